@@ -1,849 +1,2202 @@
-/*
- *  Lisp-DSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
- *  please contact with <diyer175@hotmail.com> if you have any problems.
- *
- *  This project is free software; you can redistribute it and/or
- *  modify it under the terms of the GNU Lesser General Public License(GPL)
- *  as published by the Free Software Foundation; either version 2.1
- *  of the License, or (at your option) any later version.
- *
- *  This project is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
- *  Lesser General Public License for more details.
- */
-
-#ifndef LISPDSL_H_
-#define LISPDSL_H_
-
-#include <cassert>
-#include <cstddef>
-#include <cstdarg>
-
-#include <iostream>
-
-namespace DSL {
-
-/*
- * Switchs
- */
-
-#define USES(obj)    (defined USES_##obj && USES_##obj)
-/** @def HAVE()
- * indicates whether the host machine supports 'obj'
- */
-#define HAVE(obj)   (defined HAVE_##obj && HAVE_##obj)
-/** @def ENABLE()
- * indicates whether the 'obj' is enabled
- */
-#define ENABLE(obj) (defined ENABLE_##obj && ENABLE_##obj)
-
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * cdefs
- */
-
-/** @def UNLIKELY
- * Branch prediction. Unlikely
- * @returns the value of expression.
- * @param   expr  The expression.
- */
-
-#ifdef __GNUC__
-# if __GNUC__ >= 3 && !defined(FORTIFY_RUNNING)
-#  ifndef LIKELY
-#  define LIKELY(expr)       __builtin_expect(!!(expr), 1)
-#  endif
-#  ifndef UNLIKELY
-#  define UNLIKELY(expr)     __builtin_expect(!!(expr), 0)
-#  endif
-# else
-#  ifndef LIKELY
-#  define LIKELY(expr)       (expr)
-#  endif
-#  ifndef UNLIKELY
-#  define UNLIKELY(expr)     (expr)
-#  endif
-# endif
-#else
-# ifndef LIKELY
-# define LIKELY(expr)       (expr)
-# endif
-# ifndef UNLIKELY
-# define UNLIKELY(expr)     (expr)
-# endif
-#endif
-
-#if __GNUC__
-#define LP_CURRENT_FUNCTION __PRETTY_FUNCTION__
-#else
-#define LP_CURRENT_FUNCTION __FUNCTION__
-#endif
-#define LP_CURRENT_FILE __FILE__
-#define LP_CURRENT_LINE __LINE__
-
-/** @def NULL
- * Null pointer
- */
-#ifndef NULL
-# ifdef __cplusplus
-# define NULL 0
-#else
-# define NULL (void*)0
-#endif
-#endif
-
-/** @def UNUSED
- * Avoid the 'unused parameter' warning.
- */
-#define UNUSED(var) (void)var
-
-////////////////////////////////////////////////////////////////////////////////
-
-
-/*
- * Assertions
- */
-#if ENABLE(ASSERTIONS)
-
-static void lpAssertFailure(const char* file, int line, const char* func, const char*expr) {
-    UNUSED(file);
-    UNUSED(line);
-    UNUSED(func);
-    UNUSED(expr);
-
-}
-static void lpAssertFailureLog(const char* format,...) {
-    UNUSED(format);
-}
-
-#define LP_ASSERT_PANIC() assert(0)
-
-/** @todo: implement the variable parameter by __VA_ARGS__ */
-
-/** @def LP_ASSERT
- * ASSERT that an expression is true. If it's not emit the breakpoint.
- * @param   assertion  The Expression.
- */
-#define LP_ASSERT(assertion) \
-    (UNLIKELY(!(assertion)) ? \
-        (lpAssertFailure(__FILE__, __LINE__, LP_CURRENT_FUNCTION, #assertion), \
-         LP_ASSERT_PANIC()) : \
-        (void)0)
-
-
-/** @def LP_ASSERT_LOG
- * If the expression isn't true, will report the txt-message and emit the breakpoint.
- * @param   assertion  The Expression.
- * @param   msg        Message format,args,... (must be in brackets).
- *                     eg. LP_ASSERT_LOG(expr, ("msg format", arg1, arg2, ...) );
- */
-#define LP_ASSERT_LOG(assertion, msg) \
-    (UNLIKELY(!(assertion)) ? \
-        (lpAssertFailure(__FILE__, __LINE__, LP_CURRENT_FUNCTION, #assertion), \
-         lpAssertFailureMsg msg , \
-         LP_ASSERT_PANIC()) : \
-        (void)0)
-
-
-/** @def ASSERT_STATIC_INT
- * static_assert emulated.(non standard)
- * This differs from AssertCompile in that it accepts some more expressions
- * than what C++0x allows
- * @param   assertion    The expression.
- */
-#define LP_ASSERT_STATIC_INT(assertion)  typedef int known[(assertion) ? 1 : -1]
-
-/** @def ASSERT_STATIC
- * Asserts that a C++0x compile-time expression is true. If it's not break the
- * build.
- * @param   assertion    The Expression.
- */
-#ifdef HAVE_STATIC_ASSERT
-# define LP_ASSERT_STATIC(assertion) static_assert(!!(assertion), #assertion)
-#else
-# define LP_ASSERT_STATIC(assertion) LP_ASSERT_STATIC_INT(assertion)
-#endif
-
-
-#else
-
-/*
- dummy
- */
-#define LP_ASSERT(assertion) ((void)0)
-#define LP_ASSERT_LOG(assertion, msg) ((void)0)
-#define LP_ASSERT_STATIC(assertion) ((void)0)
-
-#endif //ENABLE(ASSERTIONS)
-
-
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * Errors
- */
-
-/** Operation was succeeded. */
-#define LINF_SUCCEEDED (1)
-/** Operation was failed. */
-#define LERR_FAILED (0)
-/** Failed to allocate the memory. */
-#define LERR_ALLOC_MEMORY (-1)
-/** The stream has been opened */
-#define LERR_STREAM_HAS_BEEN_OPENED (-2)
-/** Invalid lexicon. */
-#define LERR_INVALID_LEX (-3)
-/** Report a error */
-#define LERR_THROW_ERROR (-4)
-/** Syntax error */
-#define LERR_SYNTAX_ERROR (-5)
-/** The symbol was not found */
-#define LERR_SYMBOL_NOT_FOUND (-6)
-/** Target is not matched */
-#define LERR_NOT_MATCHED (-7)
-/** Stack overflows */
-#define LERR_STACK_OVERFLOWS (-8)
-
-#define LP_SUCCESS(rc) (rc>0)
-#define LP_FAILURE(rc) (rc<1)
-
-#define UPDATE_RC(rc) do {if LP_FAILURE(rc) return rc;} while(0)
-
-#define AssertRC(rc) do {LP_ASSERT(LP_SUCCESS(rc)); } while(0)
-
-
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * Logging
- */
-
-enum LogLevel {
-  INFO = 0,
-  WARNING,
-  ERROR,
-  VERBOSE,
-  DEBUG0,
-  DEBUG1,
-  DEBUG2,
-};
-
-
-#if ENABLE(LOG)
-# define logLevelThreshold (DEBUG2)
-#else
-# define logLevelThreshold (ERROR)
-#endif
-
-class logstream{
-public:
-  logstream(LogLevel level)
-  {
-    m_level = level;
-  }
-
- template <class T>
-  std::ostream & operator<<(T value) const
-  {
-    if (m_level <= logLevelThreshold)
-      {
-#if 0
-        return std::cout.operator <<(value);
-#endif
-        return std::cout << value;
-      }
-    return std::cout;
-  }
-
- ~logstream()
- {
-   std::cout.flush(); /* flush the stream */
- }
-
-private:
-  LogLevel m_level;
-};
-
-# define LOG(level) logstream(level)
-
-
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * Marks
- */
-#define __OUT
-#define __IN
-
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * Export
- */
-#ifdef IN_SHARED
-# ifdef __GNUC__
-#  define LP_EXPORT __attribute__((visibility("default")))
-# else
-#  define LP_EXPORT __declspec(dllexport)
-# endif
-#else
-# define LP_EXPORT
-#endif
-
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * String
- */
-
-#define IsSpace(c) (c =='\t'|| c =='\n'|| c ==' ')
-#define IsDigit(c) ((c) >= '0' && (c) <= '9')
-
-////////////////////////////////////////////////////////////////////////////////
-
-
-/*
- * Config
- */
-#define MAX_LEX_LEN 80
-
-
-
-
-
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * Stream
- */
-
-/**
- * File stream error code
- */
-enum StreamError
-{
-  STREAM_ERR_INVALID = 0,
-  STREAM_ERR_NO,
-  STREAM_ERR_OPEN,
-  STREAM_ERR_CLOSE,
-  STREAM_ERR_READ,
-  STREAM_ERR_WRITE,
-  STREAM_ERR_SEEK,
-  STREAM_ERR_TELL,
-  STREAM_ERR_GETSIZE,
-  STREAM_ERR_FLUSH
-};
-
-/**
- File stream Seek mode
- */
-enum StreamSeekMode
-{
-  STREAM_SEEK_SET, /**< Seek from the beginning of the file */
-  STREAM_SEEK_CUR, /**< Seek from current position */
-  STREAM_SEEK_END  /**< Seek from the end of the file */
-};
-
-/**
- file offset internal
- */
-typedef unsigned long long file_off;
-
-#define STREAM_EOF (-1)
-
-/***************************************************
-  *****            IStream object              *****
-  ***************************************************/
-
-class IStream {
-public:
-  virtual ~IStream() {}
-
-  virtual int Open(const char *filename, const char *mode) =0;
-  virtual int Close() =0;
-
-  /* in/out */
-  /* ................................................ */
-  virtual file_off Read(void *buffer, file_off size, file_off count) =0;
-  virtual file_off Write(const void *buffer, file_off size, file_off count) =0;
-  virtual char Getchar() =0;
-  virtual int UnGetchar(char c) =0;
-  virtual char Peek() =0;
-  virtual int Seek(file_off pos, StreamSeekMode mode) =0;
-  virtual file_off Tell() =0;
-  virtual file_off GetSize() =0;
-  virtual int Flush() =0;
-};
-
-/***************************************************
-  *****             Stream object              *****
-  ***************************************************/
-
-LP_EXPORT class Stream {
-public:
-  static IStream *CreateStream();
-};
-
-
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * String
- */
-#define _MAX_BUFF_SIZE (16) /* power of 2 */
-
-/***************************************************
-  *****          StringPool object             *****
-  ***************************************************/
-
-LP_EXPORT class StringPool {
-public:
-  StringPool();
-  ~StringPool();
-
-  int append(const char *src, size_t len);
-  int append(const char *src);
-  int copy(const char *src, size_t len);
-  int copy(const char *src);
-  int copy(const StringPool &src);
-  int compare(const char *src);
-  int compare(const StringPool &src);
-
-  size_t length();
-  char *buffer() const;
-  
-  inline char & operator [](const size_t &i)
-  {
-    LP_ASSERT(i >=0 && i < len);
-    return buffer()[i];
-  }
-
-  inline StringPool &operator ++()
-  {
-    LP_ASSERT((curpos + 1) < len);
-    curpos++;
-    return *this;
-  }
-
-  inline StringPool &operator --()
-  {
-    LP_ASSERT((curpos + 1) < len);
-    curpos--;
-    return *this;
-  }
-
-private:
-  int resizeBuffer(size_t newsize);
-  int reallocBuffer(size_t size);
-private:
-  char buff[_MAX_BUFF_SIZE];
-  char *heap_buff;
-  size_t len;
-  size_t buffsize;
-  bool inheap;
-  size_t curpos;
-};
-
-int parserNumberStr(const char *src, __OUT double *out);
-
-/*
- * Lexicon type
- */
-enum LexType {
-  LEX_INVALID = 0,
-  LEX_OPEN_PAREN,
-  LEX_CLOSE_PAREN,
-  LEX_STRING,
-  LEX_MISC
-};
-
-/*
- * Lexicon node.
- */
-class LexNode {
-public:
-  LexType      m_type;
-  StringPool   m_word;
-  file_off     m_line;
-  LexNode     *m_prev;
-  LexNode     *m_next;
-};
-
-/***************************************************
-  *****             Lexer object               *****
-  ***************************************************/
-
-LP_EXPORT class Lexer {
-public:
-  Lexer();
-  int lex(IStream *stream);
-  void dumplist();
-
-  /**
-   * Get the root of list.
-   * @return pointer to the root node.
-   */
-  inline LexNode *
-  getListRoot()
-  {
-    return lexlist; // "reverse" the list.
-  }
-
-  /**
-   * Get the tail of list.
-   * @return pointer to the tail node.
-   */
-  inline LexNode *
-  getListTail()
-  {
-    return lexlistTail; // "reverse" the list.
-  }
-
-private:
-  inline void skipComment(char *c);
-  static int createLexNode(LexType type, const char *word, file_off line, __OUT LexNode **out);
-  void insertLexNode(LexNode *node);
-  int lexMisc(LexNode *lex, char c);
-
-private:
-  IStream *stream;
-  LexNode *lexlist;
-  LexNode *lexlistTail;
-  file_off currentLine;
-};
-
-/*
- * Types of object
- */
-enum objType
-{
-  OBJTYPE_INVALID = 0,
-  OBJTYPE_BOOLEAN,
-  OBJTYPE_NUMBER,
-  OBJTYPE_CHARACTER,
-  OBJTYPE_STRING,
-  OBJTYPE_SYMBOL,
-  OBJTYPE_PAIR,
-  OBJTYPE_FUNC
-};
-
-/*
- * Object data
- */
-struct objData {
-  objType type;
-  union {
-    struct {
-      bool v;
-    } OBJTYPE_BOOLEAN;
-
-    struct {
-      double v;
-    } OBJTYPE_NUMBER;
-
-    struct {
-      char v;
-    } OBJTYPE_CHARACTER;
-
-    struct {
-      StringPool *v;
-    } OBJTYPE_STRING;
-
-    struct {
-      struct SynNode *leaf;
-      struct SynNode *next;
-    } OBJTYPE_PAIR;
-
-    struct {
-      StringPool *v;
-    } OBJTYPE_SYMBOL;
-
-    struct {
-      struct SynNode *params;
-      struct SynNode *body;
-      int envsp;
-    } OBJTYPE_FUNC;
-  } u;
-};
-
-/**
- * NOTE: the following is extremely DANGEROUS for the performance.
- * Ensure that we have disabled the assertions when compiling a release version.
- */
-#if ENABLE(ASSERTIONS)
-# define OBJ_VALUE(t, s) (LP_ASSERT(t == s->object.type), (s->object.u.t).v )
-# define OBJ_LEAF(s) (LP_ASSERT(OBJTYPE_PAIR == s->object.type), (s->object.u.OBJTYPE_PAIR.leaf) )
-# define OBJ_NEXT(s) (LP_ASSERT(OBJTYPE_PAIR == s->object.type), (s->object.u.OBJTYPE_PAIR.next) )
-#else
-# define OBJ_VALUE(t, s) (s->object.u.t).v
-# define OBJ_LEAF(s) (s->object.u.OBJTYPE_PAIR.leaf)
-# define OBJ_NEXT(s) (s->object.u.OBJTYPE_PAIR.next)
-#endif
-#define OBJ_LEAF2(s) OBJ_LEAF(OBJ_LEAF(s))
-#define OBJ_LEAF3(s) OBJ_LEAF2(OBJ_LEAF(s))
-#define OBJ_NEXT2(s) OBJ_NEXT(OBJ_NEXT(s))
-#define OBJ_NEXT3(s) OBJ_NEXT2(OBJ_NEXT(s))
-
-
-/*
- * Syntax node
- */
-struct SynNode
-{
-  objData object;
-  file_off line;
-};
-
-class Lisp;
-
-/*
- * Environment stack index.
- */
-typedef int EnvSP;
-
-
-/*
- * Inner, create a atom-type syntax node.
- * @param gc GC object reference.
- * @param t Type of data object.
- * @param out Where to store the pointer of node.
- * @parem v Value want to set.
- * @param l The number of line.
- * @param Where to store the status code.
- */
-#define createAtom(gc, t, out, v, l, rcref) \
-  do \
-    { \
-      rcref = gc._createAtom(&out); \
-      if (LP_SUCCESS(rcref)) \
-        { \
-          out->object.type = t; \
-          out->line = l; \
-          OBJ_VALUE(t, out) = v; \
-        } \
-    } \
-  while(0)
-
-/***************************************************
-  *****      Garbage Collection object         *****
-  ***************************************************/
-LP_EXPORT class GC {
-public:
-  GC();
-
-  int createSynNode(SynNode *leaf, SynNode *next, __OUT SynNode **out);
-  int createPair(SynNode *leaf, SynNode *next, file_off line, __OUT SynNode **out);
-  int createFunc(SynNode *params, SynNode *body, EnvSP sp, file_off line, __OUT SynNode **out);
-  int _createAtom(__OUT SynNode **out);
-};
-
-
-/***************************************************
-  *****             Parser object              *****
-  ***************************************************/
-LP_EXPORT class Parser {
-public:
-  Parser(GC *gc);
-  int parse(LexNode *root, LexNode *tail);
-
-  void dumpast();
-
-  /*
-   * Get the root of AST (abstract syntax tree)
-   * @return pointer to the target.
-   */
-  inline SynNode *getSynRoot()
-  {
-    return m_ast;
-  }
-
-private:
-  SynNode *generate(LexNode *& lexnode, __OUT int &rc);
-  SynNode *generateList(LexNode *& lexnode, __OUT int &rc);
-  SynNode *generateNumber(LexNode *& lexnode, __OUT int &rc);
-  SynNode *generateString(LexNode *& lexnode, __OUT int &rc);
-  SynNode *generateBoolean(LexNode *& lexnode, __OUT int &rc);
-  SynNode *generateCharacter(LexNode *& lexnode, __OUT int &rc);
-  SynNode *generateSymbol(LexNode *& lexnode, __OUT int &rc);
-
-  /* inner */
-  inline GC & gc()
-  {
-    return *m_gc;
-  }
-
-private:
-  GC      *m_gc;
-  LexNode *m_lexlist;
-  LexNode *m_lexlistTail;
-  SynNode *m_ast;
-};
-
-#define _MAX_STACK_DEEPTH (2048)
-
-/***************************************************
-  *****     Environment Stack object           *****
-  ***************************************************/
-
-LP_EXPORT class EnvStack {
-public:
-  EnvStack(GC *gc);
-
-  int newenv();
-
-  int push(SynNode *vars, SynNode *vals, EnvSP sp, __OUT EnvSP *out);
-  void pop();
-
-  int lookupVariableList(EnvSP sp, SynNode *node, __OUT SynNode **out);
-  int lookupVariable(EnvSP sp, SynNode *node, __OUT SynNode **out);
-  int defineVariable(EnvSP sp, SynNode *node, SynNode *val);
-  int setVariable(EnvSP sp, SynNode *node, SynNode *val);
-  void releaseVarNode(SynNode *node);
-
-  /**
-   * Get the root node of environment in the STACK.
-   * @return pointer to the target.
-   */
-  inline SynNode* node(EnvSP sp)
-  {
-    return m_stack[sp];
-  }
-
-  /* unused */
-  inline SynNode* curnode()
-  {
-    return m_stack[m_sp];
-  }
-
-private:
-  GC      *m_gc;
-  SynNode *m_vars;
-  SynNode *m_stack[_MAX_STACK_DEEPTH];
-  EnvSP    m_sp;
-
-  /* inner */
-  inline GC &gc()
-  {
-    return *m_gc;
-  }
-};
-
-/**
- * callback. output the atom data to terminal.
- * @param node Pointer to the target node.
- * @param ln Whether print a new line.
- * @return status code.
- */
-typedef int (*pfnPrintAtom)(SynNode *node, bool ln);
-
-#define _MAX_TOKEN_NUM 32
-
-struct Token
-{
-  const char *symbol;
-  SynNode * (Lisp::*eval)(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-};
-
-#define _MAX_MSG_BUFFER 1024
-
-
-/***************************************************
-  *****             Lisp object                *****
-  ***************************************************/
-
-LP_EXPORT class Lisp {
-public:
-  Lisp();
-
-  int parser(IStream *stream);
-  int run(__OUT SynNode **out);
-  void setPrintAtomCallback(pfnPrintAtom pfn);
-
-  static int throwError(file_off line, file_off pos, const char *msg, ...);
-  /*
-   * Get the reference of envstack instance.
-   * @return envstack.
-   */
-  inline EnvStack & envstack()
-  {
-    return m_envstack;
-  }
-
-  /*
-   * Get the pointer of gc instance.
-   * @return gc.
-   */
-  inline GC &gc()
-  {
-    return m_gc;
-  }
-
-private:
-  SynNode* dispatchEvaling(SynNode *root, EnvSP envsp, __OUT int &rc);
-  SynNode* eval(SynNode *node, EnvSP envsp, __OUT int &rc);
-  SynNode* evalVariable(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* evalCall(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* evalList(SynNode *vars, SynNode *vals, EnvSP envsp, __OUT int &rc);
-  SynNode* evalProcedure(SynNode *body, SynNode *vars, SynNode *vals, EnvSP envsp, __OUT int &rc);
-
-  bool targetSymbol(SynNode *leaf);
-  bool targetCall(SynNode *leaf);
-  bool targetPair(SynNode *leaf);
-  bool targetEval(SynNode *leaf);
-
-  int validateSyntax(SynNode *leaf, int paramCount, const char *name);
-
-  SynNode* symbolSet(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolSetCar(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolSetCdr(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolDefine(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolLambda(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolIf(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolBegin(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolCond(SynNode *leaf, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolCons(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolCar(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolCdr(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolQuote(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolDisplay(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolPrint(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolEval(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolAppend(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolBooleanP(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolNumberP(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolCharP(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolStringP(SynNode *args, EnvSP envsp, __OUT int &rc);
-
-  SynNode* symbolAdd(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolSub(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolMul(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolDiv(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolEqual(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolGreater(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolLess(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolEGreater(SynNode *args, EnvSP envsp, __OUT int &rc);
-  SynNode* symbolELess(SynNode *args, EnvSP envsp, __OUT int &rc);
-
-private:
-  SynNode* displayInner(SynNode *args, EnvSP envsp, bool ln, __OUT int &rc);
-  SynNode* cmpInner(SynNode *args, EnvSP envsp, int op, __OUT int &rc);
-  SynNode* predTypeInner(SynNode *args, EnvSP envsp, objType type, __OUT int &rc);
-
-private:
-  IStream     *m_stream;
-  Lexer        m_lexer;
-  GC           m_gc;
-  Parser       m_parser;
-  EnvStack     m_envstack;
-  bool         m_parsed;
-  SynNode     *m_ast;
-  static Token  tokens[];
-  pfnPrintAtom m_printAtom;
-};
-
-
-} // namespace DSL
-
-#endif //!defined(LISPDSL_H_)
+/*
+ *  Lisp-DSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef LISPDSL_H_
+#define LISPDSL_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdarg>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include <pthread.h>
+
+namespace DSL {
+
+/*
+ * Switchs
+ */
+
+#define USES(obj)    (defined USES_##obj && USES_##obj)
+/** @def HAVE()
+ * indicates whether the host machine supports 'obj'
+ */
+#define HAVE(obj)   (defined HAVE_##obj && HAVE_##obj)
+/** @def ENABLE()
+ * indicates whether the 'obj' is enabled
+ */
+#define ENABLE(obj) (defined ENABLE_##obj && ENABLE_##obj)
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * cdefs
+ */
+
+/** @def UNLIKELY
+ * Branch prediction. Unlikely
+ * @returns the value of expression.
+ * @param   expr  The expression.
+ */
+
+#ifdef __GNUC__
+# if __GNUC__ >= 3 && !defined(FORTIFY_RUNNING)
+#  ifndef LIKELY
+#  define LIKELY(expr)       __builtin_expect(!!(expr), 1)
+#  endif
+#  ifndef UNLIKELY
+#  define UNLIKELY(expr)     __builtin_expect(!!(expr), 0)
+#  endif
+# else
+#  ifndef LIKELY
+#  define LIKELY(expr)       (expr)
+#  endif
+#  ifndef UNLIKELY
+#  define UNLIKELY(expr)     (expr)
+#  endif
+# endif
+#else
+# ifndef LIKELY
+# define LIKELY(expr)       (expr)
+# endif
+# ifndef UNLIKELY
+# define UNLIKELY(expr)     (expr)
+# endif
+#endif
+
+#if __GNUC__
+#define LP_CURRENT_FUNCTION __PRETTY_FUNCTION__
+#else
+#define LP_CURRENT_FUNCTION __FUNCTION__
+#endif
+#define LP_CURRENT_FILE __FILE__
+#define LP_CURRENT_LINE __LINE__
+
+/** @def NULL
+ * Null pointer
+ */
+#ifndef NULL
+# ifdef __cplusplus
+# define NULL 0
+#else
+# define NULL (void*)0
+#endif
+#endif
+
+/** @def UNUSED
+ * Avoid the 'unused parameter' warning.
+ */
+#define UNUSED(var) (void)var
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ * Assertions
+ */
+#if ENABLE(ASSERTIONS)
+
+static void lpAssertFailure(const char* file, int line, const char* func, const char*expr) {
+    UNUSED(file);
+    UNUSED(line);
+    UNUSED(func);
+    UNUSED(expr);
+
+}
+static void lpAssertFailureLog(const char* format,...) {
+    UNUSED(format);
+}
+
+#define LP_ASSERT_PANIC() assert(0)
+
+/** @todo: implement the variable parameter by __VA_ARGS__ */
+
+/** @def LP_ASSERT
+ * ASSERT that an expression is true. If it's not emit the breakpoint.
+ * @param   assertion  The Expression.
+ */
+#define LP_ASSERT(assertion) \
+    (UNLIKELY(!(assertion)) ? \
+        (lpAssertFailure(__FILE__, __LINE__, LP_CURRENT_FUNCTION, #assertion), \
+         LP_ASSERT_PANIC()) : \
+        (void)0)
+
+
+/** @def LP_ASSERT_LOG
+ * If the expression isn't true, will report the txt-message and emit the breakpoint.
+ * @param   assertion  The Expression.
+ * @param   msg        Message format,args,... (must be in brackets).
+ *                     eg. LP_ASSERT_LOG(expr, ("msg format", arg1, arg2, ...) );
+ */
+#define LP_ASSERT_LOG(assertion, msg) \
+    (UNLIKELY(!(assertion)) ? \
+        (lpAssertFailure(__FILE__, __LINE__, LP_CURRENT_FUNCTION, #assertion), \
+         lpAssertFailureMsg msg , \
+         LP_ASSERT_PANIC()) : \
+        (void)0)
+
+
+/** @def ASSERT_STATIC_INT
+ * static_assert emulated.(non standard)
+ * This differs from AssertCompile in that it accepts some more expressions
+ * than what C++0x allows
+ * @param   assertion    The expression.
+ */
+#define LP_ASSERT_STATIC_INT(assertion)  typedef int known[(assertion) ? 1 : -1]
+
+/** @def ASSERT_STATIC
+ * Asserts that a C++0x compile-time expression is true. If it's not break the
+ * build.
+ * @param   assertion    The Expression.
+ */
+#ifdef HAVE_STATIC_ASSERT
+# define LP_ASSERT_STATIC(assertion) static_assert(!!(assertion), #assertion)
+#else
+# define LP_ASSERT_STATIC(assertion) LP_ASSERT_STATIC_INT(assertion)
+#endif
+
+
+#else
+
+/*
+ dummy
+ */
+#define LP_ASSERT(assertion) ((void)0)
+#define LP_ASSERT_LOG(assertion, msg) ((void)0)
+#define LP_ASSERT_STATIC(assertion) ((void)0)
+
+#endif //ENABLE(ASSERTIONS)
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Errors
+ */
+
+/** Operation was succeeded. */
+#define LINF_SUCCEEDED (1)
+/** Reached the end of stream, nothing more to process. */
+#define LINF_END_OF_STREAM (2)
+/** Evaluation was suspended, see Lisp::resume(). */
+#define LINF_SUSPENDED (3)
+/** Operation was failed. */
+#define LERR_FAILED (0)
+/** Failed to allocate the memory. */
+#define LERR_ALLOC_MEMORY (-1)
+/** The stream has been opened */
+#define LERR_STREAM_HAS_BEEN_OPENED (-2)
+/** Invalid lexicon. */
+#define LERR_INVALID_LEX (-3)
+/** Report a error */
+#define LERR_THROW_ERROR (-4)
+/** Syntax error */
+#define LERR_SYNTAX_ERROR (-5)
+/** The symbol was not found */
+#define LERR_SYMBOL_NOT_FOUND (-6)
+/** Target is not matched */
+#define LERR_NOT_MATCHED (-7)
+/** Stack overflows */
+#define LERR_STACK_OVERFLOWS (-8)
+/** Object is read-only */
+#define LERR_READ_ONLY (-9)
+/** Heap limit exceeded */
+#define LERR_HEAP_LIMIT (-10)
+/** Fuel or time of evaluation was used up */
+#define LERR_OUT_OF_FUEL (-11)
+
+#define LP_SUCCESS(rc) (rc>0)
+#define LP_FAILURE(rc) (rc<1)
+
+#define UPDATE_RC(rc) do {if LP_FAILURE(rc) return rc;} while(0)
+
+#define AssertRC(rc) do {LP_ASSERT(LP_SUCCESS(rc)); } while(0)
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Logging
+ */
+
+enum LogLevel {
+  INFO = 0,
+  WARNING,
+  ERROR,
+  VERBOSE,
+  DEBUG0,
+  DEBUG1,
+  DEBUG2,
+};
+
+
+#if ENABLE(LOG)
+# define logLevelThreshold (DEBUG2)
+#else
+# define logLevelThreshold (ERROR)
+#endif
+
+/*
+ * The message is gathered in a buffer of its own and written at once,
+ * so that the messages of different threads are not interleaved.
+ */
+class logstream{
+public:
+  logstream(LogLevel level)
+  {
+    UNUSED(level);
+  }
+
+  std::ostream &stream()
+  {
+    return m_buff;
+  }
+
+ ~logstream()
+ {
+   std::string text = m_buff.str();
+   fwrite(text.data(), 1, text.size(), stdout);
+   fflush(stdout); /* flush the stream */
+ }
+
+private:
+  std::ostringstream m_buff;
+};
+
+/*
+ * Inner, turn the stream expression of LOG() into void,
+ * so that it can be a operand of '?:'.
+ */
+class logvoidify{
+public:
+  void operator &(std::ostream &) {}
+};
+
+#define LOG_IS_ON(level) ((level) <= logLevelThreshold)
+
+/*
+ * The level is compared with a constant, so a disabled LOG statement
+ * is removed by the compiler along with all the operands of '<<',
+ * which are never evaluated.
+ */
+# define LOG(level) \
+  !LOG_IS_ON(level) ? (void)0 : logvoidify() & logstream(level).stream()
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Marks
+ */
+#define __OUT
+#define __IN
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Export
+ */
+#ifdef IN_SHARED
+# ifdef __GNUC__
+#  define LP_EXPORT __attribute__((visibility("default")))
+# else
+#  define LP_EXPORT __declspec(dllexport)
+# endif
+#else
+# define LP_EXPORT
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * String
+ */
+
+#define IsSpace(c) (c =='\t'|| c =='\n'|| c =='\r'|| c ==' ')
+#define IsDigit(c) ((c) >= '0' && (c) <= '9')
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ * Config
+ */
+#define MAX_LEX_LEN 80
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Stream
+ */
+
+/**
+ * File stream error code
+ */
+enum StreamError
+{
+  STREAM_ERR_INVALID = 0,
+  STREAM_ERR_NO,
+  STREAM_ERR_OPEN,
+  STREAM_ERR_CLOSE,
+  STREAM_ERR_READ,
+  STREAM_ERR_WRITE,
+  STREAM_ERR_SEEK,
+  STREAM_ERR_TELL,
+  STREAM_ERR_GETSIZE,
+  STREAM_ERR_FLUSH
+};
+
+/**
+ File stream Seek mode
+ */
+enum StreamSeekMode
+{
+  STREAM_SEEK_SET, /**< Seek from the beginning of the file */
+  STREAM_SEEK_CUR, /**< Seek from current position */
+  STREAM_SEEK_END  /**< Seek from the end of the file */
+};
+
+/**
+ file offset internal
+ */
+typedef unsigned long long file_off;
+
+#define STREAM_EOF (-1)
+
+/***************************************************
+  *****            IStream object              *****
+  ***************************************************/
+
+class IStream {
+public:
+  virtual ~IStream() {}
+
+  virtual int Open(const char *filename, const char *mode) =0;
+  virtual int Close() =0;
+
+  /* in/out */
+  /* ................................................ */
+  virtual file_off Read(void *buffer, file_off size, file_off count) =0;
+  virtual file_off Write(const void *buffer, file_off size, file_off count) =0;
+  virtual char Getchar() =0;
+  virtual int UnGetchar(char c) =0;
+  virtual char Peek() =0;
+  virtual int Seek(file_off pos, StreamSeekMode mode) =0;
+  virtual file_off Tell() =0;
+  virtual file_off GetSize() =0;
+  virtual int Flush() =0;
+};
+
+/***************************************************
+  *****             Stream object              *****
+  ***************************************************/
+
+LP_EXPORT class Stream {
+public:
+  static IStream *CreateStream();
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * String
+ */
+#define _MAX_BUFF_SIZE (16) /* power of 2 */
+
+/***************************************************
+  *****          StringPool object             *****
+  ***************************************************/
+
+LP_EXPORT class StringPool {
+public:
+  StringPool();
+  ~StringPool();
+
+  int append(const char *src, size_t len);
+  int append(const char *src);
+  int copy(const char *src, size_t len);
+  int copy(const char *src);
+  int copy(const StringPool &src);
+  int compare(const char *src);
+  int compare(const StringPool &src);
+  int reserve(size_t size);
+  void move(StringPool &src);
+
+  size_t length();
+  char *buffer() const;
+  
+  inline char & operator [](const size_t &i)
+  {
+    LP_ASSERT(i >=0 && i < len);
+    return buffer()[i];
+  }
+
+  inline StringPool &operator ++()
+  {
+    LP_ASSERT((curpos + 1) < len);
+    curpos++;
+    return *this;
+  }
+
+  inline StringPool &operator --()
+  {
+    LP_ASSERT((curpos + 1) < len);
+    curpos--;
+    return *this;
+  }
+
+private:
+  int resizeBuffer(size_t size);
+  int reallocBuffer(size_t size);
+private:
+  char buff[_MAX_BUFF_SIZE];
+  char *heap_buff;
+  size_t len;
+  size_t buffsize;
+  bool inheap;
+  size_t curpos;
+};
+
+/***************************************************
+  *****           ImmString object             *****
+  ***************************************************/
+
+/**
+ * Immutable string. The length, the hash and the bytes (with a '\0'
+ * termination) live in a single block, allocated by create().
+ */
+LP_EXPORT class ImmString {
+public:
+  static ImmString *create(const char *src, size_t len);
+  static ImmString *create(const char *src);
+  static void release(ImmString *str);
+  static size_t sizeOf(size_t len);
+  static ImmString *construct(void *block, const char *src, size_t len);
+
+  int compare(const char *src) const;
+  int compare(const char *src, size_t len) const;
+  int compare(const ImmString &src) const;
+
+  /**
+   * Get the length of string, barring '\0' termination.
+   * @return the value in bytes.
+   */
+  inline size_t length() const
+  {
+    return m_len;
+  }
+
+  /**
+   * Get the pointer to the bytes, terminated by '\0'.
+   * @return the result.
+   */
+  inline const char *buffer() const
+  {
+    return m_data;
+  }
+
+  /**
+   * Get the hash of the bytes, computed once by create().
+   * @return the result.
+   */
+  inline unsigned long long hash() const
+  {
+    return m_hash;
+  }
+
+private:
+  ImmString() {}
+  ImmString(const ImmString &);
+  ImmString &operator =(const ImmString &);
+
+private:
+  size_t             m_len;
+  unsigned long long m_hash;
+  char               m_data[1];
+};
+
+int parserNumberStr(const char *src, __OUT double *out);
+int formatNumber(double v, __OUT StringPool &out);
+unsigned long long hashBuffer(const void *src, size_t len);
+
+/*
+ * Lexicon type
+ */
+enum LexType {
+  LEX_INVALID = 0,
+  LEX_OPEN_PAREN,
+  LEX_CLOSE_PAREN,
+  LEX_STRING,
+  LEX_MISC
+};
+
+/*
+ * Lexicon node.
+ */
+class LexNode {
+public:
+  LexType      m_type;
+  StringPool   m_word;
+  file_off     m_line;
+  file_off     m_column;
+};
+
+/**
+ * Receiver of the error messages, see Lisp::setErrorSink().
+ * @param line The number of source line, 0 if unknown.
+ * @param column The number of column, 0 if unknown.
+ * @param msg The message.
+ * @param opaque The pointer given to setErrorSink().
+ */
+typedef void (*pfnReportError)(file_off line, file_off column, const char *msg, void *opaque);
+
+struct ErrorSink
+{
+  pfnReportError pfn;
+  void          *opaque;
+};
+
+/***************************************************
+  *****             Lexer object               *****
+  ***************************************************/
+
+/**
+ * The lexer is pull-based: the parser asks for one token at a time,
+ * so only the token under processing is kept in memory.
+ */
+LP_EXPORT class Lexer {
+public:
+  Lexer();
+  int open(IStream *stream);
+  int next(__OUT LexNode **out);
+  static void dumpnode(const LexNode *node);
+
+  /**
+   * Enable or disable the dump of each lexicon pulled.
+   * @param enable Whether to enable it.
+   */
+  inline void
+  setDump(bool enable)
+  {
+    dumping = enable;
+  }
+
+  /**
+   * Set where to report the errors, 0 for the log.
+   * @param sink Pointer to the sink, kept by the caller.
+   */
+  inline void
+  setErrorSink(const ErrorSink *sink)
+  {
+    errors = sink;
+  }
+
+  /**
+   * Get the number of line currently lexing.
+   * @return the result.
+   */
+  inline file_off
+  line() const
+  {
+    return currentLine;
+  }
+
+private:
+  inline char readChar();
+  inline void unreadChar(char c);
+  inline void skipComment(char *c);
+  int lexMisc(LexNode *lex, char c);
+
+private:
+  IStream *stream;
+  LexNode  token;
+  file_off currentLine;
+  file_off currentColumn;
+  file_off lastColumn;
+  bool     dumping;
+  const ErrorSink *errors;
+};
+
+/*
+ * Types of object
+ */
+enum objType
+{
+  OBJTYPE_INVALID = 0,
+  OBJTYPE_BOOLEAN,
+  OBJTYPE_NUMBER,
+  OBJTYPE_CHARACTER,
+  OBJTYPE_STRING,
+  OBJTYPE_SYMBOL,
+  OBJTYPE_PAIR,
+  OBJTYPE_FUNC,
+  OBJTYPE_PORT,
+  OBJTYPE_FUTURE
+};
+
+/*
+ * Object data
+ */
+struct objData {
+  objType type;
+  union {
+    struct {
+      bool v;
+    } OBJTYPE_BOOLEAN;
+
+    struct {
+      double v;
+    } OBJTYPE_NUMBER;
+
+    struct {
+      char v;
+    } OBJTYPE_CHARACTER;
+
+    struct {
+      ImmString *v;
+    } OBJTYPE_STRING;
+
+    struct {
+      struct SynNode *leaf;
+      struct SynNode *next;
+    } OBJTYPE_PAIR;
+
+    struct {
+      ImmString *v;
+    } OBJTYPE_SYMBOL;
+
+    struct {
+      struct SynNode *params;
+      struct SynNode *body;
+      int envsp;
+    } OBJTYPE_FUNC;
+
+    struct {
+      StringPool *v; /* output string port */
+    } OBJTYPE_PORT;
+
+    struct {
+      unsigned long serial; /* of the task, 0 if resolved */
+      struct SynNode *value;
+      int rc;
+    } OBJTYPE_FUTURE;
+  } u;
+};
+
+/**
+ * NOTE: the following is extremely DANGEROUS for the performance.
+ * Ensure that we have disabled the assertions when compiling a release version.
+ */
+#if ENABLE(ASSERTIONS)
+# define OBJ_VALUE(t, s) (LP_ASSERT(t == s->object.type), (s->object.u.t).v )
+# define OBJ_LEAF(s) (LP_ASSERT(OBJTYPE_PAIR == s->object.type), (s->object.u.OBJTYPE_PAIR.leaf) )
+# define OBJ_NEXT(s) (LP_ASSERT(OBJTYPE_PAIR == s->object.type), (s->object.u.OBJTYPE_PAIR.next) )
+#else
+# define OBJ_VALUE(t, s) (s->object.u.t).v
+# define OBJ_LEAF(s) (s->object.u.OBJTYPE_PAIR.leaf)
+# define OBJ_NEXT(s) (s->object.u.OBJTYPE_PAIR.next)
+#endif
+#define OBJ_LEAF2(s) OBJ_LEAF(OBJ_LEAF(s))
+#define OBJ_LEAF3(s) OBJ_LEAF2(OBJ_LEAF(s))
+#define OBJ_NEXT2(s) OBJ_NEXT(OBJ_NEXT(s))
+#define OBJ_NEXT3(s) OBJ_NEXT2(OBJ_NEXT(s))
+
+
+/*
+ * Syntax node.
+ * The position in source is not stored here but in the SourceMap,
+ * only for the nodes generated by the parser.
+ */
+struct SynNode
+{
+  objData object;
+};
+
+class Lisp;
+
+/*
+ * Environment stack index.
+ */
+typedef int EnvSP;
+
+
+/*
+ * Inner, create a atom-type syntax node.
+ * @param gc GC object reference.
+ * @param t Type of data object.
+ * @param out Where to store the pointer of node.
+ * @parem v Value want to set.
+ * @param Where to store the status code.
+ */
+#define createAtom(gc, t, out, v, rcref) \
+  do \
+    { \
+      rcref = gc._createAtom(&out); \
+      if (LP_SUCCESS(rcref)) \
+        { \
+          out->object.type = t; \
+          OBJ_VALUE(t, out) = v; \
+        } \
+    } \
+  while(0)
+
+/***************************************************
+  *****             PtrMap object              *****
+  ***************************************************/
+
+/*
+ * Filter of the keys in a table, see PtrMap::retain().
+ * @param key The key.
+ * @param opaque The pointer given by caller.
+ * @return true if the entry is kept.
+ */
+typedef bool (*pfnRetainKey)(const void *key, void *opaque);
+
+/*
+ * Position of the filtering in steps, see PtrMap::retainSome().
+ * It starts again if the table is resized between the steps.
+ */
+struct RetainCursor
+{
+  size_t slot;
+  size_t size;  /* of the table, ~0 to start again */
+};
+
+struct PtrMapEntry
+{
+  const void         *key;
+  unsigned long long  value;
+};
+
+/**
+ * Open-addressing hash map from pointer to integer.
+ */
+LP_EXPORT class PtrMap {
+public:
+  PtrMap();
+  ~PtrMap();
+
+  int insert(const void *key, unsigned long long value);
+  bool lookup(const void *key, __OUT unsigned long long *value) const;
+  int retain(pfnRetainKey pfn, void *opaque);
+  bool retainSome(pfnRetainKey pfn, void *opaque, RetainCursor *at, size_t steps);
+  int reserve(size_t count);
+  void clear();
+
+  /**
+   * Get the number of entries.
+   * @return the result.
+   */
+  inline size_t size() const
+  {
+    return m_count;
+  }
+
+private:
+  int rehash(size_t newsize);
+  void removeAt(size_t pos);
+
+private:
+  PtrMapEntry *m_table;
+  size_t       m_size;
+  size_t       m_count;
+};
+
+/***************************************************
+  *****           SourceMap object             *****
+  ***************************************************/
+
+/**
+ * Side table of the positions in source, keyed by the syntax node.
+ */
+LP_EXPORT class SourceMap {
+public:
+  int add(const SynNode *node, file_off line, file_off column);
+  bool lookup(const SynNode *node, __OUT file_off *line, __OUT file_off *column) const;
+  int retain(pfnRetainKey pfn, void *opaque);
+  bool retainSome(pfnRetainKey pfn, void *opaque, RetainCursor *at, size_t steps);
+
+  /**
+   * Make room for the positions to be recorded, see PtrMap::reserve().
+   * @param count The number of them.
+   * @return status code.
+   */
+  inline int reserve(size_t count)
+  {
+    return m_map.reserve(count);
+  }
+
+  /**
+   * Forget all the positions.
+   */
+  inline void clear()
+  {
+    m_map.clear();
+  }
+
+private:
+  PtrMap m_map;
+};
+
+/***************************************************
+  *****            NodeStack object            *****
+  ***************************************************/
+
+/**
+ * Growable stack (or array) of syntax nodes.
+ */
+LP_EXPORT class NodeStack {
+public:
+  NodeStack();
+  ~NodeStack();
+
+  int push(SynNode *node);
+
+  inline SynNode *pop()
+  {
+    LP_ASSERT(m_count > 0);
+    return m_nodes[--m_count];
+  }
+
+  inline SynNode *& operator [](const size_t &i)
+  {
+    LP_ASSERT(i < m_count);
+    return m_nodes[i];
+  }
+
+  inline size_t count() const
+  {
+    return m_count;
+  }
+
+  inline void clear()
+  {
+    m_count = 0;
+  }
+
+  inline void truncate(size_t count)
+  {
+    LP_ASSERT(count <= m_count);
+    m_count = count;
+  }
+
+private:
+  SynNode **m_nodes;
+  size_t    m_count;
+  size_t    m_size;
+};
+
+/***************************************************
+  *****      Garbage Collection object         *****
+  ***************************************************/
+
+/*
+ * Chunk of the heap, the objects are allocated in it by bumping
+ * the pointer, or in the free runs left by the collector. The data
+ * follows the header, and the bitmaps follow the data, with a bit for
+ * each GC_GRANULE bytes.
+ */
+struct GCChunk
+{
+  GCChunk       *next;        /* link of the free chunks */
+  size_t         seq;         /* index in the order of allocation */
+  size_t         size;        /* capacity of data */
+  size_t         used;        /* bytes of data allocated */
+  size_t         sweepFrom;   /* the data to sweep lazily, see GC::collect() */
+  size_t         sweepLimit;
+  size_t         epoch;       /* of the collection the marks belong to */
+  size_t         sweepEpoch;  /* of the collection the sweeping belongs to */
+  unsigned long *starts;      /* set at the start of each block */
+  unsigned long *marks;       /* set at the start of each block reached */
+};
+
+/*
+ * Run of the free space in a chunk, linked in the free lists.
+ */
+struct GCFree
+{
+  GCFree  *next;
+  size_t   size;
+  GCChunk *chunk;
+};
+
+#define GC_GRANULE (8)
+#define GC_FREE_CLASSES (10)  /* by the granules, the last is of any size */
+#define GC_PAUSE_BUCKETS (24)
+
+/*
+ * Statistics of the collector.
+ */
+struct GCStats
+{
+  size_t             collections;
+  unsigned long long bytesFreed;
+  unsigned long long pauseTotal;  /* in microseconds */
+  unsigned long long pauseMax;
+  size_t             pauses[GC_PAUSE_BUCKETS]; /* by the log2 of microseconds */
+  size_t             chunksSwept;               /* lazily by the allocations */
+  size_t             slices;                    /* of the incremental marking */
+  unsigned long long bytesAllocated;            /* in total */
+  unsigned long long allocations;
+  size_t             refused;                   /* by the limits, see GC::setLimits() */
+};
+
+class TaskPool;
+struct GCMarkJob;
+class GC;
+
+/*
+ * callback. called when the marking of a collection completes, before
+ * the space of the objects not alive is reused, to forget them in the
+ * tables keyed by the objects, see GC::isLive(). It is called again
+ * in the following slices until it returns true, if the marking is
+ * incremental.
+ * @param gc The heap.
+ * @param restart Whether it is the first call of this collection.
+ * @param steps About how many entries to check in this call.
+ * @param opaque The pointer given by caller.
+ * @return true if all the tables are done.
+ */
+typedef bool (*pfnCollected)(GC *gc, bool restart, size_t steps, void *opaque);
+
+/*
+ * callback. called when the bytes allocated are going to exceed the soft
+ * limit, see GC::setLimits(). It may ask for a collection at the next
+ * safe point by GC::requestCollect(), or fail the allocation to abort
+ * the evaluation.
+ * @param gc The heap.
+ * @param bytes The bytes allocated with the allocation.
+ * @param opaque The pointer given by caller.
+ * @return status code, the allocation fails with LERR_HEAP_LIMIT if failed.
+ */
+typedef int (*pfnHeapLimit)(GC *gc, size_t bytes, void *opaque);
+
+/*
+ * Position in the heap, all the objects allocated after it can be
+ * released at once.
+ */
+struct GCMark
+{
+  size_t chunks;    /* number of chunks in use */
+  size_t used;      /* bytes used in the last chunk */
+  size_t bytes;     /* total bytes allocated */
+  size_t ports;     /* number of ports */
+};
+
+/*
+ * Record of the undo log.
+ */
+struct GCUndo
+{
+  SynNode **slot;
+  SynNode  *value;
+};
+
+/*
+ * State of the undo log saved by GC::enterUndo().
+ */
+struct GCUndoScope
+{
+  GCMark mark;
+  size_t base;      /* number of records in the log */
+  bool   logging;
+};
+
+#define GC_CHUNK_SIZE (64 * 1024)
+#define GC_MIN_TRIGGER (4 * 1024 * 1024)
+#define GC_SLICE_BYTES (64 * 1024)  /* allocated at most between the slices of marking */
+
+LP_EXPORT class GC {
+public:
+  GC();
+  ~GC();
+
+  int createSynNode(SynNode *leaf, SynNode *next, __OUT SynNode **out);
+  int createPair(SynNode *leaf, SynNode *next, __OUT SynNode **out);
+  int createFunc(SynNode *params, SynNode *body, EnvSP sp, __OUT SynNode **out);
+  int createString(const char *src, size_t len, __OUT ImmString **out);
+  int createPort(__OUT SynNode **out);
+  int _createAtom(__OUT SynNode **out);
+
+  void mark(__OUT GCMark *out) const;
+  void release(const GCMark &mark);
+  bool allocatedBefore(const void *p, const GCMark &mark) const;
+  void trim();
+
+  int beginUndo(const GCMark &mark);
+  void rollback();
+  void endUndo();
+  void enterUndo(const GCMark &mark, __OUT GCUndoScope *scope);
+  void leaveUndo(const GCUndoScope &scope);
+  int freeze(NodeStack &roots);
+  void thaw();
+
+  int collect(NodeStack &roots, TaskPool *pool);
+  int startCollect(NodeStack &roots);
+  bool isLive(const void *p) const;
+
+  /**
+   * Point out whether the objects allocated since the last collection
+   * reach the trigger, see setTrigger().
+   * @return true if so.
+   */
+  inline bool wantsCollect() const
+  {
+    return m_bytes >= m_trigger && !m_freezing && !m_marking;
+  }
+
+  /**
+   * Point out whether a incremental collection is marking.
+   * @return true if so.
+   */
+  inline bool isMarking() const
+  {
+    return m_marking;
+  }
+
+  /**
+   * Set the time limit of each slice of the incremental marking, see
+   * startCollect().
+   * @param us The limit in microseconds, 0 to collect at once.
+   */
+  inline void setSliceBudget(unsigned long us)
+  {
+    m_sliceBudget = us;
+  }
+
+  /**
+   * Get the time limit of each slice of the incremental marking.
+   * @return the value in microseconds, 0 if the collection is at once.
+   */
+  inline unsigned long sliceBudget() const
+  {
+    return m_sliceBudget;
+  }
+
+  /**
+   * Set the callback of the completed marking.
+   * @param pfn Pointer to the callback function, 0 for none.
+   * @param opaque The pointer passed to it.
+   */
+  inline void setCollectedCallback(pfnCollected pfn, void *opaque)
+  {
+    m_collected = pfn;
+    m_collectedOpaque = opaque;
+  }
+
+  /**
+   * Set the least bytes allocated that trigger a collection, which is
+   * GC_MIN_TRIGGER by default. After each collection the trigger is set
+   * to twice of the bytes alive, but not below it.
+   * @param bytes The bytes.
+   */
+  inline void setTrigger(size_t bytes)
+  {
+    m_trigger = m_minTrigger = bytes;
+  }
+
+  /**
+   * Ask for a collection at the next point where it is possible, as if
+   * the trigger is reached.
+   */
+  inline void requestCollect()
+  {
+    m_trigger = 0;
+  }
+
+  /**
+   * Set the limits of the bytes allocated, 0 for no limit. When the
+   * soft limit is going to be exceeded the callback of limit is called
+   * once, until the bytes fall below it again; a collection is asked by
+   * default. The allocations that would exceed the hard limit fail with
+   * LERR_HEAP_LIMIT, the garbage not collected yet is counted.
+   * @param soft The soft limit in bytes.
+   * @param hard The hard limit in bytes.
+   */
+  inline void setLimits(size_t soft, size_t hard)
+  {
+    m_softLimit = soft;
+    m_hardLimit = hard;
+    m_softReported = false;
+    updateLimit();
+  }
+
+  /**
+   * Get the hard limit of the bytes allocated.
+   * @return the result, 0 if no limit.
+   */
+  inline size_t hardLimit() const
+  {
+    return m_hardLimit;
+  }
+
+  /**
+   * Set the callback of the soft limit, see setLimits().
+   * @param pfn Pointer to the callback function, 0 to ask for a collection.
+   * @param opaque The pointer passed to it.
+   */
+  inline void setLimitCallback(pfnHeapLimit pfn, void *opaque)
+  {
+    m_limitPfn = pfn;
+    m_limitOpaque = opaque;
+  }
+
+  /**
+   * Get the statistics of the collector.
+   * @return reference to the result.
+   */
+  inline const GCStats &stats() const
+  {
+    return m_stats;
+  }
+
+  /**
+   * Write a pointer into a object, through the undo log if enabled.
+   * All the mutations of the objects must be done by this.
+   * @param slot Pointer to the field.
+   * @param value The new value.
+   * @return status code.
+   */
+  inline int store(SynNode **slot, SynNode *value)
+  {
+    if (isFrozen(slot))
+      {
+        return LERR_READ_ONLY;
+      }
+    return storeUnfrozen(slot, value);
+  }
+
+  /**
+   * Write a pointer into a object that is never read by the futures
+   * running, such as a frame of the environment, of which they have
+   * their own copy. See store() and freeze().
+   */
+  inline int storeUnfrozen(SynNode **slot, SynNode *value)
+  {
+    if (refuses(slot))
+      {
+        return LERR_READ_ONLY;
+      }
+    if (m_logging)
+      {
+        int rc = logStore(slot);
+        UPDATE_RC(rc);
+      }
+    shade(*slot);
+    *slot = value;
+    return LINF_SUCCEEDED;
+  }
+
+  /**
+   * The write barrier of the incremental marking: the object losing a
+   * reference is marked, so that all the objects reachable when the
+   * marking started are kept. See startCollect().
+   * @param node Pointer to the node, may be 0.
+   */
+  inline void shade(SynNode *node)
+  {
+    if (UNLIKELY(m_marking) && node)
+      shadeNode(node);
+  }
+
+  /**
+   * Set the leaf of pair, see store().
+   */
+  inline int setLeaf(SynNode *pair, SynNode *leaf)
+  {
+    LP_ASSERT(OBJTYPE_PAIR == pair->object.type);
+    return store(&pair->object.u.OBJTYPE_PAIR.leaf, leaf);
+  }
+
+  /**
+   * Set the next of pair, see store().
+   */
+  inline int setNext(SynNode *pair, SynNode *next)
+  {
+    LP_ASSERT(OBJTYPE_PAIR == pair->object.type);
+    return store(&pair->object.u.OBJTYPE_PAIR.next, next);
+  }
+
+  /**
+   * Point out whether a address is in the heap.
+   * @param p The address.
+   * @return true if so.
+   */
+  inline bool contains(const void *p) const
+  {
+    return findChunk(p) != 0;
+  }
+
+  /**
+   * Point out whether a address is in the heap or in the ones it
+   * refuses to store into, see setReadOnly().
+   * @param p The address.
+   * @return true if so.
+   */
+  inline bool protects(const void *p) const
+  {
+    return contains(p) || (m_readonly && m_readonly->protects(p));
+  }
+
+  /**
+   * Point out whether a address is in the heaps refused to store into,
+   * or in the part of heap frozen.
+   * @param p The address.
+   * @return true if so.
+   */
+  inline bool isReadOnly(const void *p) const
+  {
+    return isFrozen(p) || refuses(p);
+  }
+
+  /**
+   * Point out whether a address is a object or a field frozen, see
+   * freeze().
+   * @param p The address.
+   * @return true if so.
+   */
+  inline bool isFrozen(const void *p) const
+  {
+    unsigned long long v;
+    return m_freezing && m_frozenSet.lookup(p, &v);
+  }
+
+  /**
+   * Refuse the stores into all the objects out of this heap, as the
+   * heap of a thread that reads the objects of another running thread.
+   * @param enable Whether to refuse them.
+   */
+  inline void setPrivate(bool enable)
+  {
+    m_private = enable;
+  }
+
+  /**
+   * Point out whether the heap refuses the stores out of it.
+   * @return true if so.
+   */
+  inline bool isPrivate() const
+  {
+    return m_private;
+  }
+
+  /**
+   * Refuse the stores into the objects of another heap, such as the
+   * one of a shared Program.
+   * @param gc Pointer to the heap, 0 to allow all.
+   */
+  inline void setReadOnly(const GC *gc)
+  {
+    m_readonly = gc;
+  }
+
+  /**
+   * Get the total bytes allocated for the objects.
+   * @return the result.
+   */
+  inline size_t allocated() const
+  {
+    return m_bytes;
+  }
+
+private:
+  void *allocate(size_t size);
+  void *allocateFree(size_t size);
+  void addFree(GCChunk *c, size_t offset, size_t size);
+  void dropFree();
+  GCChunk *newChunk(size_t size);
+  GCChunk *findChunk(const void *p) const;
+  int logStore(SynNode **slot);
+  void rollbackTo(size_t base);
+  void sweepChunk(GCChunk *c);
+  void refreshMarks(GCChunk *c);
+  void sweepPorts();
+  bool markBlock(const void *p, __OUT size_t *size);
+  int scan(SynNode *node, NodeStack &stack, __OUT size_t *live);
+  static void markTask(size_t worker, size_t begin, size_t end, void *opaque);
+  void drain(GCMarkJob *job, size_t index);
+  size_t beginMark();
+  int markRoots(NodeStack &roots, NodeStack &out, __OUT size_t *live);
+  void endMark(size_t live);
+  void shadeNode(SynNode *node);
+  void markSlice();
+  void recordPause(unsigned long long us);
+  int checkLimit(size_t size);
+  void updateLimit();
+
+  inline int allocError() const
+  {
+    return m_refused ? LERR_HEAP_LIMIT : LERR_ALLOC_MEMORY;
+  }
+
+  inline bool refuses(const void *p) const
+  {
+    return (m_private && !contains(p)) || (m_readonly && m_readonly->protects(p));
+  }
+
+private:
+  GCChunk  **m_chunks;      /* in the order of allocation */
+  GCChunk  **m_sorted;      /* in the order of address */
+  size_t     m_count;
+  size_t     m_capacity;
+  GCChunk   *m_free;
+  size_t     m_bytes;
+  NodeStack  m_ports;
+
+  GCUndo    *m_undo;
+  size_t     m_undoCount;
+  size_t     m_undoSize;
+  GCMark     m_undoMark;
+  bool       m_logging;
+  const GC  *m_readonly;
+  bool       m_private;
+  PtrMap     m_frozenSet;   /* the objects and the fields read-only */
+  bool       m_freezing;
+
+  GCMark     m_base;        /* the objects before it are not collected */
+  GCFree    *m_freeLists[GC_FREE_CLASSES];
+  bool       m_hasFree;
+  size_t     m_sweepNext;   /* the chunks to sweep lazily */
+  size_t     m_sweepEnd;
+  size_t     m_trigger;
+  size_t     m_minTrigger;
+  bool       m_marking;     /* incrementally */
+  bool       m_purging;     /* the tables, after the marking, see pfnCollected */
+  size_t     m_epoch;       /* of the collection, see refreshMarks() */
+  NodeStack  m_grey;        /* the nodes marked but not scanned */
+  size_t     m_markLive;
+  size_t     m_nextSlice;
+  unsigned long m_sliceBudget;
+  pfnCollected m_collected;
+  void      *m_collectedOpaque;
+  size_t     m_softLimit;
+  size_t     m_hardLimit;
+  size_t     m_limit;       /* the bytes checked by the allocations */
+  bool       m_softReported;
+  bool       m_refused;     /* the last allocation failed by the limits */
+  pfnHeapLimit m_limitPfn;
+  void      *m_limitOpaque;
+  GCStats    m_stats;
+};
+
+
+/*
+ * List under construction while parsing.
+ */
+struct ParseFrame
+{
+  SynNode *head;
+  SynNode *tail;
+  file_off line;
+  file_off column;
+  size_t   count;   /* number of elements so far */
+  bool     data;    /* quoted data, elements are held in the stack */
+  size_t   base;    /* index of the first element in the stack */
+};
+
+/***************************************************
+  *****           ConsTable object             *****
+  ***************************************************/
+
+struct ConsEntry
+{
+  SynNode *node;
+  size_t   hash;
+};
+
+/*
+ * Statistics of hash-consing.
+ */
+struct ConsStats
+{
+  size_t hits;        /* the number of constants shared */
+  size_t bytesSaved;  /* the memory they would have taken */
+};
+
+/**
+ * Table of the immutable constants, for hash-consing.
+ */
+LP_EXPORT class ConsTable {
+public:
+  ConsTable();
+  ~ConsTable();
+
+  SynNode *lookup(objType type, const void *data, size_t len, __OUT size_t *hash);
+  int insert(SynNode *node, size_t hash);
+  int retain(pfnRetainKey pfn, void *opaque);
+  bool retainSome(pfnRetainKey pfn, void *opaque, RetainCursor *at, size_t steps);
+  void clear();
+
+  /**
+   * Get the statistics.
+   * @return reference to the result.
+   */
+  inline const ConsStats &stats() const
+  {
+    return m_stats;
+  }
+
+private:
+  int rehash(size_t newsize);
+  void removeAt(size_t pos);
+
+private:
+  ConsEntry *m_table;
+  size_t     m_size;
+  size_t     m_count;
+  ConsStats  m_stats;
+};
+
+/***************************************************
+  *****             Parser object              *****
+  ***************************************************/
+LP_EXPORT class Parser {
+public:
+  Parser(GC *gc, SourceMap *srcmap);
+  ~Parser();
+  int parse(Lexer *lexer);
+  int parseNext(Lexer *lexer, __OUT SynNode **out);
+  void setHashConsing(bool enable);
+  int retainConsts(pfnRetainKey pfn, void *opaque);
+  bool retainSomeConsts(pfnRetainKey pfn, void *opaque, RetainCursor *at, size_t steps);
+
+  /**
+   * Set where to report the errors, 0 for the log.
+   * @param sink Pointer to the sink, kept by the caller.
+   */
+  inline void setErrorSink(const ErrorSink *sink)
+  {
+    m_errors = sink;
+  }
+
+  /**
+   * Get the statistics of hash-consing.
+   * @return reference to the result.
+   */
+  inline const ConsStats &consStats() const
+  {
+    return m_consts.stats();
+  }
+
+  void dumpast();
+
+  /*
+   * Get the root of AST (abstract syntax tree)
+   * @return pointer to the target.
+   */
+  inline SynNode *getSynRoot()
+  {
+    return m_ast;
+  }
+
+private:
+  SynNode *generate(LexNode *lexnode, __OUT int &rc);
+  SynNode *generateAtom(LexNode *lexnode, __OUT int &rc);
+  SynNode *generateData(ParseFrame *frame, __OUT int &rc);
+  SynNode *lookupConst(objType type, const void *data, size_t len, __OUT size_t *hash);
+  int pushFrame(file_off line, file_off column);
+  int locate(SynNode *node, file_off line, file_off column);
+  bool quotedContext();
+  SynNode *generateNumber(LexNode *lexnode, __OUT int &rc);
+  SynNode *generateString(LexNode *lexnode, __OUT int &rc);
+  SynNode *generateBoolean(LexNode *lexnode, __OUT int &rc);
+  SynNode *generateCharacter(LexNode *lexnode, __OUT int &rc);
+  SynNode *generateSymbol(LexNode *lexnode, __OUT int &rc);
+
+  /* inner */
+  inline GC & gc()
+  {
+    return *m_gc;
+  }
+
+private:
+  GC      *m_gc;
+  SourceMap *m_srcmap;
+  Lexer   *m_lexer;
+  SynNode *m_ast;
+  ParseFrame *m_frames;
+  size_t   m_depth;
+  size_t   m_maxdepth;
+  bool     m_consing;
+  ConsTable m_consts;
+  NodeStack m_elements;
+  const ErrorSink *m_errors;
+};
+
+/***************************************************
+  *****           Serializer object            *****
+  ***************************************************/
+
+/**
+ * Compact binary serialization of the graph of syntax nodes,
+ * the sharing of nodes is preserved.
+ */
+LP_EXPORT class Serializer {
+public:
+  static int encode(SynNode *root, const SourceMap *srcmap, __OUT StringPool &out);
+  static int decode(GC &gc, const char *src, size_t len, SourceMap *srcmap, __OUT SynNode **out);
+};
+
+#define _MAX_STACK_DEEPTH (2048)
+
+/***************************************************
+  *****     Environment Stack object           *****
+  ***************************************************/
+
+LP_EXPORT class EnvStack {
+public:
+  EnvStack(GC *gc);
+
+  int newenv();
+
+  int push(SynNode *vars, SynNode *vals, EnvSP sp, __OUT EnvSP *out);
+  void pop();
+  void unwind();
+  void adopt(SynNode *env);
+  void restore(SynNode *vars, SynNode *const *frames, EnvSP top);
+
+  int lookupVariableList(EnvSP sp, SynNode *node, __OUT SynNode **out);
+  int lookupVariable(EnvSP sp, SynNode *node, __OUT SynNode **out);
+  int defineVariable(EnvSP sp, SynNode *node, SynNode *val);
+  int setVariable(EnvSP sp, SynNode *node, SynNode *val);
+  int roots(NodeStack &out) const;
+
+  /**
+   * Get the root node of environment in the STACK.
+   * @return pointer to the target.
+   */
+  inline SynNode* node(EnvSP sp)
+  {
+    return m_stack[sp];
+  }
+
+  /**
+   * Point out whether the global environment was created.
+   * @return true if so.
+   */
+  inline bool ready() const
+  {
+    return m_vars != 0;
+  }
+
+  /**
+   * Get the highest index ever pushed, the closures may refer to the
+   * environments up to it.
+   * @return the result.
+   */
+  inline EnvSP top() const
+  {
+    return m_top;
+  }
+
+  /* unused */
+  inline SynNode* curnode()
+  {
+    return m_stack[m_sp];
+  }
+
+private:
+  GC      *m_gc;
+  SynNode *m_vars;
+  SynNode *m_stack[_MAX_STACK_DEEPTH];
+  EnvSP    m_sp;
+  EnvSP    m_top; /* the highest index ever pushed, the closures may refer to it */
+
+  /* inner */
+  inline GC &gc()
+  {
+    return *m_gc;
+  }
+};
+
+/**
+ * callback. output the atom data to terminal.
+ * @param node Pointer to the target node.
+ * @param ln Whether print a new line.
+ * @return status code.
+ */
+typedef int (*pfnPrintAtom)(SynNode *node, bool ln);
+
+/*
+ * Writer of the output sink.
+ * @param buff Pointer to the text.
+ * @param len Length of the text.
+ * @param opaque The pointer given to setOutputSink().
+ * @return status code.
+ */
+typedef int (*pfnWriteOutput)(const char *buff, size_t len, void *opaque);
+
+#define _DEFAULT_OUTPUT_THRESHOLD (8192)
+
+/*
+ * Value passed between the host and the procedures, see Lisp::applyBatch().
+ * The type is one of OBJTYPE_BOOLEAN, OBJTYPE_NUMBER, OBJTYPE_CHARACTER and
+ * OBJTYPE_STRING, or OBJTYPE_INVALID for the results that can not be
+ * represented (such as nil or a list).
+ */
+struct HostValue
+{
+  objType type;
+  union
+  {
+    bool   boolean;
+    double number;
+    char   character;
+    struct
+    {
+      const char *buffer;
+      size_t      length;
+    } string;
+  } u;
+};
+
+/*
+ * Diagnostic dumps, see Lisp::setDiagnostics().
+ */
+enum DiagFlags {
+  DIAG_NONE = 0,
+  DIAG_LEXER = 1 << 0,  /* dump each lexicon */
+  DIAG_PARSER = 1 << 1  /* dump the AST parsed */
+};
+
+#define _MAX_TOKEN_NUM 32
+
+struct Token
+{
+  const char *symbol;
+  SynNode * (Lisp::*eval)(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+};
+
+#define _MAX_MSG_BUFFER 1024
+
+/*
+ * Host function registered by Lisp::registerNative(). The arguments are
+ * evaluated and passed in an array, no list is built.
+ * @param lisp Pointer to the interpreter, for creating the result.
+ * @param args Pointer to the values of arguments.
+ * @param argc Number of the arguments.
+ * @param opaque The pointer given at registration.
+ * @param rc Where to store the status code.
+ * @return pointer to the result.
+ */
+typedef SynNode *(*pfnNative)(Lisp *lisp, SynNode **args, size_t argc, void *opaque, __OUT int &rc);
+
+/*
+ * Numeric host functions, called with the unboxed numbers.
+ */
+typedef double (*pfnNumber1)(double x);
+typedef double (*pfnNumber2)(double x, double y);
+
+enum NativeKind
+{
+  NATIVE_GENERIC,
+  NATIVE_NUMBER1,
+  NATIVE_NUMBER2
+};
+
+#define NATIVE_VARIADIC (-1)
+#define _MAX_NATIVE_ARGS (16)
+
+struct NativeEntry
+{
+  ImmString  *name;
+  NativeKind  kind;
+  int         arity;    /* NATIVE_VARIADIC for any */
+  void       *opaque;
+  union
+  {
+    pfnNative  generic;
+    pfnNumber1 number1;
+    pfnNumber2 number2;
+  } u;
+};
+
+
+/***************************************************
+  *****            TaskPool object             *****
+  ***************************************************/
+
+/*
+ * Task run by the pool on the range [begin, end) of indexes.
+ * @param worker Index of the worker thread running it.
+ * @param begin The first index.
+ * @param end The index after the last.
+ * @param opaque The pointer given to TaskPool::run().
+ */
+typedef void (*pfnTask)(size_t worker, size_t begin, size_t end, void *opaque);
+
+struct TaskRange
+{
+  size_t begin;
+  size_t end;
+};
+
+/*
+ * Task submitted to run alone, see TaskPool::submit().
+ */
+struct TaskJob
+{
+  pfnTask  pfn;
+  void    *opaque;
+};
+
+class TaskPool;
+
+/*
+ * Worker thread of the pool, with its own queue of ranges.
+ */
+struct TaskWorker
+{
+  TaskPool        *pool;
+  size_t           index;
+  pthread_t        thread;
+  pthread_mutex_t  lock;    /* of the queue */
+  TaskRange       *queue;
+  size_t           head;    /* the thieves take from here */
+  size_t           tail;    /* the owner takes from here */
+};
+
+/**
+ * Work-stealing thread pool. Each worker takes the ranges from the
+ * tail of its own queue, and steals from the head of the others when
+ * its own is empty. The jobs submitted are taken in order before the
+ * ranges, by the first worker idle.
+ */
+LP_EXPORT class TaskPool {
+public:
+  TaskPool();
+  ~TaskPool();
+
+  int start(size_t threads);
+  void stop();
+  int run(size_t count, size_t grain, pfnTask pfn, void *opaque);
+  int submit(pfnTask pfn, void *opaque);
+
+  /**
+   * Get the number of worker threads.
+   * @return the result.
+   */
+  inline size_t size() const
+  {
+    return m_count;
+  }
+
+  /**
+   * Lock shared by the tasks, for example to write the output.
+   */
+  inline void lock()
+  {
+    pthread_mutex_lock(&m_lock);
+  }
+
+  inline void unlock()
+  {
+    pthread_mutex_unlock(&m_lock);
+  }
+
+  /**
+   * Wait until a job or a run is finished, with the lock held.
+   */
+  inline void waitDone()
+  {
+    pthread_cond_wait(&m_done, &m_lock);
+  }
+
+private:
+  static void *threadMain(void *arg);
+  bool take(TaskWorker *worker, __OUT TaskRange *out);
+
+private:
+  TaskWorker      *m_workers;
+  size_t           m_count;
+  pthread_mutex_t  m_lock;
+  pthread_cond_t   m_wake;
+  pthread_cond_t   m_done;
+  pfnTask          m_task;
+  void            *m_opaque;
+  size_t           m_pending;     /* ranges not finished */
+  unsigned long    m_generation;  /* number of run() */
+  bool             m_stopping;
+  TaskJob         *m_jobs;        /* ring of the jobs submitted */
+  size_t           m_jobHead;
+  size_t           m_jobCount;
+  size_t           m_jobSize;
+};
+
+/*
+ * Future evaluated on the pool, see Lisp::symbolFuture(). The output
+ * and the error are held until it is touched.
+ */
+struct FutureTask
+{
+  unsigned long serial;
+  Lisp         *owner;
+  Lisp         *worker;    /* evaluating in its own heap */
+  SynNode      *handle;    /* in the heap of owner */
+  SynNode      *func;
+  SynNode      *result;    /* in the heap of worker */
+  int           rc;
+  bool          done;      /* written with the lock of pool held */
+  StringPool    output;
+  file_off      line;
+  file_off      column;
+  char          message[_MAX_MSG_BUFFER];
+};
+
+/***************************************************
+  *****             Channel object             *****
+  ***************************************************/
+
+/**
+ * Bounded channel passing the values between the Lisp instances, which
+ * may run on different threads. The values are serialized by the sender
+ * and decoded into the heap of the receiver, so that no object is
+ * shared. The lock is held only to move the buffer of a message.
+ */
+LP_EXPORT class Channel {
+public:
+  Channel();
+  ~Channel();
+
+  int open(size_t capacity);
+  void close();
+  int send(SynNode *value);
+  int recv(GC &gc, __OUT SynNode **out);
+
+private:
+  StringPool      *m_slots;     /* ring of the messages serialized */
+  size_t           m_capacity;
+  size_t           m_head;
+  size_t           m_count;
+  bool             m_closed;
+  pthread_mutex_t  m_lock;
+  pthread_cond_t   m_notEmpty;
+  pthread_cond_t   m_notFull;
+};
+
+struct ChannelEntry
+{
+  ImmString  *name;
+  Channel    *channel;
+};
+
+/*
+ * Evaluation of run() on a stack of its own, which is suspended when the
+ * fuel is used up, see Lisp::setPreemptive().
+ */
+struct LispFiber;
+
+#define LISP_FUEL_UNLIMITED (~0ULL)
+#define LISP_CLOCK_PERIOD (256)             /* evaluations between the checks of deadline */
+#define LISP_FIBER_STACK (16 * 1024 * 1024)
+
+/***************************************************
+  *****             Lisp object                *****
+  ***************************************************/
+
+/***************************************************
+  *****             Program object             *****
+  ***************************************************/
+
+/**
+ * Program parsed once and frozen, which can be executed by many Lisp
+ * instances at the same time, see Lisp::attach(). It must outlive the
+ * instances attached to it.
+ */
+LP_EXPORT class Program {
+public:
+  Program();
+
+  int parse(IStream *stream);
+  int parseFile(const char *filename);
+  void setErrorSink(pfnReportError pfn, void *opaque);
+
+  /**
+   * Get the root of AST.
+   * @return 0 if not parsed.
+   */
+  inline SynNode *root() const
+  {
+    return m_ast;
+  }
+
+  /**
+   * Get the positions of nodes in source.
+   * @return reference to the result.
+   */
+  inline const SourceMap &srcmap() const
+  {
+    return m_srcmap;
+  }
+
+  /**
+   * Get the heap holding the AST.
+   * @return reference to the result.
+   */
+  inline const GC &gc() const
+  {
+    return m_gc;
+  }
+
+private:
+  GC           m_gc;
+  SourceMap    m_srcmap;
+  Lexer        m_lexer;
+  Parser       m_parser;
+  ErrorSink    m_errors;
+  SynNode     *m_ast;
+};
+
+LP_EXPORT class Lisp {
+public:
+  Lisp();
+  ~Lisp();
+
+  int parser(IStream *stream);
+  int parserFile(const char *filename);
+  int attach(const Program *program);
+  int run(__OUT SynNode **out);
+  int load(IStream *stream, __OUT SynNode **out);
+  int snapshot();
+  int reset();
+  int collect();
+  int saveImage(const char *filename);
+  int loadImage(const char *filename);
+  int lookupProcedure(const char *name, __OUT SynNode **out);
+  int apply(SynNode *proc, const HostValue *args, size_t argc,
+            __OUT HostValue *result, StringPool *text);
+  int applyBatch(SynNode *proc, const HostValue *args, size_t argc, size_t count,
+                 __OUT HostValue *results, StringPool *text);
+  int registerNative(const char *name, pfnNative pfn, int arity, void *opaque);
+  int registerNumber(const char *name, pfnNumber1 pfn);
+  int registerNumber(const char *name, pfnNumber2 pfn);
+  int registerChannel(const char *name, Channel *channel);
+  int setParallelism(size_t threads);
+  void setPrintAtomCallback(pfnPrintAtom pfn);
+  void setOutputSink(pfnWriteOutput pfn, void *opaque);
+  void setOutputThreshold(size_t size);
+  int display(SynNode *node, bool ln);
+  int flushOutput();
+  void setHashConsing(bool enable);
+  void setDiagnostics(unsigned int flags);
+  void setFuel(unsigned long long steps);
+  void setDeadline(unsigned long ms);
+  void setPreemptive(bool enable);
+  int resume(__OUT SynNode **out);
+  int cancel();
+
+  /*
+   * Get the evaluations left, see setFuel().
+   * @return the result, LISP_FUEL_UNLIMITED if not limited.
+   */
+  inline unsigned long long fuel() const
+  {
+    return m_fuel;
+  }
+
+  bool suspended() const;
+
+  /*
+   * Get the statistics of hash-consing of the constants parsed.
+   * @return reference to the result.
+   */
+  inline const ConsStats &consStats() const
+  {
+    return m_parser.consStats();
+  }
+
+  void setErrorSink(pfnReportError pfn, void *opaque);
+  static int throwError(file_off line, file_off pos, const char *msg, ...);
+  static int throwError(const ErrorSink *sink, file_off line, file_off pos, const char *msg, ...);
+  int throwErrorAt(SynNode *node, const char *msg, ...);
+  static int formatNode(SynNode *node, __OUT StringPool &out);
+  /*
+   * Get the reference of envstack instance.
+   * @return envstack.
+   */
+  inline EnvStack & envstack()
+  {
+    return m_envstack;
+  }
+
+  /*
+   * Get the pointer of gc instance.
+   * @return gc.
+   */
+  inline GC &gc()
+  {
+    return m_gc;
+  }
+
+private:
+  SynNode* dispatchEvaling(SynNode *root, EnvSP envsp, __OUT int &rc);
+  int finishRun(SynNode *result, int rc, __OUT SynNode **out);
+  int consumeFuel(SynNode *at);
+  bool takeFuel();
+  bool meterUsedUp() const;
+  void shareMeter(Lisp *w) const;
+  void startClock();
+  int runFiber(__OUT SynNode **out);
+  void switchFiber();
+  void dropFiber();
+  static void fiberEntry(unsigned int hi, unsigned int lo);
+  int collectWith(SynNode *extra, bool incremental);
+  static bool forgetCollected(GC *gc, bool restart, size_t steps, void *opaque);
+  SynNode* eval(SynNode *node, EnvSP envsp, __OUT int &rc);
+  SynNode* evalVariable(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  SynNode* evalCall(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  void reportRefused(SynNode *at);
+  SynNode* evalList(SynNode *vars, SynNode *vals, EnvSP envsp, __OUT int &rc);
+  SynNode* evalProcedure(SynNode *body, SynNode *vars, SynNode *vals, EnvSP envsp, __OUT int &rc);
+  int applyOne(SynNode *proc, const HostValue *args, size_t argc,
+               __OUT HostValue *result, StringPool *text);
+  NativeEntry *findNative(SynNode *sym);
+  bool locate(SynNode *node, __OUT file_off *line, __OUT file_off *column) const;
+  int startPool();
+  void stopPool();
+  SynNode* parallelMap(SynNode *args, EnvSP envsp, bool keep, __OUT int &rc);
+  void evalItems(SynNode *func, EnvSP envsp, SynNode **items, SynNode **results,
+                 int *codes, size_t begin, size_t end);
+  static void parallelTask(size_t worker, size_t begin, size_t end, void *opaque);
+  static int forwardOutput(const char *buff, size_t len, void *opaque);
+  static void forwardError(file_off line, file_off column, const char *msg, void *opaque);
+  int startFuture(SynNode *func, __OUT FutureTask **out);
+  SynNode* resolveFuture(size_t index, SynNode *at, __OUT int &rc);
+  void waitFutures();
+  static void futureTask(size_t worker, size_t begin, size_t end, void *opaque);
+  static int holdOutput(const char *buff, size_t len, void *opaque);
+  static void holdError(file_off line, file_off column, const char *msg, void *opaque);
+  int addNative(const char *name, const NativeEntry &entry);
+  Channel *findChannel(SynNode *name);
+  int evalChannel(SynNode *leaf, const char *name, EnvSP envsp, __OUT Channel **out);
+  SynNode* evalNative(NativeEntry *native, SynNode *leaf, EnvSP envsp, __OUT int &rc);
+
+  bool targetSymbol(SynNode *leaf);
+  bool targetCall(SynNode *leaf);
+  bool targetPair(SynNode *leaf);
+  bool targetEval(SynNode *leaf);
+
+  int validateSyntax(SynNode *leaf, int paramCount, const char *name);
+  static int throwErrorV(const ErrorSink *sink, file_off line, file_off pos, const char *msg, va_list args);
+
+  SynNode* symbolSet(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolSetCar(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolSetCdr(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolDefine(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolLambda(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolIf(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolBegin(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolCond(SynNode *leaf, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolCons(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolCar(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolCdr(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolQuote(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolDisplay(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolPrint(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolEval(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolAppend(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolBooleanP(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolNumberP(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolCharP(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolStringP(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolStringAppend(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolNumberToString(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolOpenOutputString(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolGetOutputString(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolPMap(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolPForEach(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolFuture(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolTouch(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolChannelSend(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolChannelRecv(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolChannelClose(SynNode *args, EnvSP envsp, __OUT int &rc);
+
+  SynNode* symbolAdd(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolSub(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolMul(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolDiv(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolEqual(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolGreater(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolLess(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolEGreater(SynNode *args, EnvSP envsp, __OUT int &rc);
+  SynNode* symbolELess(SynNode *args, EnvSP envsp, __OUT int &rc);
+
+private:
+  SynNode* displayInner(SynNode *args, EnvSP envsp, bool ln, __OUT int &rc);
+  SynNode* cmpInner(SynNode *args, EnvSP envsp, int op, __OUT int &rc);
+  SynNode* predTypeInner(SynNode *args, EnvSP envsp, objType type, __OUT int &rc);
+
+private:
+  IStream     *m_stream;
+  Lexer        m_lexer;
+  GC           m_gc;
+  SourceMap    m_srcmap;
+  Parser       m_parser;
+  EnvStack     m_envstack;
+  bool         m_parsed;
+  SynNode     *m_ast;
+  static const Token tokens[];
+  pfnPrintAtom m_printAtom;
+  StringPool   m_output;
+  pfnWriteOutput m_writeOutput;
+  void        *m_outputOpaque;
+  size_t       m_outputThreshold;
+  unsigned int m_diagnostics;
+  ErrorSink    m_errors;
+  const Program *m_program;
+  Lisp        *m_parent;        /* of the pool workers */
+  TaskPool    *m_pool;
+  Lisp       **m_workers;
+  size_t       m_parallelism;
+  bool         m_parallelismSet;
+  size_t       m_poolErrors;    /* reported by the workers in this map */
+  FutureTask **m_futures;       /* not resolved */
+  size_t       m_futureCount;
+  size_t       m_futureSize;
+  unsigned long m_futureSerial;
+  NativeEntry *m_natives;
+  size_t       m_nativeCount;
+  size_t       m_nativeSize;
+  ChannelEntry *m_channels;
+  size_t       m_channelCount;
+  size_t       m_channelSize;
+  GCMark       m_mark;
+  bool         m_snapshot;
+  bool         m_markParsed;
+  SynNode     *m_markAst;
+  unsigned long long m_fuel;    /* evaluations left */
+  unsigned long m_deadline;     /* in milliseconds of each run */
+  unsigned long long m_deadlineAt;
+  unsigned int m_ticks;
+  size_t       m_refusedReported; /* the allocations refused, see reportRefused() */
+  RetainCursor m_forgetPositions; /* see forgetCollected() */
+  RetainCursor m_forgetConsts;
+  bool         m_metered;       /* by the fuel or the deadline */
+  bool         m_preemptive;
+  LispFiber   *m_fiber;
+};
+
+
+} // namespace DSL
+
+#endif //!defined(LISPDSL_H_)
@@ -0,0 +1,307 @@
+/** @file
+ * LispDSL - Calling the procedures from host.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Inner, convert a host value to a node.
+ * @param gc GC object reference.
+ * @param value The host value.
+ * @param out Where to store the result.
+ * @return status code.
+ */
+static int
+hostToNode(GC &gc, const HostValue &value, __OUT SynNode **out)
+{
+  int rc;
+  SynNode *node = 0;
+
+  switch (value.type)
+  {
+    case OBJTYPE_BOOLEAN:
+      createAtom(gc, OBJTYPE_BOOLEAN, node, value.u.boolean, rc);
+      break;
+    case OBJTYPE_NUMBER:
+      createAtom(gc, OBJTYPE_NUMBER, node, value.u.number, rc);
+      break;
+    case OBJTYPE_CHARACTER:
+      createAtom(gc, OBJTYPE_CHARACTER, node, value.u.character, rc);
+      break;
+    case OBJTYPE_STRING:
+      {
+        ImmString *str;
+        rc = gc.createString(value.u.string.buffer, value.u.string.length, &str);
+        if (LP_SUCCESS(rc))
+          createAtom(gc, OBJTYPE_STRING, node, str, rc);
+      }
+      break;
+    default:
+      rc = LERR_NOT_MATCHED;
+  }
+  *out = node;
+  return rc;
+}
+
+/**
+ * Inner, convert a node to the host value. The strings are copied to
+ * the text pool, followed by '\0', the buffer is set by applyBatch().
+ * @param node Pointer to the node.
+ * @param out Where to store the result.
+ * @param text Where to copy the strings, may be 0.
+ * @return status code.
+ */
+static int
+nodeToHost(SynNode *node, __OUT HostValue *out, StringPool *text)
+{
+  out->type = node ? node->object.type : OBJTYPE_INVALID;
+
+  switch (out->type)
+  {
+    case OBJTYPE_BOOLEAN:
+      out->u.boolean = OBJ_VALUE(OBJTYPE_BOOLEAN, node);
+      break;
+    case OBJTYPE_NUMBER:
+      out->u.number = OBJ_VALUE(OBJTYPE_NUMBER, node);
+      break;
+    case OBJTYPE_CHARACTER:
+      out->u.character = OBJ_VALUE(OBJTYPE_CHARACTER, node);
+      break;
+    case OBJTYPE_STRING:
+    case OBJTYPE_SYMBOL:
+      {
+        ImmString *v = (out->type == OBJTYPE_STRING)
+            ? OBJ_VALUE(OBJTYPE_STRING, node)
+            : OBJ_VALUE(OBJTYPE_SYMBOL, node);
+        out->type = OBJTYPE_STRING;
+        out->u.string.buffer = 0;
+        out->u.string.length = v->length();
+        if (!text)
+          {
+            return LERR_FAILED;
+          }
+        int rc = text->append(v->buffer(), v->length());
+        UPDATE_RC(rc);
+        return text->append("", 1);
+      }
+    default:
+      out->type = OBJTYPE_INVALID;
+  }
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Lookup a procedure defined in the global environment, so that it
+ * can be called by apply() and applyBatch() without parsing. The
+ * result is valid as long as the definition is kept, see reset().
+ * @param name Name of the procedure.
+ * @param out Where to store the procedure.
+ * @return status code.
+ */
+int
+Lisp::lookupProcedure(const char *name, __OUT SynNode **out)
+{
+  int rc;
+  *out = 0;
+
+  if (!m_envstack.ready())
+    {
+      return LERR_SYMBOL_NOT_FOUND;
+    }
+  ImmString *str = ImmString::create(name);
+  if (!str)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  SynNode sym;
+  sym.object.type = OBJTYPE_SYMBOL;
+  OBJ_VALUE(OBJTYPE_SYMBOL, (&sym)) = str;
+
+  SynNode *value;
+  rc = m_envstack.lookupVariable(0/*envsp*/, &sym, &value);
+  ImmString::release(str);
+  if (LP_SUCCESS(rc))
+    {
+      if (!value || OBJTYPE_FUNC != value->object.type)
+        {
+          return LERR_NOT_MATCHED;
+        }
+      *out = value;
+    }
+  return rc;
+}
+
+/**
+ * Inner, call the procedure once. All the objects created by the call
+ * are released and the mutations it made are undone afterwards.
+ * @param proc Pointer to the procedure.
+ * @param args Pointer to the arguments.
+ * @param argc Number of the arguments.
+ * @param result Where to store the result.
+ * @param text Where to copy the strings of result.
+ * @return status code.
+ */
+int
+Lisp::applyOne(SynNode *proc, const HostValue *args, size_t argc,
+               __OUT HostValue *result, StringPool *text)
+{
+  int rc = LINF_SUCCEEDED;
+  GCMark mark;
+  GCUndoScope scope;
+
+  m_gc.mark(&mark);
+  m_gc.enterUndo(mark, &scope);
+
+  /* build the list of actual parameters */
+  SynNode *vals = 0, *tail = 0;
+  for (size_t i = 0; i < argc && LP_SUCCESS(rc); i++)
+    {
+      SynNode *node, *pair;
+      rc = hostToNode(m_gc, args[i], &node);
+      if (LP_SUCCESS(rc))
+        rc = m_gc.createPair(node, 0, &pair);
+      if (LP_SUCCESS(rc))
+        {
+          if (tail)
+            OBJ_NEXT(tail) = pair;
+          else
+            vals = pair;
+          tail = pair;
+        }
+    }
+
+  result->type = OBJTYPE_INVALID;
+  if (LP_SUCCESS(rc))
+    {
+      SynNode *res = evalProcedure(proc->object.u.OBJTYPE_FUNC.body,
+                                   proc->object.u.OBJTYPE_FUNC.params,
+                                   vals,
+                                   proc->object.u.OBJTYPE_FUNC.envsp,
+                                   rc);
+      waitFutures();
+      if (LP_SUCCESS(rc))
+        rc = nodeToHost(res, result, text);
+    }
+
+  m_gc.leaveUndo(scope);
+  m_gc.release(mark);
+  return rc;
+}
+
+/**
+ * Call a procedure with the arguments given by host.
+ * See applyBatch().
+ * @param proc Pointer to the procedure got by lookupProcedure().
+ * @param args Pointer to the arguments.
+ * @param argc Number of the arguments.
+ * @param result Where to store the result.
+ * @param text Where to copy the strings of result, may be 0 if the
+ *             result is not a string.
+ * @return status code.
+ */
+int
+Lisp::apply(SynNode *proc, const HostValue *args, size_t argc,
+            __OUT HostValue *result, StringPool *text)
+{
+  return applyBatch(proc, args, argc, 1, result, text);
+}
+
+/**
+ * Call a procedure once for each record of arguments, for example to
+ * evaluate a rule on many records without parsing and running the
+ * script again.
+ * Each call starts from the same state: the objects it created are
+ * released and the mutations it made (such as set! of a global
+ * variable) are undone before the next record.
+ * The strings of results are copied to the text pool, each followed by
+ * '\0', they are valid as long as the pool is not changed.
+ * @param proc Pointer to the procedure got by lookupProcedure().
+ * @param args Pointer to the arguments, argc values for each record.
+ * @param argc Number of the arguments of each record.
+ * @param count Number of the records.
+ * @param results Where to store the results, count values.
+ * @param text Where to copy the strings of results, may be 0 if none
+ *             of the results is a string.
+ * @return status code. If failed, the results of the records before
+ *         the failed one are stored.
+ */
+int
+Lisp::applyBatch(SynNode *proc, const HostValue *args, size_t argc, size_t count,
+                 __OUT HostValue *results, StringPool *text)
+{
+  int rc = LINF_SUCCEEDED;
+
+  if (suspended())
+    {
+      return LERR_FAILED;
+    }
+  if (!proc || OBJTYPE_FUNC != proc->object.type)
+    {
+      return LERR_NOT_MATCHED;
+    }
+  size_t params = 0;
+  for (SynNode *n = proc->object.u.OBJTYPE_FUNC.params; n; n = OBJ_NEXT(n))
+    params++;
+  if (params != argc)
+    {
+      return throwErrorAt(proc->object.u.OBJTYPE_FUNC.params,
+                          "invalid number of actual parameters of target function.");
+    }
+
+  startClock();
+  size_t start = text ? text->length() : 0;
+  size_t done;
+  for (done = 0; done < count; done++)
+    {
+      rc = applyOne(proc, args + done * argc, argc, &results[done], text);
+      if (LP_FAILURE(rc))
+        {
+          results[done].type = OBJTYPE_INVALID;
+          break;
+        }
+    }
+
+  /* the pool may be moved while growing, point to the strings at last */
+  if (text)
+    {
+      const char *p = text->buffer() + start;
+      for (size_t i = 0; i < done; i++)
+        {
+          if (OBJTYPE_STRING == results[i].type)
+            {
+              results[i].u.string.buffer = p;
+              p += results[i].u.string.length + 1;
+            }
+        }
+    }
+
+  int rc2 = flushOutput();
+  return LP_SUCCESS(rc) ? rc2 : rc;
+}
+
+} // namespace DSL
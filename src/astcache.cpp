@@ -0,0 +1,241 @@
+/** @file
+ * LispDSL - Precompiled AST cache files.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The cache of "foo.scm" is stored in "foo.scm.lspc", which is a header
+ * followed by the AST in the format of Serializer.
+ */
+#define AST_CACHE_SUFFIX ".lspc"
+#define AST_CACHE_MAGIC "LSPC"
+#define AST_CACHE_VERSION (2)
+#define AST_CACHE_ENDIAN (0x01020304)
+
+struct AstCacheHeader
+{
+  char               magic[4];
+  unsigned int       version;
+  unsigned int       endian;
+  unsigned int       reserved;
+  unsigned long long hash;      /* hash of the source text */
+  unsigned long long length;    /* length of the serialized AST */
+};
+
+/**
+ * Inner, read the whole content of stream.
+ * @param stream Pointer to the IStream interface.
+ * @param out Where to store the buffer, should be released by delete[].
+ * @param len Where to store the length.
+ * @return status code.
+ */
+static int
+readStream(IStream *stream, __OUT char **out, __OUT size_t *len)
+{
+  size_t size = static_cast<size_t>(stream->GetSize());
+  char *buff = new (std::nothrow) char[size ? size : 1];
+  if (!buff)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  if (size && stream->Read(buff, 1, size) != size)
+    {
+      delete [] buff;
+      return LERR_FAILED;
+    }
+  *out = buff;
+  *len = size;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, load the AST from cache file with a single read.
+ * @param gc GC object reference.
+ * @param srcmap Where to record the positions of nodes in source.
+ * @param filename Path name of the cache file.
+ * @param hash Hash of the source text, the cache is stale if mismatched.
+ * @param out Where to store the root of AST.
+ * @return status code.
+ */
+static int
+loadCache(GC &gc, SourceMap *srcmap, const char *filename, unsigned long long hash, __OUT SynNode **out)
+{
+  int rc;
+  IStream *stream = Stream::CreateStream();
+  if (!stream)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+
+  rc = stream->Open(filename, "rb");
+  if (LP_SUCCESS(rc))
+    {
+      char *buff;
+      size_t len;
+
+      rc = readStream(stream, &buff, &len);
+      stream->Close();
+      if (LP_SUCCESS(rc))
+        {
+          AstCacheHeader header;
+          if (len >= sizeof(header))
+            memcpy(&header, buff, sizeof(header));
+
+          if (len < sizeof(header)
+              || memcmp(header.magic, AST_CACHE_MAGIC, sizeof(header.magic)) != 0
+              || header.version != AST_CACHE_VERSION
+              || header.endian != AST_CACHE_ENDIAN
+              || header.hash != hash
+              || header.length != len - sizeof(header))
+            {
+              rc = LERR_NOT_MATCHED;
+            }
+          else
+            {
+              rc = Serializer::decode(gc, buff + sizeof(header),
+                                      static_cast<size_t>(header.length), srcmap, out);
+            }
+          delete [] buff;
+        }
+    }
+  delete stream;
+  return rc;
+}
+
+/**
+ * Inner, write the AST to cache file.
+ * @param root Pointer to the root of AST.
+ * @param srcmap Pointer to the positions of nodes in source.
+ * @param filename Path name of the cache file.
+ * @param hash Hash of the source text.
+ * @return status code.
+ */
+static int
+saveCache(SynNode *root, const SourceMap *srcmap, const char *filename, unsigned long long hash)
+{
+  int rc;
+  StringPool body;
+
+  rc = Serializer::encode(root, srcmap, body);
+  UPDATE_RC(rc);
+
+  AstCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, AST_CACHE_MAGIC, sizeof(header.magic));
+  header.version = AST_CACHE_VERSION;
+  header.endian = AST_CACHE_ENDIAN;
+  header.hash = hash;
+  header.length = body.length();
+
+  IStream *stream = Stream::CreateStream();
+  if (!stream)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  rc = stream->Open(filename, "wb");
+  if (LP_SUCCESS(rc))
+    {
+      if (stream->Write(&header, sizeof(header), 1) != 1
+          || (body.length() && stream->Write(body.buffer(), 1, body.length()) != body.length()))
+        {
+          rc = LERR_FAILED;
+        }
+      stream->Close();
+    }
+  delete stream;
+  return rc;
+}
+
+/**
+ * Parser the lisp code from file, through the AST cache.
+ * If a cache file that matches the content of source exists next to
+ * it, the AST is loaded from the cache without lexing and parsing.
+ * Otherwise the source is parsed and the cache is (re)written.
+ * @param filename Path name of the source file.
+ * @return status code.
+ */
+int
+Lisp::parserFile(const char *filename)
+{
+  int rc;
+  char *text;
+  size_t len;
+  StringPool cachename;
+
+  m_parsed = false;
+
+  IStream *source = Stream::CreateStream();
+  if (!source)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  rc = source->Open(filename, "rb");
+  if (LP_FAILURE(rc))
+    {
+      delete source;
+      return rc;
+    }
+
+  rc = readStream(source, &text, &len);
+  if (LP_SUCCESS(rc))
+    {
+      unsigned long long hash = hashBuffer(text, len);
+      delete [] text;
+
+      rc = cachename.copy(filename);
+      if (LP_SUCCESS(rc))
+        rc = cachename.append(AST_CACHE_SUFFIX);
+
+      if (LP_SUCCESS(rc))
+        {
+          SynNode *ast;
+          rc = loadCache(gc(), &m_srcmap, cachename.buffer(), hash, &ast);
+          if (LP_SUCCESS(rc))
+            {
+              m_ast = ast;
+              m_parsed = true;
+            }
+          else
+            {
+              /* missed, parse the source and save it for the next time */
+              rc = source->Seek(0, STREAM_SEEK_SET);
+              if (LP_SUCCESS(rc))
+                rc = parser(source);
+              if (LP_SUCCESS(rc))
+                saveCache(m_ast, &m_srcmap, cachename.buffer(), hash); /* optional */
+            }
+        }
+    }
+
+  source->Close();
+  delete source;
+  m_stream = 0;
+  return rc;
+}
+
+} // namespace DSL
@@ -0,0 +1,421 @@
+/** @file
+ * LispDSL - Bounded channels between the instances.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+Channel::Channel()
+  : m_slots(0),
+    m_capacity(0),
+    m_head(0),
+    m_count(0),
+    m_closed(false)
+{
+}
+
+Channel::~Channel()
+{
+  if (m_slots)
+    {
+      delete [] m_slots;
+      pthread_cond_destroy(&m_notFull);
+      pthread_cond_destroy(&m_notEmpty);
+      pthread_mutex_destroy(&m_lock);
+    }
+}
+
+/**
+ * Allocate the ring of messages, before any instance uses the channel.
+ * @param capacity Number of the messages held before the senders block.
+ * @return status code.
+ */
+int
+Channel::open(size_t capacity)
+{
+  if (m_slots || !capacity)
+    {
+      return LERR_FAILED;
+    }
+  m_slots = new (std::nothrow) StringPool[capacity];
+  if (!m_slots)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  pthread_mutex_init(&m_lock, 0);
+  pthread_cond_init(&m_notEmpty, 0);
+  pthread_cond_init(&m_notFull, 0);
+  m_capacity = capacity;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Close the channel, the senders fail afterwards, and the receivers get
+ * the messages left and then the end of stream.
+ */
+void
+Channel::close()
+{
+  if (!m_slots)
+    return;
+  pthread_mutex_lock(&m_lock);
+  m_closed = true;
+  pthread_cond_broadcast(&m_notEmpty);
+  pthread_cond_broadcast(&m_notFull);
+  pthread_mutex_unlock(&m_lock);
+}
+
+/**
+ * Inner, check if the value can be decoded in another instance, the
+ * procedures, ports and futures are bound to the one of sender.
+ * @param root Pointer to the value.
+ * @return status code.
+ */
+static int
+checkPortable(SynNode *root)
+{
+  int rc;
+  PtrMap visited;
+  NodeStack stack;
+
+  rc = stack.push(root);
+  while (LP_SUCCESS(rc) && stack.count())
+    {
+      unsigned long long v;
+      SynNode *node = stack.pop();
+      if (!node || visited.lookup(node, &v))
+        continue;
+      rc = visited.insert(node, 0);
+      if (LP_FAILURE(rc))
+        break;
+
+      switch (node->object.type)
+      {
+        case OBJTYPE_PAIR:
+          rc = stack.push(OBJ_NEXT(node));
+          if (LP_SUCCESS(rc))
+            rc = stack.push(OBJ_LEAF(node));
+          break;
+        case OBJTYPE_FUNC:
+        case OBJTYPE_PORT:
+        case OBJTYPE_FUTURE:
+          rc = LERR_NOT_MATCHED;
+          break;
+        default:
+          break;
+      }
+    }
+  return rc;
+}
+
+/**
+ * Send a value, blocking while the channel is full.
+ * @param value Pointer to the value, may be 0.
+ * @return LERR_NOT_MATCHED if the value can not be sent.
+ * @return LERR_FAILED if the channel is closed.
+ * @return status code.
+ */
+int
+Channel::send(SynNode *value)
+{
+  if (!m_slots)
+    {
+      return LERR_FAILED;
+    }
+  int rc = checkPortable(value);
+  UPDATE_RC(rc);
+
+  /* serialize out of the lock */
+  StringPool msg;
+  rc = Serializer::encode(value, 0, msg);
+  UPDATE_RC(rc);
+
+  pthread_mutex_lock(&m_lock);
+  while (!m_closed && m_count == m_capacity)
+    pthread_cond_wait(&m_notFull, &m_lock);
+  if (m_closed)
+    {
+      rc = LERR_FAILED;
+    }
+  else
+    {
+      m_slots[(m_head + m_count) % m_capacity].move(msg);
+      m_count++;
+      pthread_cond_signal(&m_notEmpty);
+    }
+  pthread_mutex_unlock(&m_lock);
+  return rc;
+}
+
+/**
+ * Receive a value, blocking while the channel is empty.
+ * @param gc The heap to decode the value into.
+ * @param out Where to store the value.
+ * @return LINF_END_OF_STREAM if the channel is closed and empty.
+ * @return status code.
+ */
+int
+Channel::recv(GC &gc, __OUT SynNode **out)
+{
+  if (!m_slots)
+    {
+      return LERR_FAILED;
+    }
+
+  StringPool msg;
+  pthread_mutex_lock(&m_lock);
+  while (!m_closed && !m_count)
+    pthread_cond_wait(&m_notEmpty, &m_lock);
+  if (m_count)
+    {
+      msg.move(m_slots[m_head]);
+      m_head = (m_head + 1) % m_capacity;
+      m_count--;
+      pthread_cond_signal(&m_notFull);
+    }
+  else
+    {
+      pthread_mutex_unlock(&m_lock);
+      return LINF_END_OF_STREAM;
+    }
+  pthread_mutex_unlock(&m_lock);
+
+  /* decode out of the lock */
+  return Serializer::decode(gc, msg.buffer(), msg.length(), 0, out);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Make a channel visible to the script by name, for channel-send,
+ * channel-recv and channel-close. The channel is owned by the host,
+ * and must be opened and outlive the instance.
+ * @param name Name of the channel, a registered one is replaced.
+ * @param channel Pointer to the channel.
+ * @return status code.
+ */
+int
+Lisp::registerChannel(const char *name, Channel *channel)
+{
+  if (!name || !*name || !channel)
+    {
+      return LERR_FAILED;
+    }
+  ImmString *str = ImmString::create(name);
+  if (!str)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  for (size_t i = 0; i < m_channelCount; i++)
+    {
+      if (m_channels[i].name->compare(*str) == 0)
+        {
+          ImmString::release(str);
+          m_channels[i].channel = channel;
+          return LINF_SUCCEEDED;
+        }
+    }
+
+  if (m_channelCount == m_channelSize)
+    {
+      size_t newsize = m_channelSize ? m_channelSize * 2 : 8;
+      ChannelEntry *channels = new (std::nothrow) ChannelEntry[newsize];
+      if (!channels)
+        {
+          ImmString::release(str);
+          return LERR_ALLOC_MEMORY;
+        }
+      if (m_channels)
+        {
+          memcpy(channels, m_channels, m_channelCount * sizeof(ChannelEntry));
+          delete [] m_channels;
+        }
+      m_channels = channels;
+      m_channelSize = newsize;
+    }
+  m_channels[m_channelCount].name = str;
+  m_channels[m_channelCount].channel = channel;
+  m_channelCount++;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, find the channel registered with the name.
+ * @param name Pointer to the string or symbol node.
+ * @return 0 if not found.
+ * @return pointer to the channel.
+ */
+Channel *
+Lisp::findChannel(SynNode *name)
+{
+  ImmString *str;
+  if (name && OBJTYPE_STRING == name->object.type)
+    str = OBJ_VALUE(OBJTYPE_STRING, name);
+  else if (name && OBJTYPE_SYMBOL == name->object.type)
+    str = OBJ_VALUE(OBJTYPE_SYMBOL, name);
+  else
+    return 0;
+
+  for (size_t i = 0; i < m_channelCount; i++)
+    {
+      const ImmString *each = m_channels[i].name;
+      if (each->length() == str->length()
+          && memcmp(each->buffer(), str->buffer(), str->length()) == 0)
+        return m_channels[i].channel;
+    }
+  /* the pool workers and futures use the ones of their owner */
+  return m_parent ? m_parent->findChannel(name) : 0;
+}
+
+/**
+ * Inner, evaluate the name of channel, the first argument.
+ * @param leaf Pointer to the calling node.
+ * @param name Name of the builtin.
+ * @param envsp Index of local environment stack.
+ * @param out Where to store the channel.
+ * @return status code.
+ */
+int
+Lisp::evalChannel(SynNode *leaf, const char *name, EnvSP envsp, __OUT Channel **out)
+{
+  int rc = LINF_SUCCEEDED;
+  SynNode *node = eval(OBJ_LEAF(OBJ_NEXT(leaf)), envsp, rc);
+  UPDATE_RC(rc);
+  *out = findChannel(node);
+  if (!*out)
+    {
+      return throwErrorAt(OBJ_LEAF(OBJ_NEXT(leaf)), "%s - the channel was not found.", name);
+    }
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Send a value to the channel, blocking while it is full.
+ * (channel-send [name] [value])
+ */
+SynNode*
+Lisp::symbolChannelSend(SynNode *args, EnvSP envsp, __OUT int &rc)
+{
+  Channel *channel;
+  rc = validateSyntax(args, 3, "channel-send");
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  rc = evalChannel(args, "channel-send", envsp, &channel);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  SynNode *value = eval(OBJ_LEAF(OBJ_NEXT2(args)), envsp, rc);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+
+  rc = channel->send(value);
+  if (LERR_NOT_MATCHED == rc)
+    {
+      rc = throwErrorAt(OBJ_LEAF(OBJ_NEXT2(args)), "channel-send - the value can not be sent.");
+      return 0;
+    }
+  if (LERR_FAILED == rc)
+    {
+      rc = throwErrorAt(OBJ_LEAF(OBJ_NEXT(args)), "channel-send - the channel is closed.");
+      return 0;
+    }
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  SynNode *res;
+  createAtom(gc(), OBJTYPE_BOOLEAN, res, true, rc);
+  return res;
+}
+
+/**
+ * Receive a value from the channel, blocking while it is empty. The
+ * default (nil if omitted) is returned if the channel is closed and
+ * empty.
+ * (channel-recv [name] [default])
+ */
+SynNode*
+Lisp::symbolChannelRecv(SynNode *args, EnvSP envsp, __OUT int &rc)
+{
+  Channel *channel;
+  bool withDefault = OBJ_NEXT(args) && OBJ_NEXT2(args);
+  rc = validateSyntax(args, withDefault ? 3 : 2, "channel-recv");
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  rc = evalChannel(args, "channel-recv", envsp, &channel);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+
+  SynNode *value = 0;
+  rc = channel->recv(gc(), &value);
+  if (LINF_END_OF_STREAM == rc)
+    {
+      rc = LINF_SUCCEEDED;
+      return withDefault ? eval(OBJ_LEAF(OBJ_NEXT2(args)), envsp, rc) : 0;
+    }
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  return value;
+}
+
+/**
+ * Close the channel, the receivers get the default after the values left.
+ * (channel-close [name])
+ */
+SynNode*
+Lisp::symbolChannelClose(SynNode *args, EnvSP envsp, __OUT int &rc)
+{
+  Channel *channel;
+  rc = validateSyntax(args, 2, "channel-close");
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  rc = evalChannel(args, "channel-close", envsp, &channel);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  channel->close();
+
+  SynNode *res;
+  createAtom(gc(), OBJTYPE_BOOLEAN, res, true, rc);
+  return res;
+}
+
+} // namespace DSL
@@ -0,0 +1,381 @@
+/** @file
+ * LispDSL - Containers.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+#define PTRMAP_MIN_SIZE (64) /* power of 2 */
+
+PtrMap::PtrMap()
+  : m_table(0),
+    m_size(0),
+    m_count(0)
+{
+}
+
+PtrMap::~PtrMap()
+{
+  if (m_table)
+    delete [] m_table;
+}
+
+/**
+ * Inner, hash a pointer.
+ * @param key The pointer.
+ * @return the hash value.
+ */
+static inline size_t
+hashPtr(const void *key)
+{
+  unsigned long long h = reinterpret_cast<size_t>(key);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return static_cast<size_t>(h);
+}
+
+/**
+ * Inner, resize the table and insert the entries again.
+ * @param newsize The new number of slots, power of 2.
+ * @return status code.
+ */
+int
+PtrMap::rehash(size_t newsize)
+{
+  PtrMapEntry *old = m_table;
+  size_t oldsize = m_size;
+
+  m_table = new (std::nothrow) PtrMapEntry[newsize];
+  if (!m_table)
+    {
+      m_table = old;
+      return LERR_ALLOC_MEMORY;
+    }
+  for (size_t i = 0; i < newsize; i++)
+    m_table[i].key = 0;
+  m_size = newsize;
+
+  for (size_t i = 0; i < oldsize; i++)
+    {
+      if (old[i].key)
+        {
+          size_t pos = hashPtr(old[i].key) & (m_size - 1);
+          while (m_table[pos].key)
+            pos = (pos + 1) & (m_size - 1);
+          m_table[pos] = old[i];
+        }
+    }
+  if (old)
+    delete [] old;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Make room for the entries to be inserted, so that the table is not
+ * resized while they are inserted one by one.
+ * @param count The number of entries to be inserted.
+ * @return status code.
+ */
+int
+PtrMap::reserve(size_t count)
+{
+  size_t newsize = m_size ? m_size : PTRMAP_MIN_SIZE;
+  while ((m_count + count) * 2 > newsize)
+    newsize *= 2;
+  return newsize != m_size ? rehash(newsize) : LINF_SUCCEEDED;
+}
+
+/**
+ * Insert a entry, or replace the value if the key exists.
+ * @param key The pointer, must not be 0.
+ * @param value The value.
+ * @return status code.
+ */
+int
+PtrMap::insert(const void *key, unsigned long long value)
+{
+  LP_ASSERT(key);
+
+  /* keep the load factor below 1/2 */
+  if ((m_count + 1) * 2 > m_size)
+    {
+      int rc = rehash(m_size ? m_size * 2 : PTRMAP_MIN_SIZE);
+      UPDATE_RC(rc);
+    }
+
+  size_t pos = hashPtr(key) & (m_size - 1);
+  while (m_table[pos].key && m_table[pos].key != key)
+    pos = (pos + 1) & (m_size - 1);
+
+  if (!m_table[pos].key)
+    m_count++;
+  m_table[pos].key = key;
+  m_table[pos].value = value;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Lookup the value of key.
+ * @param key The pointer.
+ * @param value Where to store the value.
+ * @return true if found.
+ */
+bool
+PtrMap::lookup(const void *key, __OUT unsigned long long *value) const
+{
+  if (!m_count)
+    return false;
+
+  size_t pos = hashPtr(key) & (m_size - 1);
+  while (m_table[pos].key)
+    {
+      if (m_table[pos].key == key)
+        {
+          *value = m_table[pos].value;
+          return true;
+        }
+      pos = (pos + 1) & (m_size - 1);
+    }
+  return false;
+}
+
+/**
+ * Remove the entries whose key is rejected by the filter.
+ * All the entries are removed if out of memory.
+ * @param pfn Pointer to the filter.
+ * @param opaque The pointer passed to the filter.
+ * @return status code.
+ */
+int
+PtrMap::retain(pfnRetainKey pfn, void *opaque)
+{
+  if (!m_count)
+    return LINF_SUCCEEDED;
+
+  PtrMapEntry *old = m_table;
+  size_t oldsize = m_size;
+
+  m_table = new (std::nothrow) PtrMapEntry[oldsize];
+  if (!m_table)
+    {
+      m_table = old;
+      clear();
+      return LERR_ALLOC_MEMORY;
+    }
+  for (size_t i = 0; i < oldsize; i++)
+    m_table[i].key = 0;
+  m_count = 0;
+
+  for (size_t i = 0; i < oldsize; i++)
+    {
+      if (old[i].key && pfn(old[i].key, opaque))
+        {
+          size_t pos = hashPtr(old[i].key) & (m_size - 1);
+          while (m_table[pos].key)
+            pos = (pos + 1) & (m_size - 1);
+          m_table[pos] = old[i];
+          m_count++;
+        }
+    }
+  delete [] old;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, remove the entry at a slot, the entries after it in the same
+ * probing sequence are shifted back into the hole.
+ * @param pos Index of the slot.
+ */
+void
+PtrMap::removeAt(size_t pos)
+{
+  size_t hole = pos;
+  for (size_t i = (pos + 1) & (m_size - 1); m_table[i].key; i = (i + 1) & (m_size - 1))
+    {
+      /* movable unless its home is in (hole, i] */
+      size_t home = hashPtr(m_table[i].key) & (m_size - 1);
+      if (((i - home) & (m_size - 1)) >= ((i - hole) & (m_size - 1)))
+        {
+          m_table[hole] = m_table[i];
+          hole = i;
+        }
+    }
+  m_table[hole].key = 0;
+  m_count--;
+}
+
+/**
+ * Remove the entries whose key is rejected by the filter, a few slots
+ * at a time, so that a large table is filtered in short steps. The
+ * table may be changed between the steps.
+ * @param pfn Pointer to the filter.
+ * @param opaque The pointer passed to the filter.
+ * @param at Cursor of the filtering, set size to ~0 to start.
+ * @param steps Number of the slots to check in this step.
+ * @return true if all the slots are checked.
+ */
+bool
+PtrMap::retainSome(pfnRetainKey pfn, void *opaque, RetainCursor *at, size_t steps)
+{
+  if (at->size != m_size)
+    {
+      at->slot = 0;
+      at->size = m_size;
+    }
+  for (; steps && at->slot < m_size; steps--)
+    {
+      /* the entry shifted into the slot is checked next */
+      if (m_table[at->slot].key && !pfn(m_table[at->slot].key, opaque))
+        removeAt(at->slot);
+      else
+        at->slot++;
+    }
+  return at->slot >= m_size;
+}
+
+/**
+ * Remove all the entries.
+ */
+void
+PtrMap::clear()
+{
+  for (size_t i = 0; i < m_size; i++)
+    m_table[i].key = 0;
+  m_count = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The line and the column are packed into one value of PtrMap.
+ */
+#define SRCMAP_COLUMN_BITS (24)
+#define SRCMAP_COLUMN_MASK ((1ULL << SRCMAP_COLUMN_BITS) - 1)
+
+/**
+ * Record the position of a node, the position recorded first is kept.
+ * @param node Pointer to the node.
+ * @param line The number of line, starting from 1.
+ * @param column The number of column, starting from 1.
+ * @return status code.
+ */
+int
+SourceMap::add(const SynNode *node, file_off line, file_off column)
+{
+  unsigned long long v;
+  if (m_map.lookup(node, &v))
+    return LINF_SUCCEEDED;
+
+  if (static_cast<unsigned long long>(column) > SRCMAP_COLUMN_MASK)
+    column = 0; /* unknown */
+  v = (static_cast<unsigned long long>(line) << SRCMAP_COLUMN_BITS)
+      | static_cast<unsigned long long>(column);
+  return m_map.insert(node, v);
+}
+
+/**
+ * Lookup the position of a node.
+ * @param node Pointer to the node.
+ * @param line Where to store the number of line.
+ * @param column Where to store the number of column, 0 if unknown.
+ * @return false if the node was not created by parser.
+ */
+bool
+SourceMap::lookup(const SynNode *node, __OUT file_off *line, __OUT file_off *column) const
+{
+  unsigned long long v;
+  if (!node || !m_map.lookup(node, &v))
+    return false;
+  *line = static_cast<file_off>(v >> SRCMAP_COLUMN_BITS);
+  *column = static_cast<file_off>(v & SRCMAP_COLUMN_MASK);
+  return true;
+}
+
+/**
+ * Forget the positions of the nodes rejected by the filter.
+ * @param pfn Pointer to the filter.
+ * @param opaque The pointer passed to the filter.
+ * @return status code.
+ */
+int
+SourceMap::retain(pfnRetainKey pfn, void *opaque)
+{
+  return m_map.retain(pfn, opaque);
+}
+
+/**
+ * Forget the positions of the nodes rejected by the filter in steps,
+ * see PtrMap::retainSome().
+ */
+bool
+SourceMap::retainSome(pfnRetainKey pfn, void *opaque, RetainCursor *at, size_t steps)
+{
+  return m_map.retainSome(pfn, opaque, at, steps);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+NodeStack::NodeStack()
+  : m_nodes(0),
+    m_count(0),
+    m_size(0)
+{
+}
+
+NodeStack::~NodeStack()
+{
+  if (m_nodes)
+    delete [] m_nodes;
+}
+
+/**
+ * Push a node on the top.
+ * @param node Pointer to the node.
+ * @return status code.
+ */
+int
+NodeStack::push(SynNode *node)
+{
+  if (m_count == m_size)
+    {
+      size_t newsize = m_size ? m_size * 2 : 64;
+      SynNode **nodes = new (std::nothrow) SynNode*[newsize];
+      if (!nodes)
+        return LERR_ALLOC_MEMORY;
+      if (m_nodes)
+        {
+          memcpy(nodes, m_nodes, m_count * sizeof(SynNode*));
+          delete [] m_nodes;
+        }
+      m_nodes = nodes;
+      m_size = newsize;
+    }
+  m_nodes[m_count++] = node;
+  return LINF_SUCCEEDED;
+}
+
+} // namespace DSL
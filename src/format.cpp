@@ -0,0 +1,130 @@
+/** @file
+ * LispDSL - Textual formatting of the values.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Format a number in the shortest of "%.15g" and "%.17g" that reads
+ * back as the same value, so (number->string 0.1) gives "0.1" while
+ * no precision is lost for the others.
+ * @param v The number.
+ * @param out Where to append the result.
+ * @return status code.
+ */
+int
+formatNumber(double v, __OUT StringPool &out)
+{
+  char buff[32];
+  int len = snprintf(buff, sizeof(buff), "%.15g", v);
+  if (strtod(buff, 0) != v && v == v /* not NaN */)
+    len = snprintf(buff, sizeof(buff), "%.17g", v);
+  return out.append(buff, static_cast<size_t>(len));
+}
+
+/**
+ * Format a value as the text written by display, i.e. strings and
+ * characters without the quotes.
+ * @param node Pointer to the value, 0 for nil.
+ * @param out Where to append the result.
+ * @return status code.
+ */
+/* static */
+int
+Lisp::formatNode(SynNode *node, __OUT StringPool &out)
+{
+  int rc;
+  if (!node)
+    {
+      return out.append("nil");
+    }
+
+  switch (node->object.type)
+  {
+    case OBJTYPE_PAIR:
+      {
+        rc = out.append("(", 1);
+        while (LP_SUCCESS(rc) && node)
+          {
+            if (node->object.type == OBJTYPE_PAIR)
+              {
+                rc = formatNode(OBJ_LEAF(node), out);
+                node = OBJ_NEXT(node);
+              }
+            else
+              {
+                rc = out.append(". ", 2);
+                if (LP_SUCCESS(rc))
+                  rc = formatNode(node, out);
+                node = 0;
+              }
+            if (LP_SUCCESS(rc) && node)
+              rc = out.append(" ", 1);
+          }
+        if (LP_SUCCESS(rc))
+          rc = out.append(")", 1);
+      }
+      break;
+
+    case OBJTYPE_BOOLEAN:
+      rc = out.append(OBJ_VALUE(OBJTYPE_BOOLEAN, node) ? "#t" : "#f", 2);
+      break;
+    case OBJTYPE_NUMBER:
+      rc = formatNumber(OBJ_VALUE(OBJTYPE_NUMBER, node), out);
+      break;
+    case OBJTYPE_CHARACTER:
+      {
+        char c = OBJ_VALUE(OBJTYPE_CHARACTER, node);
+        rc = out.append(&c, 1);
+      }
+      break;
+    case OBJTYPE_STRING:
+      rc = out.append(OBJ_VALUE(OBJTYPE_STRING, node)->buffer(),
+                      OBJ_VALUE(OBJTYPE_STRING, node)->length());
+      break;
+    case OBJTYPE_SYMBOL:
+      rc = out.append(OBJ_VALUE(OBJTYPE_SYMBOL, node)->buffer(),
+                      OBJ_VALUE(OBJTYPE_SYMBOL, node)->length());
+      break;
+    case OBJTYPE_FUNC:
+      rc = out.append("#func");
+      break;
+    case OBJTYPE_PORT:
+      rc = out.append("#port");
+      break;
+    case OBJTYPE_FUTURE:
+      rc = out.append("#future");
+      break;
+
+    default:
+      rc = out.append("(unknown)");
+  }
+  return rc;
+}
+
+} // namespace DSL
@@ -0,0 +1,346 @@
+/** @file
+ * LispDSL - Fuel, deadline and preemption of the evaluation.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The program of run() is evaluated on the stack of fiber, and the fiber
+ * switches back to the caller when the fuel is used up, so that the
+ * evaluation can be resumed later, even by another thread.
+ */
+struct LispFiber
+{
+  ucontext_t  caller;
+  ucontext_t  context;
+  char       *stack;
+  bool        active;     /* started and not finished */
+  bool        running;    /* on the stack of fiber */
+  bool        cancelled;
+  SynNode    *result;
+  int         rc;
+};
+
+/**
+ * Inner, get the wall-clock time.
+ * @return the value in microseconds.
+ */
+static unsigned long long
+clockMicros()
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+  return now.tv_sec * 1000000ULL + now.tv_usec;
+}
+
+/**
+ * Set the number of evaluations left, each expression evaluated takes
+ * one. When it is used up, the evaluation fails with LERR_OUT_OF_FUEL,
+ * or is suspended if preemptive. The fuel is not refilled by run(),
+ * set it again before each run() or resume(). The evaluations of the
+ * workers of pmap, pfor-each and future are taken from it too.
+ * @param steps The number, LISP_FUEL_UNLIMITED (the default) for no limit.
+ */
+void
+Lisp::setFuel(unsigned long long steps)
+{
+  m_fuel = steps;
+  m_metered = m_fuel != LISP_FUEL_UNLIMITED || m_deadline;
+}
+
+/**
+ * Set the wall-clock time allowed for each call of run(), resume(),
+ * load() and applyBatch(). When it passes, the evaluation fails with
+ * LERR_OUT_OF_FUEL, or is suspended if preemptive. It is checked every
+ * LISP_CLOCK_PERIOD evaluations, also by the workers.
+ * @param ms The time in milliseconds, 0 (the default) for no limit.
+ */
+void
+Lisp::setDeadline(unsigned long ms)
+{
+  m_deadline = ms;
+  m_metered = m_fuel != LISP_FUEL_UNLIMITED || m_deadline;
+}
+
+/**
+ * Suspend the evaluation of run() instead of failing it when the fuel
+ * or the time is used up, run() returns LINF_SUSPENDED then, and the
+ * evaluation goes on by resume(), from the same or another thread.
+ * Thus the scripts of many instances can be time-sliced on a few
+ * threads. Only run() is preemptive, load() and applyBatch() fail.
+ * @param enable Whether to suspend.
+ */
+void
+Lisp::setPreemptive(bool enable)
+{
+  m_preemptive = enable;
+}
+
+/**
+ * Point out whether the evaluation of run() is suspended, until it is
+ * resumed or cancelled. Nothing else is evaluated meanwhile.
+ * @return true if so.
+ */
+bool
+Lisp::suspended() const
+{
+  return m_fiber && m_fiber->active && !m_fiber->running;
+}
+
+/**
+ * Inner, start the time allowed for the evaluation, see setDeadline().
+ */
+void
+Lisp::startClock()
+{
+  if (m_deadline)
+    m_deadlineAt = clockMicros() + m_deadline * 1000ULL;
+}
+
+/**
+ * Inner, meter a worker by the fuel and the deadline of this instance,
+ * before it evaluates a map or a future. The evaluations of the worker
+ * are charged to the fuel of this instance, see takeFuel().
+ * @param w Pointer to the worker.
+ */
+void
+Lisp::shareMeter(Lisp *w) const
+{
+  w->m_metered = m_metered;
+  w->m_deadline = m_deadline;
+  w->m_deadlineAt = m_deadlineAt;
+}
+
+/**
+ * Inner, take one from the fuel. The fuel of the owner is shared by
+ * its workers, so it is taken atomically once the pool is started.
+ * @return false if used up.
+ */
+bool
+Lisp::takeFuel()
+{
+  if (!m_parent && !m_pool)
+    {
+      if (!m_fuel)
+        return false;
+      if (m_fuel != LISP_FUEL_UNLIMITED)
+        m_fuel--;
+      return true;
+    }
+
+  unsigned long long *fuel = m_parent ? &m_parent->m_fuel : &m_fuel;
+  for (;;)
+    {
+      unsigned long long left = *fuel;
+      if (!left)
+        return false;
+      if (LISP_FUEL_UNLIMITED == left
+          || __sync_bool_compare_and_swap(fuel, left, left - 1))
+        return true;
+    }
+}
+
+/**
+ * Inner, point out whether the fuel or the time of a worker is used up,
+ * so that the ranges of map skipped fail as the one evaluated.
+ * @return true if so.
+ */
+bool
+Lisp::meterUsedUp() const
+{
+  const Lisp *owner = m_parent ? m_parent : this;
+  return m_metered && (!owner->m_fuel || (m_deadline && clockMicros() >= m_deadlineAt));
+}
+
+/**
+ * Inner, take the fuel for a evaluation, see setFuel().
+ * @param at Pointer to the node evaluated.
+ * @return status code.
+ */
+int
+Lisp::consumeFuel(SynNode *at)
+{
+  for (;;)
+    {
+      bool late = m_deadline && !(++m_ticks % LISP_CLOCK_PERIOD)
+          && clockMicros() >= m_deadlineAt;
+      bool empty = !late && !takeFuel();
+      if (!empty && !late)
+        {
+          return LINF_SUCCEEDED;
+        }
+
+      if (!m_fiber || !m_fiber->running)
+        {
+          throwErrorAt(at, late ? "evaluation passed the deadline." : "evaluation ran out of fuel.");
+          return LERR_OUT_OF_FUEL;
+        }
+
+      /* suspended, until resume() or cancel() */
+      swapcontext(&m_fiber->context, &m_fiber->caller);
+      if (m_fiber->cancelled)
+        return LERR_OUT_OF_FUEL;
+    }
+}
+
+/**
+ * Inner, the entry of fiber, evaluating the program of run(). The
+ * pointer of instance is split into two, as makecontext() passes int.
+ * @param hi The high bits of pointer.
+ * @param lo The low bits of pointer.
+ */
+/* static */
+void
+Lisp::fiberEntry(unsigned int hi, unsigned int lo)
+{
+  Lisp *lisp = reinterpret_cast<Lisp *>((static_cast<unsigned long>(hi) << 16 << 16) | lo);
+  LispFiber *fiber = lisp->m_fiber;
+
+  int rc = LINF_SUCCEEDED;
+  fiber->result = lisp->dispatchEvaling(lisp->m_ast, 0/*envsp*/, rc);
+  fiber->rc = rc;
+  fiber->active = false;
+  swapcontext(&fiber->context, &fiber->caller); /* never resumed */
+}
+
+/**
+ * Inner, switch to the fiber until it is suspended or finished.
+ */
+void
+Lisp::switchFiber()
+{
+  m_fiber->running = true;
+  swapcontext(&m_fiber->caller, &m_fiber->context);
+  m_fiber->running = false;
+}
+
+/**
+ * Inner, evaluate the program of run() on the fiber.
+ * @param out Optional, Where to store the result.
+ * @return status code. LINF_SUSPENDED if the fuel was used up.
+ */
+int
+Lisp::runFiber(__OUT SynNode **out)
+{
+  if (!m_fiber)
+    {
+      m_fiber = new (std::nothrow) LispFiber;
+      if (!m_fiber)
+        {
+          return LERR_ALLOC_MEMORY;
+        }
+      m_fiber->stack = new (std::nothrow) char[LISP_FIBER_STACK];
+      if (!m_fiber->stack)
+        {
+          delete m_fiber;
+          m_fiber = 0;
+          return LERR_ALLOC_MEMORY;
+        }
+      m_fiber->active = m_fiber->running = false;
+    }
+
+  if (getcontext(&m_fiber->context))
+    {
+      return LERR_FAILED;
+    }
+  m_fiber->context.uc_stack.ss_sp = m_fiber->stack;
+  m_fiber->context.uc_stack.ss_size = LISP_FIBER_STACK;
+  m_fiber->context.uc_link = 0;
+  unsigned long self = reinterpret_cast<unsigned long>(this);
+  makecontext(&m_fiber->context, reinterpret_cast<void (*)()>(fiberEntry), 2,
+              static_cast<unsigned int>(self >> 16 >> 16),
+              static_cast<unsigned int>(self & 0xffffffffUL));
+  m_fiber->active = true;
+  m_fiber->cancelled = false;
+  return resume(out);
+}
+
+/**
+ * Go on with the evaluation of run() suspended, see setPreemptive().
+ * The fuel and the deadline should be set again before.
+ * @param out Optional, Where to store the result of program.
+ * @return status code, as of run(). LINF_SUSPENDED if the fuel was used
+ *         up again.
+ */
+int
+Lisp::resume(__OUT SynNode **out)
+{
+  if (!m_fiber || !m_fiber->active || m_fiber->running)
+    {
+      return LERR_FAILED;
+    }
+
+  startClock();
+  switchFiber();
+  if (m_fiber->active)
+    {
+      /* the output so far is visible to the host */
+      int rc = flushOutput();
+      return LP_SUCCESS(rc) ? LINF_SUSPENDED : rc;
+    }
+  return finishRun(m_fiber->result, m_fiber->rc, out);
+}
+
+/**
+ * Abandon the evaluation of run() suspended, it fails with
+ * LERR_OUT_OF_FUEL where it was suspended.
+ * @return status code.
+ */
+int
+Lisp::cancel()
+{
+  if (!suspended())
+    {
+      return LINF_SUCCEEDED;
+    }
+
+  m_fiber->cancelled = true;
+  switchFiber();
+  LP_ASSERT(!m_fiber->active);
+  waitFutures();
+  return flushOutput();
+}
+
+/**
+ * Inner, cancel the evaluation suspended and free the fiber.
+ */
+void
+Lisp::dropFiber()
+{
+  if (m_fiber)
+    {
+      cancel();
+      delete [] m_fiber->stack;
+      delete m_fiber;
+      m_fiber = 0;
+    }
+}
+
+} // namespace DSL
@@ -1,119 +1,1447 @@
-/** @file
- * LispDSL - Garbage collection.
- */
-
-/*
- *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
- *  please contact with <diyer175@hotmail.com> if you have any problems.
- *
- *  This project is free software; you can redistribute it and/or
- *  modify it under the terms of the GNU Lesser General Public License(GPL)
- *  as published by the Free Software Foundation; either version 2.1
- *  of the License, or (at your option) any later version.
- *
- *  This project is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
- *  Lesser General Public License for more details.
- */
-
-/*******************************************************************************
-*   Header Files                                                               *
-*******************************************************************************/
-#include "lispdsl.h"
-
-namespace DSL {
-
-////////////////////////////////////////////////////////////////////////////////
-
-GC::GC()
-{
-}
-
-/**
- * Create a variable node.
- * @param Pointer to the first leaf node.
- * @param next Pointer to the next node.
- * @param out Where to store the new node.
- * @return status code.
- */
-int
-GC::createSynNode(SynNode *leaf, SynNode *next, __OUT SynNode **out)
-{
-  SynNode *n;
-  *out = n = new (std::nothrow) SynNode;
-  if (n)
-    {
-      n->object.type = OBJTYPE_PAIR;
-      n->line = 0;
-      OBJ_LEAF(n) = leaf;
-      OBJ_NEXT(n) = next;
-      return LINF_SUCCEEDED;
-    }
-  return LERR_ALLOC_MEMORY;
-}
-
-/**
- * Inner, new a list-type syntax node.
- * @param Pointer to the first leaf node.
- * @param next Pointer to the next node.
- * @param line The number of current line.
- * @param out Where to store the new node.
- * @return status code.
- */
-int
-GC::createPair(SynNode *leaf, SynNode *next, file_off line, __OUT SynNode **out)
-{
-  SynNode *n;
-  *out = n = new (std::nothrow) SynNode;
-  if (n)
-    {
-      n->object.type = OBJTYPE_PAIR;
-      n->line = line;
-      OBJ_LEAF(n) = leaf;
-      OBJ_NEXT(n) = next;
-      return LINF_SUCCEEDED;
-    }
-  return LERR_ALLOC_MEMORY;
-}
-
-
-/**
- * Create a function-type synnode.
- * @param params Pointer to the parameters node.
- * @param body Pointer to the body of function.
- * @param sp Stack index of environment.
- * @param line The number of source line.
- * @param out Where to store the result.
- */
-int
-GC::createFunc(SynNode *params, SynNode *body, EnvSP sp, file_off line, __OUT SynNode **out)
-{
-  SynNode *n;
-  *out = n = new (std::nothrow) SynNode;
-  if (n)
-    {
-      n->object.type = OBJTYPE_FUNC;
-      n->line = line;
-      n->object.u.OBJTYPE_FUNC.params = params;
-      n->object.u.OBJTYPE_FUNC.body = body;
-      n->object.u.OBJTYPE_FUNC.envsp = sp;
-      return LINF_SUCCEEDED;
-    }
-  return LERR_ALLOC_MEMORY;
-}
-
-/**
- * Working for macro createAtom().
- * @param out Where to store the result.
- * @return status code.
- */
-int
-GC::_createAtom(__OUT SynNode **out)
-{
-  *out = new (std::nothrow) SynNode;
-  return *out ? LINF_SUCCEEDED : LERR_ALLOC_MEMORY;
-}
-
-
-} // namespace DSL
+/** @file
+ * LispDSL - Garbage collection.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include <sched.h>
+#include <sys/time.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The objects are aligned to 8 bytes, the data of chunk as well.
+ */
+#define GC_ALIGN(size) (((size) + 7) & ~static_cast<size_t>(7))
+#define GC_CHUNK_HEADER GC_ALIGN(sizeof(GCChunk))
+#define GC_CHUNK_DATA(c) (reinterpret_cast<char *>(c) + GC_CHUNK_HEADER)
+
+/*
+ * The bitmaps of chunk, with a bit for each granule of data.
+ */
+#define GC_BITS (sizeof(unsigned long) * 8)
+#define GC_BITMAP_WORDS(size) (((size) / GC_GRANULE + GC_BITS - 1) / GC_BITS)
+#define GC_FREE_MIN GC_ALIGN(sizeof(GCFree))
+
+#define GC_MARK_SHARE (64)  /* nodes scanned between the checks of idle markers */
+#define GC_PURGE_STEPS (256) /* slots of the tables purged between the checks of time */
+
+static inline void
+setBit(unsigned long *map, size_t i)
+{
+  map[i / GC_BITS] |= 1UL << (i % GC_BITS);
+}
+
+static inline void
+clearBit(unsigned long *map, size_t i)
+{
+  map[i / GC_BITS] &= ~(1UL << (i % GC_BITS));
+}
+
+static inline bool
+testBit(const unsigned long *map, size_t i)
+{
+  return (map[i / GC_BITS] >> (i % GC_BITS)) & 1;
+}
+
+/**
+ * Inner, set a bit shared by the markers.
+ * @return true if it was clear.
+ */
+static inline bool
+setBitAtomic(unsigned long *map, size_t i)
+{
+  unsigned long bit = 1UL << (i % GC_BITS);
+  return !(__sync_fetch_and_or(&map[i / GC_BITS], bit) & bit);
+}
+
+/**
+ * Inner, find the next bit set.
+ * @param map Pointer to the bitmap.
+ * @param from The first bit to test.
+ * @param end The bit after the last.
+ * @return end if not found.
+ * @return index of the bit.
+ */
+static size_t
+nextBit(const unsigned long *map, size_t from, size_t end)
+{
+  while (from < end)
+    {
+      unsigned long w = map[from / GC_BITS] >> (from % GC_BITS);
+      if (w)
+        {
+          size_t i = from + __builtin_ctzl(w);
+          return i < end ? i : end;
+        }
+      from = (from / GC_BITS + 1) * GC_BITS;
+    }
+  return end;
+}
+
+/**
+ * Inner, clear the bits in [from, end).
+ */
+static void
+clearBits(unsigned long *map, size_t from, size_t end)
+{
+  for (; from < end && from % GC_BITS; from++)
+    clearBit(map, from);
+  for (; from + GC_BITS <= end; from += GC_BITS)
+    map[from / GC_BITS] = 0;
+  for (; from < end; from++)
+    clearBit(map, from);
+}
+
+GC::GC()
+  : m_chunks(0),
+    m_sorted(0),
+    m_count(0),
+    m_capacity(0),
+    m_free(0),
+    m_bytes(0),
+    m_undo(0),
+    m_undoCount(0),
+    m_undoSize(0),
+    m_logging(false),
+    m_readonly(0),
+    m_private(false),
+    m_freezing(false),
+    m_hasFree(false),
+    m_sweepNext(0),
+    m_sweepEnd(0),
+    m_trigger(GC_MIN_TRIGGER),
+    m_minTrigger(GC_MIN_TRIGGER),
+    m_marking(false),
+    m_purging(false),
+    m_epoch(0),
+    m_markLive(0),
+    m_nextSlice(0),
+    m_sliceBudget(0),
+    m_collected(0),
+    m_collectedOpaque(0),
+    m_softLimit(0),
+    m_hardLimit(0),
+    m_limit(~static_cast<size_t>(0)),
+    m_softReported(false),
+    m_refused(false),
+    m_limitPfn(0),
+    m_limitOpaque(0)
+{
+  memset(&m_undoMark, 0, sizeof(m_undoMark));
+  memset(&m_base, 0, sizeof(m_base));
+  memset(m_freeLists, 0, sizeof(m_freeLists));
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+GC::~GC()
+{
+  GCMark empty;
+  memset(&empty, 0, sizeof(empty));
+  release(empty);
+  trim();
+
+  if (m_chunks)
+    delete [] m_chunks;
+  if (m_sorted)
+    delete [] m_sorted;
+  if (m_undo)
+    delete [] m_undo;
+}
+
+/**
+ * Inner, get a chunk for the allocation, from the free ones if possible.
+ * @param size The size of data wanted.
+ * @return 0 if failed.
+ * @return pointer to the chunk, appended in the lists.
+ */
+GCChunk *
+GC::newChunk(size_t size)
+{
+  if (m_count == m_capacity)
+    {
+      size_t newsize = m_capacity ? m_capacity * 2 : 64;
+      GCChunk **chunks = new (std::nothrow) GCChunk*[newsize];
+      GCChunk **sorted = new (std::nothrow) GCChunk*[newsize];
+      if (!chunks || !sorted)
+        {
+          if (chunks)
+            delete [] chunks;
+          if (sorted)
+            delete [] sorted;
+          return 0;
+        }
+      if (m_count)
+        {
+          memcpy(chunks, m_chunks, m_count * sizeof(GCChunk*));
+          memcpy(sorted, m_sorted, m_count * sizeof(GCChunk*));
+        }
+      if (m_chunks)
+        delete [] m_chunks;
+      if (m_sorted)
+        delete [] m_sorted;
+      m_chunks = chunks;
+      m_sorted = sorted;
+      m_capacity = newsize;
+    }
+
+  GCChunk *c;
+  if (size <= GC_CHUNK_SIZE && m_free)
+    {
+      c = m_free;
+      m_free = c->next;
+    }
+  else
+    {
+      if (size < GC_CHUNK_SIZE)
+        size = GC_CHUNK_SIZE;
+      size_t bitmaps = 2 * GC_BITMAP_WORDS(size) * sizeof(unsigned long);
+      c = reinterpret_cast<GCChunk *>(new (std::nothrow) char[GC_CHUNK_HEADER + size + bitmaps]);
+      if (!c)
+        return 0;
+      c->size = size;
+      c->starts = reinterpret_cast<unsigned long *>(GC_CHUNK_DATA(c) + size);
+      c->marks = c->starts + GC_BITMAP_WORDS(size);
+    }
+  c->next = 0;
+  c->seq = m_count;
+  c->used = 0;
+  c->sweepFrom = c->sweepLimit = 0;
+  c->epoch = m_epoch;
+  c->sweepEpoch = 0;
+  memset(c->starts, 0, 2 * GC_BITMAP_WORDS(c->size) * sizeof(unsigned long));
+
+  /* insert in the order of address */
+  size_t pos = m_count;
+  while (pos > 0 && m_sorted[pos - 1] > c)
+    {
+      m_sorted[pos] = m_sorted[pos - 1];
+      pos--;
+    }
+  m_sorted[pos] = c;
+  m_chunks[m_count++] = c;
+  return c;
+}
+
+/**
+ * Inner, allocate a block from the heap.
+ * @param size The size in bytes.
+ * @return 0 if failed.
+ * @return pointer to the block.
+ */
+void *
+GC::allocate(size_t size)
+{
+  size = GC_ALIGN(size);
+  if (UNLIKELY(m_bytes + size > m_limit) && LP_FAILURE(checkLimit(size)))
+    return 0;
+
+  void *p = m_hasFree ? allocateFree(size) : 0;
+  if (!p)
+    {
+      GCChunk *c = m_count ? m_chunks[m_count - 1] : 0;
+      if (!c || c->used + size > c->size)
+        {
+          c = newChunk(size);
+          if (!c)
+            {
+              m_refused = false;
+              return 0;
+            }
+        }
+      p = GC_CHUNK_DATA(c) + c->used;
+      setBit(c->starts, c->used / GC_GRANULE);
+      c->used += size;
+      m_bytes += size;
+    }
+  m_stats.allocations++;
+  m_stats.bytesAllocated += size;
+
+  /* allocated black, and the marking goes on by the bytes allocated */
+  if (UNLIKELY(m_marking))
+    {
+      size_t block;
+      if (markBlock(p, &block))
+        m_markLive += block;
+      if (m_bytes >= m_nextSlice)
+        markSlice();
+    }
+  return p;
+}
+
+/**
+ * Inner, check the limits before a allocation would exceed one of them.
+ * @param size The size in bytes, aligned.
+ * @return status code.
+ */
+int
+GC::checkLimit(size_t size)
+{
+  int rc = LINF_SUCCEEDED;
+  if (m_softLimit && !m_softReported && m_bytes + size > m_softLimit)
+    {
+      /* reported once, until the bytes fall below it again */
+      m_softReported = true;
+      updateLimit();
+      if (m_limitPfn)
+        rc = m_limitPfn(this, m_bytes + size, m_limitOpaque);
+      else
+        requestCollect();
+    }
+  if (LP_SUCCESS(rc) && m_hardLimit && m_bytes + size > m_hardLimit)
+    rc = LERR_HEAP_LIMIT;
+
+  if (LP_FAILURE(rc))
+    {
+      m_refused = true;
+      m_stats.refused++;
+    }
+  return rc;
+}
+
+/**
+ * Inner, update the bytes checked by the allocations, see checkLimit().
+ */
+void
+GC::updateLimit()
+{
+  if (m_softReported && m_bytes < m_softLimit)
+    m_softReported = false;
+
+  size_t limit = m_hardLimit ? m_hardLimit : ~static_cast<size_t>(0);
+  if (m_softLimit && !m_softReported && m_softLimit < limit)
+    limit = m_softLimit;
+  m_limit = limit;
+}
+
+/**
+ * Inner, allocate a block from the free runs, the chunks left by the
+ * last collection are swept here one by one as the runs are used up.
+ * @param size The size in bytes, aligned.
+ * @return 0 if no run fits.
+ * @return pointer to the block.
+ */
+void *
+GC::allocateFree(size_t size)
+{
+  size_t g = size / GC_GRANULE;
+  for (;;)
+    {
+      for (size_t k = g < GC_FREE_CLASSES - 1 ? g : GC_FREE_CLASSES - 1; k < GC_FREE_CLASSES; k++)
+        {
+          /* only the last class holds the runs of different sizes */
+          GCFree **link = &m_freeLists[k];
+          while (*link && (*link)->size < size)
+            link = &(*link)->next;
+          if (!*link)
+            continue;
+
+          GCFree *f = *link;
+          *link = f->next;
+          GCChunk *c = f->chunk;
+          size_t run = f->size;
+          char *p = reinterpret_cast<char *>(f);
+          if (run - size >= GC_FREE_MIN)
+            {
+              addFree(c, p + size - GC_CHUNK_DATA(c), run - size);
+              run = size;
+            }
+          m_bytes += run;
+          return p;
+        }
+
+      if (m_sweepNext < m_sweepEnd)
+        {
+          sweepChunk(m_chunks[m_sweepNext++]);
+          continue;
+        }
+      for (size_t k = 0; k < GC_FREE_CLASSES; k++)
+        {
+          if (m_freeLists[k])
+            return 0;
+        }
+      m_hasFree = false; /* until the next collection */
+      return 0;
+    }
+}
+
+/**
+ * Inner, add a run of the free space to the free lists.
+ * @param c Pointer to the chunk.
+ * @param offset Offset of the run in the data.
+ * @param size The size in bytes, the runs too short are left unused.
+ */
+void
+GC::addFree(GCChunk *c, size_t offset, size_t size)
+{
+  setBit(c->starts, offset / GC_GRANULE);
+  if (size < GC_FREE_MIN)
+    return;
+
+  GCFree *f = reinterpret_cast<GCFree *>(GC_CHUNK_DATA(c) + offset);
+  size_t k = size / GC_GRANULE;
+  if (k >= GC_FREE_CLASSES)
+    k = GC_FREE_CLASSES - 1;
+  f->size = size;
+  f->chunk = c;
+  f->next = m_freeLists[k];
+  m_freeLists[k] = f;
+}
+
+/**
+ * Inner, forget the free runs and the chunks not swept, they are found
+ * again by the next collection.
+ */
+void
+GC::dropFree()
+{
+  memset(m_freeLists, 0, sizeof(m_freeLists));
+  for (size_t i = m_sweepNext; i < m_sweepEnd; i++)
+    m_chunks[i]->sweepFrom = m_chunks[i]->sweepLimit = 0;
+  m_sweepNext = m_sweepEnd = 0;
+  m_hasFree = false;
+}
+
+/**
+ * Inner, find the chunk containing the address.
+ * @param p The address.
+ * @return 0 if it is not in the heap.
+ * @return pointer to the chunk.
+ */
+GCChunk *
+GC::findChunk(const void *p) const
+{
+  const char *addr = static_cast<const char *>(p);
+  size_t lo = 0, hi = m_count;
+  while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      GCChunk *c = m_sorted[mid];
+      if (addr < GC_CHUNK_DATA(c))
+        hi = mid;
+      else if (addr >= GC_CHUNK_DATA(c) + c->size)
+        lo = mid + 1;
+      else
+        return c;
+    }
+  return 0;
+}
+
+/**
+ * Create a variable node.
+ * @param Pointer to the first leaf node.
+ * @param next Pointer to the next node.
+ * @param out Where to store the new node.
+ * @return status code.
+ */
+int
+GC::createSynNode(SynNode *leaf, SynNode *next, __OUT SynNode **out)
+{
+  return createPair(leaf, next, out);
+}
+
+/**
+ * Inner, new a list-type syntax node.
+ * @param Pointer to the first leaf node.
+ * @param next Pointer to the next node.
+ * @param out Where to store the new node.
+ * @return status code.
+ */
+int
+GC::createPair(SynNode *leaf, SynNode *next, __OUT SynNode **out)
+{
+  SynNode *n;
+  *out = n = static_cast<SynNode *>(allocate(sizeof(SynNode)));
+  if (n)
+    {
+      n->object.type = OBJTYPE_PAIR;
+      OBJ_LEAF(n) = leaf;
+      OBJ_NEXT(n) = next;
+      return LINF_SUCCEEDED;
+    }
+  return allocError();
+}
+
+
+/**
+ * Create a function-type synnode.
+ * @param params Pointer to the parameters node.
+ * @param body Pointer to the body of function.
+ * @param sp Stack index of environment.
+ * @param out Where to store the result.
+ */
+int
+GC::createFunc(SynNode *params, SynNode *body, EnvSP sp, __OUT SynNode **out)
+{
+  SynNode *n;
+  *out = n = static_cast<SynNode *>(allocate(sizeof(SynNode)));
+  if (n)
+    {
+      n->object.type = OBJTYPE_FUNC;
+      n->object.u.OBJTYPE_FUNC.params = params;
+      n->object.u.OBJTYPE_FUNC.body = body;
+      n->object.u.OBJTYPE_FUNC.envsp = sp;
+      return LINF_SUCCEEDED;
+    }
+  return allocError();
+}
+
+/**
+ * Create a immutable string in the heap.
+ * @param src Pointer to the source bytes.
+ * @param len Length of source.
+ * @param out Where to store the result.
+ * @return status code.
+ */
+int
+GC::createString(const char *src, size_t len, __OUT ImmString **out)
+{
+  void *block = allocate(ImmString::sizeOf(len));
+  if (!block)
+    {
+      *out = 0;
+      return allocError();
+    }
+  *out = ImmString::construct(block, src, len);
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Create a output string port. The buffer of port is released along
+ * with the node.
+ * @param out Where to store the result.
+ * @return status code.
+ */
+int
+GC::createPort(__OUT SynNode **out)
+{
+  int rc;
+  SynNode *n = static_cast<SynNode *>(allocate(sizeof(SynNode)));
+  void *block = allocate(sizeof(StringPool));
+  if (!n || !block)
+    {
+      return allocError();
+    }
+  rc = m_ports.push(n);
+  UPDATE_RC(rc);
+
+  n->object.type = OBJTYPE_PORT;
+  n->object.u.OBJTYPE_PORT.v = new (block) StringPool;
+  *out = n;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Working for macro createAtom().
+ * @param out Where to store the result.
+ * @return status code.
+ */
+int
+GC::_createAtom(__OUT SynNode **out)
+{
+  *out = static_cast<SynNode *>(allocate(sizeof(SynNode)));
+  return *out ? LINF_SUCCEEDED : allocError();
+}
+
+/**
+ * Get the current position of heap.
+ * @param out Where to store the result.
+ */
+void
+GC::mark(__OUT GCMark *out) const
+{
+  out->chunks = m_count;
+  out->used = m_count ? m_chunks[m_count - 1]->used : 0;
+  out->bytes = m_bytes;
+  out->ports = m_ports.count();
+}
+
+/**
+ * Release all the objects allocated after the mark at once.
+ * The chunks are kept for the allocations later, see trim().
+ * Nothing allocated after the mark may be referenced afterwards.
+ * @param mark The position got by mark().
+ */
+void
+GC::release(const GCMark &mark)
+{
+  LP_ASSERT(mark.chunks <= m_count);
+
+  /* the collector may have freed some of the ports after the mark */
+  for (size_t i = m_ports.count(); i > mark.ports; i--)
+    {
+      OBJ_VALUE(OBJTYPE_PORT, m_ports[i - 1])->~StringPool();
+    }
+  if (mark.ports < m_ports.count())
+    m_ports.truncate(mark.ports);
+
+  if (mark.chunks == m_count && (!m_count || m_chunks[m_count - 1]->used == mark.used))
+    return;
+  dropFree();
+
+  /* the nodes released are not scanned */
+  size_t grey = 0;
+  for (size_t i = 0; i < m_grey.count(); i++)
+    {
+      if (allocatedBefore(m_grey[i], mark))
+        m_grey[grey++] = m_grey[i];
+    }
+  m_grey.truncate(grey);
+
+  for (size_t i = mark.chunks; i < m_count; i++)
+    {
+      GCChunk *c = m_chunks[i];
+      if (c->size > GC_CHUNK_SIZE)
+        delete [] reinterpret_cast<char *>(c);
+      else
+        {
+          c->next = m_free;
+          m_free = c;
+        }
+    }
+  m_count = mark.chunks;
+  if (m_count)
+    {
+      GCChunk *c = m_chunks[m_count - 1];
+      clearBits(c->starts, mark.used / GC_GRANULE, c->used / GC_GRANULE);
+      c->used = mark.used;
+    }
+  m_bytes = mark.bytes;
+  updateLimit();
+  if (m_nextSlice > m_bytes + GC_SLICE_BYTES)
+    m_nextSlice = m_bytes + GC_SLICE_BYTES;
+
+  /* the chunks still in use, in the order of address */
+  size_t n = 0;
+  for (size_t i = 0; n < m_count; i++)
+    {
+      if (m_sorted[i]->seq < m_count && m_chunks[m_sorted[i]->seq] == m_sorted[i])
+        m_sorted[n++] = m_sorted[i];
+    }
+}
+
+/**
+ * Resolve whether a address was allocated before the mark.
+ * @param p The address.
+ * @param mark The position got by mark().
+ * @return false if it was allocated after the mark or not in the heap.
+ */
+bool
+GC::allocatedBefore(const void *p, const GCMark &mark) const
+{
+  GCChunk *c = findChunk(p);
+  if (!c || c->seq >= mark.chunks)
+    return false;
+  if (c->seq + 1 < mark.chunks)
+    return true;
+  return static_cast<const char *>(p) < GC_CHUNK_DATA(c) + mark.used;
+}
+
+/**
+ * Free the chunks kept by release().
+ */
+void
+GC::trim()
+{
+  while (m_free)
+    {
+      GCChunk *c = m_free;
+      m_free = c->next;
+      delete [] reinterpret_cast<char *>(c);
+    }
+}
+
+/**
+ * Start to log the mutations of the objects allocated before the mark,
+ * so that they can be undone by rollback().
+ * @param mark The position got by mark().
+ * @return status code.
+ */
+int
+GC::beginUndo(const GCMark &mark)
+{
+  /* the objects allocated afterwards must be after the mark */
+  dropFree();
+  m_undoMark = mark;
+  m_undoCount = 0;
+  m_logging = true;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, undo the mutations logged after the position, in the reverse order.
+ * @param base The number of records kept.
+ */
+void
+GC::rollbackTo(size_t base)
+{
+  while (m_undoCount > base)
+    {
+      GCUndo *u = &m_undo[--m_undoCount];
+      shade(*u->slot);
+      *u->slot = u->value;
+    }
+}
+
+/**
+ * Undo the mutations logged, in the reverse order. The logging goes on.
+ */
+void
+GC::rollback()
+{
+  rollbackTo(0);
+}
+
+/**
+ * Stop logging the mutations, the log is discarded.
+ */
+void
+GC::endUndo()
+{
+  m_undoCount = 0;
+  m_logging = false;
+}
+
+/**
+ * Start a nested undo log for the objects allocated before the mark,
+ * for example to undo the mutations of each call separately. The outer
+ * log, if any, is kept and resumed by leaveUndo().
+ * @param mark The position got by mark().
+ * @param scope Where to store the state of the outer log.
+ */
+void
+GC::enterUndo(const GCMark &mark, __OUT GCUndoScope *scope)
+{
+  scope->mark = m_undoMark;
+  scope->base = m_undoCount;
+  scope->logging = m_logging;
+  dropFree();
+  m_undoMark = mark;
+  m_logging = true;
+}
+
+/**
+ * Undo the mutations logged since enterUndo(), then resume the outer log.
+ * @param scope The state saved by enterUndo().
+ */
+void
+GC::leaveUndo(const GCUndoScope &scope)
+{
+  rollbackTo(scope.base);
+  m_undoMark = scope.mark;
+  m_logging = scope.logging;
+}
+
+/**
+ * Refuse the stores into the objects reachable from the roots, while
+ * they are read by the futures running on the other threads. The
+ * objects of the other heaps are not followed. It adds to the objects
+ * frozen before, until thaw().
+ * @param roots The roots, emptied.
+ * @return status code. Nothing more is frozen if failed.
+ */
+int
+GC::freeze(NodeStack &roots)
+{
+  int rc = LINF_SUCCEEDED;
+  if (!m_freezing)
+    {
+      /* the futures may keep the objects not marked yet */
+      m_marking = m_purging = false;
+      m_grey.clear();
+      dropFree();
+      m_freezing = true;
+    }
+
+  unsigned long long v;
+  while (LP_SUCCESS(rc) && roots.count())
+    {
+      SynNode *node = roots.pop();
+      if (!node || !contains(node) || m_frozenSet.lookup(node, &v))
+        continue;
+
+      /* the node itself for the ports, the fields for the stores */
+      rc = m_frozenSet.insert(node, 0);
+      switch (node->object.type)
+      {
+        case OBJTYPE_PAIR:
+          if (LP_SUCCESS(rc))
+            rc = m_frozenSet.insert(&node->object.u.OBJTYPE_PAIR.leaf, 0);
+          if (LP_SUCCESS(rc))
+            rc = m_frozenSet.insert(&node->object.u.OBJTYPE_PAIR.next, 0);
+          if (LP_SUCCESS(rc))
+            rc = roots.push(OBJ_LEAF(node));
+          if (LP_SUCCESS(rc))
+            rc = roots.push(OBJ_NEXT(node));
+          break;
+        case OBJTYPE_FUNC:
+          if (LP_SUCCESS(rc))
+            rc = roots.push(node->object.u.OBJTYPE_FUNC.params);
+          if (LP_SUCCESS(rc))
+            rc = roots.push(node->object.u.OBJTYPE_FUNC.body);
+          break;
+        case OBJTYPE_FUTURE:
+          if (LP_SUCCESS(rc))
+            rc = roots.push(node->object.u.OBJTYPE_FUTURE.value);
+          break;
+        default:
+          break;
+      }
+    }
+  return rc;
+}
+
+/**
+ * Allow the stores into all the objects again, see freeze().
+ */
+void
+GC::thaw()
+{
+  m_frozenSet.clear();
+  m_freezing = false;
+}
+
+/**
+ * Inner, log the old value of a field before it is written.
+ * @param slot Pointer to the field.
+ * @return status code.
+ */
+int
+GC::logStore(SynNode **slot)
+{
+  /* the objects created after the mark are simply released */
+  if (!allocatedBefore(slot, m_undoMark))
+    return LINF_SUCCEEDED;
+
+  if (m_undoCount == m_undoSize)
+    {
+      size_t newsize = m_undoSize ? m_undoSize * 2 : 256;
+      GCUndo *undo = new (std::nothrow) GCUndo[newsize];
+      if (!undo)
+        return LERR_ALLOC_MEMORY;
+      if (m_undo)
+        {
+          memcpy(undo, m_undo, m_undoCount * sizeof(GCUndo));
+          delete [] m_undo;
+        }
+      m_undo = undo;
+      m_undoSize = newsize;
+    }
+  m_undo[m_undoCount].slot = slot;
+  m_undo[m_undoCount].value = *slot;
+  m_undoCount++;
+  return LINF_SUCCEEDED;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Marker of the collection, each has a stack of its own, and shares a
+ * part of it with the idle ones.
+ */
+struct GCMarker
+{
+  pthread_mutex_t lock;     /* of the shared stack */
+  NodeStack       shared;   /* the others steal from it */
+  NodeStack       local;
+  size_t          live;     /* bytes marked */
+};
+
+struct GCMarkJob
+{
+  GC            *gc;
+  GCMarker      *markers;
+  size_t         count;
+  volatile long  pending;   /* the nodes pushed but not scanned */
+  volatile long  idle;      /* the markers looking for nodes */
+  volatile long  failed;
+};
+
+/**
+ * Inner, mark a block reached, if it is in the part of heap collected.
+ * @param p The address.
+ * @param size Where to store the size of block.
+ * @return true if it was not marked.
+ */
+bool
+GC::markBlock(const void *p, __OUT size_t *size)
+{
+  GCChunk *c = p ? findChunk(p) : 0;
+  if (!c || c->seq + 1 < m_base.chunks)
+    return false;
+  size_t offset = static_cast<const char *>(p) - GC_CHUNK_DATA(c);
+  if (c->seq + 1 == m_base.chunks && offset < m_base.used)
+    return false;
+  if (c->epoch != m_epoch)
+    refreshMarks(c);
+  /* the stale pointers of the stack of environment may point anywhere */
+  if (offset % GC_GRANULE || offset >= c->used || !testBit(c->starts, offset / GC_GRANULE))
+    return false;
+  if (!setBitAtomic(c->marks, offset / GC_GRANULE))
+    return false;
+
+  size_t g = offset / GC_GRANULE;
+  *size = (nextBit(c->starts, g + 1, c->used / GC_GRANULE) - g) * GC_GRANULE;
+  return true;
+}
+
+/**
+ * Inner, mark the objects referred by a node, the nodes newly marked are
+ * pushed to be scanned.
+ * @param node Pointer to the node.
+ * @param stack Where to push the nodes.
+ * @param live Where to add the bytes marked.
+ * @return status code.
+ */
+int
+GC::scan(SynNode *node, NodeStack &stack, __OUT size_t *live)
+{
+  const void *children[2] = {0, 0};
+  bool nodes = true;
+  switch (node->object.type)
+  {
+    case OBJTYPE_PAIR:
+      children[0] = OBJ_NEXT(node);
+      children[1] = OBJ_LEAF(node);
+      break;
+    case OBJTYPE_FUNC:
+      children[0] = node->object.u.OBJTYPE_FUNC.body;
+      children[1] = node->object.u.OBJTYPE_FUNC.params;
+      break;
+    case OBJTYPE_FUTURE:
+      children[0] = node->object.u.OBJTYPE_FUTURE.value;
+      break;
+    case OBJTYPE_STRING:
+      children[0] = OBJ_VALUE(OBJTYPE_STRING, node);
+      nodes = false;
+      break;
+    case OBJTYPE_SYMBOL:
+      children[0] = OBJ_VALUE(OBJTYPE_SYMBOL, node);
+      nodes = false;
+      break;
+    case OBJTYPE_PORT:
+      children[0] = OBJ_VALUE(OBJTYPE_PORT, node);
+      nodes = false;
+      break;
+    default:
+      break;
+  }
+
+  int rc = LINF_SUCCEEDED;
+  for (int i = 0; i < 2; i++)
+    {
+      size_t size;
+      if (!children[i] || !markBlock(children[i], &size))
+        continue;
+      *live += size;
+      /* a node is scanned only if the whole of it is in the block */
+      if (nodes && size >= sizeof(SynNode)
+          && LP_FAILURE(stack.push(static_cast<SynNode *>(const_cast<void *>(children[i])))))
+        rc = LERR_ALLOC_MEMORY;
+    }
+  return rc;
+}
+
+/**
+ * Inner, mark and scan the nodes until none is left in all the stacks.
+ * @param job Pointer to the job.
+ * @param index Index of the marker.
+ */
+void
+GC::drain(GCMarkJob *job, size_t index)
+{
+  GCMarker *m = &job->markers[index];
+  size_t scanned = 0;
+  bool idle = false;
+
+  for (;;)
+    {
+      if (!m->local.count())
+        {
+          /* steal from the shared stacks, starting from its own */
+          for (size_t k = 0; k < job->count && !m->local.count(); k++)
+            {
+              GCMarker *victim = &job->markers[(index + k) % job->count];
+              pthread_mutex_lock(&victim->lock);
+              size_t n = (victim->shared.count() + 1) / 2;
+              for (; n; n--)
+                {
+                  SynNode *node = victim->shared[victim->shared.count() - 1];
+                  if (LP_FAILURE(m->local.push(node)))
+                    break;
+                  victim->shared.pop();
+                }
+              pthread_mutex_unlock(&victim->lock);
+            }
+          if (!m->local.count())
+            {
+              if (!idle)
+                __sync_fetch_and_add(&job->idle, 1);
+              idle = true;
+              if (!__sync_fetch_and_add(&job->pending, 0))
+                break;
+              sched_yield();
+              continue;
+            }
+          if (idle)
+            __sync_fetch_and_sub(&job->idle, 1);
+          idle = false;
+        }
+
+      SynNode *node = m->local.pop();
+      size_t before = m->local.count();
+      if (LP_FAILURE(scan(node, m->local, &m->live)))
+        __sync_lock_test_and_set(&job->failed, 1);
+      __sync_fetch_and_add(&job->pending, m->local.count() - before);
+      __sync_fetch_and_sub(&job->pending, 1);
+
+      /* give the bottom half, the oldest nodes, to the idle markers */
+      if (job->count > 1 && ++scanned % GC_MARK_SHARE == 0
+          && m->local.count() > 1 && __sync_fetch_and_add(&job->idle, 0))
+        {
+          pthread_mutex_lock(&m->lock);
+          size_t half = m->local.count() / 2, n = 0;
+          while (n < half && LP_SUCCESS(m->shared.push(m->local[n])))
+            n++;
+          for (size_t i = n; i < m->local.count(); i++)
+            m->local[i - n] = m->local[i];
+          m->local.truncate(m->local.count() - n);
+          pthread_mutex_unlock(&m->lock);
+        }
+    }
+}
+
+/**
+ * Inner, the task of the pool running the markers.
+ */
+/* static */
+void
+GC::markTask(size_t worker, size_t begin, size_t end, void *opaque)
+{
+  GCMarkJob *job = static_cast<GCMarkJob *>(opaque);
+  UNUSED(worker);
+  for (size_t i = begin; i < end; i++)
+    job->gc->drain(job, i);
+}
+
+/**
+ * Inner, destroy the string ports not reached by the collection.
+ */
+void
+GC::sweepPorts()
+{
+  size_t n = m_base.ports;
+  for (size_t i = m_base.ports; i < m_ports.count(); i++)
+    {
+      SynNode *port = m_ports[i];
+      if (isLive(port))
+        m_ports[n++] = port;
+      else
+        OBJ_VALUE(OBJTYPE_PORT, port)->~StringPool();
+    }
+  m_ports.truncate(n);
+}
+
+/**
+ * Inner, turn the blocks not reached by the last collection in a chunk
+ * into the free runs, merging the adjacent ones. The marks of a chunk
+ * not reached by the collection at all are stale, and none is alive.
+ * @param c Pointer to the chunk.
+ */
+void
+GC::sweepChunk(GCChunk *c)
+{
+  bool reached = c->epoch == c->sweepEpoch;
+  size_t end = c->sweepLimit / GC_GRANULE;
+  size_t run = end; /* start of the dead run, end if none */
+  size_t g = nextBit(c->starts, c->sweepFrom / GC_GRANULE, end);
+
+  while (g < end)
+    {
+      size_t next = nextBit(c->starts, g + 1, end);
+      if (reached && testBit(c->marks, g))
+        {
+          if (run < g)
+            addFree(c, run * GC_GRANULE, (g - run) * GC_GRANULE);
+          run = end;
+        }
+      else if (run == end)
+        run = g;
+      else
+        clearBit(c->starts, g); /* merged into the run */
+      g = next;
+    }
+  if (run < end)
+    addFree(c, run * GC_GRANULE, (end - run) * GC_GRANULE);
+
+  c->sweepFrom = c->sweepLimit = 0;
+  m_stats.chunksSwept++;
+}
+
+/**
+ * Inner, clear the marks of a chunk when it is first reached by a
+ * collection, rather than all of them when the marking starts. The
+ * chunk is swept with the marks of the last collection first, if it
+ * was not yet.
+ * @param c Pointer to the chunk.
+ */
+void
+GC::refreshMarks(GCChunk *c)
+{
+  if (c->sweepLimit)
+    {
+      sweepChunk(c);
+      m_hasFree = true;
+    }
+  memset(c->marks, 0, GC_BITMAP_WORDS(c->size) * sizeof(unsigned long));
+  c->epoch = m_epoch;
+}
+
+/**
+ * Point out whether a object survived the last collection, for the
+ * tables keyed by the objects. Valid until the next allocation.
+ * @param p The address.
+ * @return true if it is alive, or not collected.
+ */
+bool
+GC::isLive(const void *p) const
+{
+  GCChunk *c = findChunk(p);
+  if (!c || allocatedBefore(p, m_base))
+    return true;
+  if (c->epoch != m_epoch)
+    return false;
+  return testBit(c->marks, (static_cast<const char *>(p) - GC_CHUNK_DATA(c)) / GC_GRANULE);
+}
+
+/**
+ * Inner, get the microseconds elapsed.
+ * @param start The time started.
+ * @return the result.
+ */
+static unsigned long long
+elapsed(const struct timeval &start)
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+  return (now.tv_sec - start.tv_sec) * 1000000ULL + now.tv_usec - start.tv_usec;
+}
+
+/**
+ * Inner, count a pause of the collection in the statistics.
+ * @param us The length in microseconds.
+ */
+void
+GC::recordPause(unsigned long long us)
+{
+  size_t bucket = 0;
+  while (bucket + 1 < GC_PAUSE_BUCKETS && (2ULL << bucket) <= us)
+    bucket++;
+  m_stats.pauses[bucket]++;
+  m_stats.pauseTotal += us;
+  if (us > m_stats.pauseMax)
+    m_stats.pauseMax = us;
+}
+
+/**
+ * Inner, start the marking of a collection. The objects allocated before
+ * the mark of undo log are not collected. The incremental marking in
+ * progress, if any, is abandoned. The marks of each chunk are cleared
+ * when it is first reached, see refreshMarks().
+ * @return index of the first chunk collected.
+ */
+size_t
+GC::beginMark()
+{
+  m_marking = m_purging = false;
+  m_grey.clear();
+  m_epoch++;
+  if (m_logging)
+    m_base = m_undoMark;
+  else
+    memset(&m_base, 0, sizeof(m_base));
+  return m_base.chunks ? m_base.chunks - 1 : 0;
+}
+
+/**
+ * Inner, mark the roots, and the values stored into the objects before
+ * the base, which are not traced.
+ * @param roots The roots.
+ * @param out Where to push the nodes to be scanned.
+ * @param live Where to add the bytes marked.
+ * @return status code.
+ */
+int
+GC::markRoots(NodeStack &roots, NodeStack &out, __OUT size_t *live)
+{
+  for (size_t i = 0; i < roots.count() + m_undoCount; i++)
+    {
+      size_t size;
+      SynNode *node = i < roots.count() ? roots[i] : *m_undo[i - roots.count()].slot;
+      if (!markBlock(node, &size))
+        continue;
+      *live += size;
+      if (size >= sizeof(SynNode))
+        {
+          int rc = out.push(node);
+          UPDATE_RC(rc);
+        }
+    }
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, complete a collection after the marking, the objects not marked
+ * are reclaimed, lazily by the allocations.
+ * @param live The bytes marked.
+ */
+void
+GC::endMark(size_t live)
+{
+  m_marking = m_purging = false;
+  sweepPorts();
+
+  /* the undo log started while marking, if any, must not find the free
+     runs before its mark, see beginUndo() */
+  GCMark from = m_base;
+  if (m_logging && (m_undoMark.chunks > from.chunks
+                    || (m_undoMark.chunks == from.chunks && m_undoMark.used > from.used)))
+    from = m_undoMark;
+
+  /* the runs still free are found again by the sweeping */
+  dropFree();
+  size_t first = from.chunks ? from.chunks - 1 : 0;
+  for (size_t i = first; i < m_count; i++)
+    {
+      GCChunk *c = m_chunks[i];
+      c->sweepFrom = i + 1 == from.chunks ? from.used : 0;
+      c->sweepLimit = c->used;
+      c->sweepEpoch = m_epoch;
+    }
+  m_sweepNext = first;
+  m_sweepEnd = m_count;
+  m_hasFree = true;
+
+  /* the objects marked may have been released since */
+  size_t bytes = m_base.bytes + live;
+  if (m_bytes > bytes)
+    m_stats.bytesFreed += m_bytes - bytes;
+  else
+    bytes = m_bytes;
+  m_bytes = bytes;
+  updateLimit();
+  m_trigger = bytes * 2 > m_minTrigger ? bytes * 2 : m_minTrigger;
+  m_stats.collections++;
+}
+
+/**
+ * Reclaim the objects not reachable from the roots at once. The objects
+ * allocated before the mark of undo log are not collected, and the
+ * values stored into them are the roots too. The marking is spread on
+ * the threads of pool, and the chunks are swept lazily by the
+ * allocations afterwards, so the pause is the marking only.
+ * It must be called where no other object is referenced, and not while
+ * the heap is frozen.
+ * @param roots The roots.
+ * @param pool Pointer to the pool running the markers, 0 to mark in
+ *             the calling thread.
+ * @return status code.
+ */
+int
+GC::collect(NodeStack &roots, TaskPool *pool)
+{
+  if (m_freezing)
+    {
+      return LERR_FAILED;
+    }
+
+  struct timeval start;
+  gettimeofday(&start, 0);
+  dropFree();
+  for (size_t i = beginMark(); i < m_count; i++)
+    refreshMarks(m_chunks[i]); /* before the markers run */
+
+  size_t count = pool && pool->size() > 1 ? pool->size() : 1;
+  GCMarker *markers = new (std::nothrow) GCMarker[count];
+  if (!markers)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  GCMarkJob job;
+  job.gc = this;
+  job.markers = markers;
+  job.count = count;
+  job.pending = 0;
+  job.idle = 0;
+  job.failed = 0;
+  for (size_t i = 0; i < count; i++)
+    {
+      pthread_mutex_init(&markers[i].lock, 0);
+      markers[i].live = 0;
+    }
+
+  /* the roots are dealt to the markers */
+  size_t live = 0;
+  NodeStack grey;
+  if (LP_FAILURE(markRoots(roots, grey, &live)))
+    job.failed = 1;
+  for (size_t i = 0; i < grey.count(); i++)
+    {
+      if (LP_FAILURE(markers[i % count].local.push(grey[i])))
+        job.failed = 1;
+      else
+        job.pending++;
+    }
+
+  if (count > 1)
+    pool->run(count, 1, markTask, &job);
+  else
+    drain(&job, 0);
+
+  for (size_t i = 0; i < count; i++)
+    {
+      live += markers[i].live;
+      pthread_mutex_destroy(&markers[i].lock);
+    }
+  delete [] markers;
+  if (job.failed)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+
+  if (m_collected)
+    m_collected(this, true, ~static_cast<size_t>(0), m_collectedOpaque);
+  endMark(live);
+  recordPause(elapsed(start));
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Start a incremental collection. The roots are marked at once, the
+ * rest of marking is done in slices by the allocations afterwards, each
+ * of them is limited by setSliceBudget(), and the objects not marked are
+ * reclaimed when it completes.
+ * The objects allocated while marking are kept, and the object losing a
+ * reference by store() is marked (see shade()), so all the objects
+ * reachable at this time are kept, even if they are only referenced by
+ * the caller later. Thus it must be called where no other object is
+ * referenced, but the marking may complete anywhere.
+ * @param roots The roots.
+ * @return status code.
+ */
+int
+GC::startCollect(NodeStack &roots)
+{
+  if (m_freezing)
+    {
+      return LERR_FAILED;
+    }
+
+  struct timeval start;
+  gettimeofday(&start, 0);
+  beginMark();
+
+  m_markLive = 0;
+  int rc = markRoots(roots, m_grey, &m_markLive);
+  if (LP_FAILURE(rc))
+    {
+      m_grey.clear();
+      return rc;
+    }
+  m_marking = true;
+  m_nextSlice = m_bytes + GC_SLICE_BYTES;
+  recordPause(elapsed(start));
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, mark a object losing a reference while marking, see shade().
+ * @param node Pointer to the node.
+ */
+void
+GC::shadeNode(SynNode *node)
+{
+  size_t size;
+  if (!markBlock(node, &size))
+    return;
+  m_markLive += size;
+  if (size >= sizeof(SynNode) && LP_FAILURE(m_grey.push(node)))
+    {
+      /* the marking can not be completed */
+      m_marking = m_purging = false;
+      m_grey.clear();
+    }
+}
+
+/**
+ * Inner, scan the nodes marked until none is left, then purge the tables
+ * by the callback, until both are done or the time of slice is used up.
+ * The marking goes on while purging, for the nodes found in the tables
+ * may be shaded.
+ */
+void
+GC::markSlice()
+{
+  struct timeval start;
+  gettimeofday(&start, 0);
+
+  size_t scanned = 0, before = m_markLive;
+  for (;;)
+    {
+      if (m_grey.count())
+        {
+          if (LP_FAILURE(scan(m_grey.pop(), m_grey, &m_markLive)))
+            {
+              /* the marking can not be completed */
+              m_marking = m_purging = false;
+              m_grey.clear();
+              return;
+            }
+          if (++scanned % GC_MARK_SHARE)
+            continue;
+        }
+      else
+        {
+          bool restart = !m_purging;
+          m_purging = true;
+          if (!m_collected || m_collected(this, restart, GC_PURGE_STEPS, m_collectedOpaque))
+            {
+              endMark(m_markLive);
+              break;
+            }
+        }
+      if (elapsed(start) >= m_sliceBudget)
+        break;
+    }
+
+  /* the marking must outpace the allocations, so the next slice comes
+     after half of the bytes marked by this one are allocated */
+  size_t work = (m_markLive - before) / 2;
+  m_nextSlice = m_bytes + (work < GC_SLICE_BYTES ? work : GC_SLICE_BYTES);
+  m_stats.slices++;
+  recordPause(elapsed(start));
+}
+
+} // namespace DSL
+
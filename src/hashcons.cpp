@@ -0,0 +1,286 @@
+/** @file
+ * LispDSL - Hash-consing of immutable constants.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+#define CONSTABLE_MIN_SIZE (256) /* power of 2 */
+
+ConsTable::ConsTable()
+  : m_table(0),
+    m_size(0),
+    m_count(0)
+{
+  m_stats.hits = 0;
+  m_stats.bytesSaved = 0;
+}
+
+ConsTable::~ConsTable()
+{
+  if (m_table)
+    delete [] m_table;
+}
+
+/**
+ * Inner, compare the content of node with the key.
+ * @param node Pointer to the node in table.
+ * @param type Type of the key.
+ * @param data Pointer to the value of key. For pair it is an
+ *             array of two pointers, the leaf and the next.
+ * @param len Length of the value.
+ * @return true if they are equal.
+ */
+static bool
+matchConst(SynNode *node, objType type, const void *data, size_t len)
+{
+  if (node->object.type != type)
+    return false;
+
+  switch (type)
+  {
+    case OBJTYPE_BOOLEAN:
+      return OBJ_VALUE(OBJTYPE_BOOLEAN, node) == *static_cast<const bool *>(data);
+    case OBJTYPE_NUMBER:
+      return memcmp(&OBJ_VALUE(OBJTYPE_NUMBER, node), data, sizeof(double)) == 0;
+    case OBJTYPE_CHARACTER:
+      return OBJ_VALUE(OBJTYPE_CHARACTER, node) == *static_cast<const char *>(data);
+    case OBJTYPE_STRING:
+    case OBJTYPE_SYMBOL:
+      {
+        ImmString *v = (type == OBJTYPE_STRING)
+            ? OBJ_VALUE(OBJTYPE_STRING, node)
+            : OBJ_VALUE(OBJTYPE_SYMBOL, node);
+        return v->length() == len && memcmp(v->buffer(), data, len) == 0;
+      }
+    case OBJTYPE_PAIR:
+      {
+        SynNode * const *p = static_cast<SynNode * const *>(data);
+        return OBJ_LEAF(node) == p[0] && OBJ_NEXT(node) == p[1];
+      }
+    default:
+      return false;
+  }
+}
+
+/**
+ * Inner, get the memory taken by a constant.
+ * @param node Pointer to the node.
+ * @return the value in bytes.
+ */
+static size_t
+sizeofConst(SynNode *node)
+{
+  size_t size = sizeof(SynNode);
+  if (node->object.type == OBJTYPE_STRING || node->object.type == OBJTYPE_SYMBOL)
+    {
+      ImmString *v = (node->object.type == OBJTYPE_STRING)
+          ? OBJ_VALUE(OBJTYPE_STRING, node)
+          : OBJ_VALUE(OBJTYPE_SYMBOL, node);
+      size += sizeof(ImmString) + v->length();
+    }
+  return size;
+}
+
+/**
+ * Lookup a constant equal to the key.
+ * @param type Type of the key.
+ * @param data Pointer to the value of key. For pair it is an
+ *             array of two pointers, the leaf and the next.
+ * @param len Length of the value.
+ * @param hash Where to store the hash of key, for insert().
+ * @return 0 if not found.
+ * @return pointer to the shared node.
+ */
+SynNode *
+ConsTable::lookup(objType type, const void *data, size_t len, __OUT size_t *hash)
+{
+  size_t h = static_cast<size_t>(hashBuffer(data, len)) ^ (static_cast<size_t>(type) * 0x9e3779b9U);
+  *hash = h;
+
+  if (!m_count)
+    return 0;
+
+  size_t pos = h & (m_size - 1);
+  while (m_table[pos].node)
+    {
+      if (m_table[pos].hash == h && matchConst(m_table[pos].node, type, data, len))
+        {
+          SynNode *node = m_table[pos].node;
+          m_stats.hits++;
+          m_stats.bytesSaved += sizeofConst(node);
+          return node;
+        }
+      pos = (pos + 1) & (m_size - 1);
+    }
+  return 0;
+}
+
+/**
+ * Inner, resize the table and insert the entries again.
+ * @param newsize The new number of slots, power of 2.
+ * @return status code.
+ */
+int
+ConsTable::rehash(size_t newsize)
+{
+  ConsEntry *old = m_table;
+  size_t oldsize = m_size;
+
+  m_table = new (std::nothrow) ConsEntry[newsize];
+  if (!m_table)
+    {
+      m_table = old;
+      return LERR_ALLOC_MEMORY;
+    }
+  for (size_t i = 0; i < newsize; i++)
+    m_table[i].node = 0;
+  m_size = newsize;
+
+  for (size_t i = 0; i < oldsize; i++)
+    {
+      if (old[i].node)
+        {
+          size_t pos = old[i].hash & (m_size - 1);
+          while (m_table[pos].node)
+            pos = (pos + 1) & (m_size - 1);
+          m_table[pos] = old[i];
+        }
+    }
+  if (old)
+    delete [] old;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Insert a new constant, which was not found by lookup().
+ * @param node Pointer to the node, must not be mutated afterwards.
+ * @param hash The hash got from lookup().
+ * @return status code.
+ */
+int
+ConsTable::insert(SynNode *node, size_t hash)
+{
+  /* keep the load factor below 1/2 */
+  if ((m_count + 1) * 2 > m_size)
+    {
+      int rc = rehash(m_size ? m_size * 2 : CONSTABLE_MIN_SIZE);
+      UPDATE_RC(rc);
+    }
+
+  size_t pos = hash & (m_size - 1);
+  while (m_table[pos].node)
+    pos = (pos + 1) & (m_size - 1);
+
+  m_table[pos].node = node;
+  m_table[pos].hash = hash;
+  m_count++;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Forget the constants rejected by the filter, the statistics are kept.
+ * All the constants are forgotten if out of memory.
+ * @param pfn Pointer to the filter, called with the node.
+ * @param opaque The pointer passed to the filter.
+ * @return status code.
+ */
+int
+ConsTable::retain(pfnRetainKey pfn, void *opaque)
+{
+  if (!m_count)
+    return LINF_SUCCEEDED;
+
+  for (size_t i = 0; i < m_size; i++)
+    {
+      if (m_table[i].node && !pfn(m_table[i].node, opaque))
+        {
+          m_table[i].node = 0;
+          m_count--;
+        }
+    }
+  /* insert the remaining again to repair the probing sequences */
+  int rc = rehash(m_size);
+  if (LP_FAILURE(rc))
+    clear();
+  return rc;
+}
+
+/**
+ * Inner, remove the constant at a slot, see PtrMap::removeAt().
+ * @param pos Index of the slot.
+ */
+void
+ConsTable::removeAt(size_t pos)
+{
+  size_t hole = pos;
+  for (size_t i = (pos + 1) & (m_size - 1); m_table[i].node; i = (i + 1) & (m_size - 1))
+    {
+      size_t home = m_table[i].hash & (m_size - 1);
+      if (((i - home) & (m_size - 1)) >= ((i - hole) & (m_size - 1)))
+        {
+          m_table[hole] = m_table[i];
+          hole = i;
+        }
+    }
+  m_table[hole].node = 0;
+  m_count--;
+}
+
+/**
+ * Forget the constants rejected by the filter in steps, see
+ * PtrMap::retainSome().
+ */
+bool
+ConsTable::retainSome(pfnRetainKey pfn, void *opaque, RetainCursor *at, size_t steps)
+{
+  if (at->size != m_size)
+    {
+      at->slot = 0;
+      at->size = m_size;
+    }
+  for (; steps && at->slot < m_size; steps--)
+    {
+      if (m_table[at->slot].node && !pfn(m_table[at->slot].node, opaque))
+        removeAt(at->slot);
+      else
+        at->slot++;
+    }
+  return at->slot >= m_size;
+}
+
+/**
+ * Forget all the constants, the statistics are kept.
+ */
+void
+ConsTable::clear()
+{
+  for (size_t i = 0; i < m_size; i++)
+    m_table[i].node = 0;
+  m_count = 0;
+}
+
+} // namespace DSL
@@ -0,0 +1,239 @@
+/** @file
+ * LispDSL - Images of the environments for fast startup.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The image is a header followed by the list
+ *   (program global-environment environment-1 ... environment-top)
+ * in the format of Serializer, so that the nodes shared between them
+ * (such as the bodies of closures in the program) are written once and
+ * the pointers are fixed up as they are decoded.
+ */
+#define IMAGE_MAGIC "LSPI"
+#define IMAGE_VERSION (1)
+#define IMAGE_ENDIAN (0x01020304)
+#define IMAGE_PARSED (0x1)
+
+struct ImageHeader
+{
+  char               magic[4];
+  unsigned int       version;
+  unsigned int       endian;
+  unsigned int       top;       /* highest index of the environments */
+  unsigned int       flags;
+  unsigned int       reserved;
+  unsigned long long hash;      /* hash of the serialized list */
+  unsigned long long length;    /* length of the serialized list */
+};
+
+/**
+ * Save the global variables, the closures and the program to a image
+ * file, typically after evaluating the prelude, so that another
+ * instance (maybe of another process) starts from loadImage() without
+ * parsing and evaluating it again. The host functions and channels
+ * registered are not saved, neither the values of port or future.
+ * @param filename Path name of the image file.
+ * @return status code.
+ */
+int
+Lisp::saveImage(const char *filename)
+{
+  if (m_parent || suspended())
+    {
+      return LERR_FAILED;
+    }
+  waitFutures();
+
+  int rc = LINF_SUCCEEDED;
+  EnvSP top = m_envstack.ready() ? m_envstack.top() : 0;
+  SynNode *list = 0;
+
+  /* the environments above the global one are kept by the closures */
+  for (EnvSP i = top; i > 0 && LP_SUCCESS(rc); i--)
+    rc = m_gc.createPair(m_envstack.node(i), list, &list);
+  if (LP_SUCCESS(rc))
+    rc = m_gc.createPair(m_envstack.ready() ? m_envstack.node(0) : 0, list, &list);
+  if (LP_SUCCESS(rc))
+    rc = m_gc.createPair(m_parsed ? m_ast : 0, list, &list);
+  UPDATE_RC(rc);
+
+  StringPool body;
+  rc = Serializer::encode(list, &m_srcmap, body);
+  UPDATE_RC(rc);
+
+  ImageHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+  header.version = IMAGE_VERSION;
+  header.endian = IMAGE_ENDIAN;
+  header.top = static_cast<unsigned int>(top);
+  header.flags = m_parsed ? IMAGE_PARSED : 0;
+  header.hash = hashBuffer(body.buffer(), body.length());
+  header.length = body.length();
+
+  IStream *stream = Stream::CreateStream();
+  if (!stream)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  rc = stream->Open(filename, "wb");
+  if (LP_SUCCESS(rc))
+    {
+      if (stream->Write(&header, sizeof(header), 1) != 1
+          || stream->Write(body.buffer(), 1, body.length()) != body.length())
+        {
+          rc = LERR_FAILED;
+        }
+      stream->Close();
+    }
+  delete stream;
+  return rc;
+}
+
+/**
+ * Inner, rebuild the list of image from the file mapped.
+ * @param gc GC object reference.
+ * @param srcmap Where to record the positions of nodes in source.
+ * @param base Pointer to the content of file.
+ * @param size Size of the file.
+ * @param header Where to store the header.
+ * @param out Where to store the list.
+ * @return LERR_NOT_MATCHED if it is not a image of this version.
+ * @return status code.
+ */
+static int
+decodeImage(GC &gc, SourceMap *srcmap, const char *base, size_t size,
+            __OUT ImageHeader *header, __OUT SynNode **out)
+{
+  if (size < sizeof(*header))
+    {
+      return LERR_NOT_MATCHED;
+    }
+  memcpy(header, base, sizeof(*header));
+
+  if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0
+      || header->version != IMAGE_VERSION
+      || header->endian != IMAGE_ENDIAN
+      || header->top >= _MAX_STACK_DEEPTH
+      || header->length != size - sizeof(*header))
+    {
+      return LERR_NOT_MATCHED;
+    }
+
+  const char *body = base + sizeof(*header);
+  if (hashBuffer(body, static_cast<size_t>(header->length)) != header->hash)
+    {
+      return LERR_FAILED;
+    }
+  return Serializer::decode(gc, body, static_cast<size_t>(header->length), srcmap, out);
+}
+
+/**
+ * Restore the state saved by saveImage(), replacing the global variables
+ * and the program. The file is mapped rather than read, and the nodes
+ * are rebuilt from it in one pass. The host functions and channels
+ * should be registered again.
+ * Not allowed after snapshot(), take the snapshot after it instead.
+ * @param filename Path name of the image file.
+ * @return LERR_NOT_MATCHED if it is not a image of this version.
+ * @return status code.
+ */
+int
+Lisp::loadImage(const char *filename)
+{
+  if (m_parent || m_snapshot || suspended())
+    {
+      return LERR_FAILED;
+    }
+  waitFutures();
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    {
+      return LERR_FAILED;
+    }
+  struct stat st;
+  void *base = MAP_FAILED;
+  if (!fstat(fd, &st) && st.st_size > 0)
+    {
+      base = mmap(0, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+  close(fd);
+  if (MAP_FAILED == base)
+    {
+      return LERR_FAILED;
+    }
+
+  ImageHeader header;
+  SynNode *list;
+  int rc = decodeImage(m_gc, &m_srcmap, static_cast<const char *>(base),
+                       static_cast<size_t>(st.st_size), &header, &list);
+  munmap(base, static_cast<size_t>(st.st_size));
+  UPDATE_RC(rc);
+
+  SynNode **frames = new (std::nothrow) SynNode*[header.top ? header.top : 1];
+  if (!frames)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+
+  /* (program global-environment environment-1 ... environment-top) */
+  SynNode *roots[2];
+  SynNode *each = list;
+  for (size_t i = 0; i < header.top + 2 && LP_SUCCESS(rc); i++)
+    {
+      if (!each || OBJTYPE_PAIR != each->object.type)
+        {
+          rc = LERR_FAILED;
+          break;
+        }
+      if (i < 2)
+        roots[i] = OBJ_LEAF(each);
+      else
+        frames[i - 2] = OBJ_LEAF(each);
+      each = OBJ_NEXT(each);
+    }
+
+  if (LP_SUCCESS(rc) && !each)
+    {
+      m_envstack.restore(roots[1], frames, static_cast<EnvSP>(header.top));
+      m_ast = roots[0];
+      m_parsed = (header.flags & IMAGE_PARSED) != 0;
+    }
+  else
+    rc = LERR_FAILED;
+  delete [] frames;
+  return rc;
+}
+
+} // namespace DSL
@@ -1,547 +1,1135 @@
-/** @file
- * LispDSL - main logic
- */
-
-/*
- *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
- *  please contact with <diyer175@hotmail.com> if you have any problems.
- *
- *  This project is free software; you can redistribute it and/or
- *  modify it under the terms of the GNU Lesser General Public License(GPL)
- *  as published by the Free Software Foundation; either version 2.1
- *  of the License, or (at your option) any later version.
- *
- *  This project is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
- *  Lesser General Public License for more details.
- */
-
-/*******************************************************************************
-*   Header Files                                                               *
-*******************************************************************************/
-#include "lispdsl.h"
-
-namespace DSL {
-
-#define DEBUG_LEXER (1)
-#define DEBUG_PARSER (1)
-
-////////////////////////////////////////////////////////////////////////////////
-
-Token Lisp::tokens[] =
-{
-    {"set!", &Lisp::symbolSet},
-    {"set-car!", &Lisp::symbolSetCar},
-    {"set-cdr!", &Lisp::symbolSetCdr},
-    {"define", &Lisp::symbolDefine},
-    {"lambda", &Lisp::symbolLambda},
-    {"if", &Lisp::symbolIf},
-    {"begin", &Lisp::symbolBegin},
-    {"cond", &Lisp::symbolCond},
-    {"cons", &Lisp::symbolCons},
-    {"car", &Lisp::symbolCar},
-    {"cdr", &Lisp::symbolCdr},
-    {"quote", &Lisp::symbolQuote},
-    {"display", &Lisp::symbolDisplay},
-    {"print", &Lisp::symbolPrint},
-    {"eval", &Lisp::symbolEval},
-    {"append", &Lisp::symbolAppend},
-    {"boolean?", &Lisp::symbolBooleanP},
-    {"number?", &Lisp::symbolNumberP},
-    {"char?", &Lisp::symbolCharP},
-    {"string?", &Lisp::symbolStringP},
-    {"+", &Lisp::symbolAdd},
-    {"-", &Lisp::symbolSub},
-    {"*", &Lisp::symbolMul},
-    {"/", &Lisp::symbolDiv},
-    {"=", &Lisp::symbolEqual},
-    {">", &Lisp::symbolGreater},
-    {"<", &Lisp::symbolLess},
-    {">=", &Lisp::symbolEGreater},
-    {"<=", &Lisp::symbolELess},
-    {0, 0}
-};
-
-Lisp::Lisp()
-  : m_stream(0),
-    m_parser(&m_gc),
-    m_envstack(&m_gc),
-    m_parsed(false),
-    m_ast(0),
-    m_printAtom(0)
-{
-}
-
-/**
- * Report a error.
- * @param line The number of source line.
- * @param pos Position of source line.
- * @return status code.
- */
-/* static */
-int
-Lisp::throwError(file_off line, file_off pos, const char *msg, ...)
-{
-  va_list args;
-  va_start (args, msg);
-
-  char buff[_MAX_MSG_BUFFER];
-  vsnprintf(buff, sizeof(buff), msg, args);
-  va_end(args);
-
-  LOG(ERROR) << "error: line:" << line << ":" << pos
-      << " " << buff << "\n";
-  return LERR_THROW_ERROR;
-}
-
-/**
- * Parser the lisp code from stream.
- * @param stream Pointer to the IStream interface.
- * @return status code.
- */
-int
-Lisp::parser(IStream *stream)
-{
-  int rc;
-  m_parsed = false;
-
-  /*
-   * parser the lexicons
-   */
-  rc = m_lexer.lex(stream);
-  if (LP_SUCCESS(rc))
-    {
-#if DEBUG_LEXER
-      m_lexer.dumplist();
-#endif
-      /*
-       * generate the AST
-       */
-      rc = m_parser.parse(m_lexer.getListRoot(), m_lexer.getListTail());
-      if (LP_SUCCESS(rc))
-        {
-#if DEBUG_PARSER
-          m_parser.dumpast();
-#endif
-          m_stream = stream;
-          m_ast = m_parser.getSynRoot();
-          m_parsed = true;
-
-          return rc;
-        }
-    }
-  return rc;
-}
-
-
-/**
- * Inner, evaluating the variable.
- * @param leaf Pointer to the source node.
- * @param envsp Index of local environment stack.
- * @param rc Reference to the status code.
- */
-SynNode*
-Lisp::evalVariable(SynNode *leaf, EnvSP envsp, __OUT int &rc)
-{
-  SynNode *var;
-  rc = m_envstack.lookupVariable(envsp, leaf, &var);
-  if (LP_FAILURE(rc))
-    {
-      rc = throwError(leaf->line, 0, "variable was not found.");
-      return 0;
-    }
-  return var;
-}
-
-/**
- * Inner, evaluating the calling.
- * @param leaf Pointer to the source node.
- * @param envsp Index of local environment stack.
- * @param rc Reference to the status code.
- * @return pointer to the node that stores the result.
- */
-SynNode*
-Lisp::evalCall(SynNode *leaf, EnvSP envsp, __OUT int &rc)
-{
-  Token *tk;
-  bool matched = false;
-  SynNode *sym = OBJ_LEAF(leaf);
-
-  /*
-   * Match the symbol name
-   */
-  if (OBJTYPE_SYMBOL == sym->object.type)
-    {
-      int cmp;
-      for (tk = tokens; tk->symbol; tk++)
-        {
-          cmp = OBJ_VALUE(OBJTYPE_SYMBOL, sym)->compare(tk->symbol);
-          if (cmp == 0)
-            {
-              matched = true;
-              break;
-            }
-        }
-    }
-
-  /*
-   * Call the primitive function if matched.
-   */
-  if (matched)
-    {
-      /* call the internal function here. */
-      SynNode * val = (this->*(tk->eval))(leaf, envsp, rc);
-      if (LP_SUCCESS(rc))
-        {
-          return val;
-        }
-      return 0; // failed
-    }
-
-  SynNode *result;
-
-  /*
-   * the node is not a primary function,
-   * try to evaluate it as a procedure or lambda.
-   */
-  if (OBJTYPE_SYMBOL == OBJ_LEAF(leaf)->object.type)
-    {
-      /* not a lambda */
-      SynNode *value;
-      rc = m_envstack.lookupVariable(envsp, OBJ_LEAF(leaf), &value);
-      if (LP_FAILURE(rc))
-        {
-          rc = throwError(leaf->line, 0, "target function was not found");
-          return 0;
-        }
-      else
-        {
-          if (OBJTYPE_FUNC != value->object.type)
-            {
-              rc = throwError(leaf->line, 0, "invalid calling, target is not a function.");
-              return 0;
-            }
-
-          SynNode *args = evalList(value->object.u.OBJTYPE_FUNC.params, OBJ_NEXT(leaf), envsp, rc);
-          if (LP_SUCCESS(rc))
-            {
-              /*
-               * Call the procedure.
-               */
-              result = evalProcedure(
-                  value->object.u.OBJTYPE_FUNC.body,
-                  value->object.u.OBJTYPE_FUNC.params,
-                  args,
-                  value->object.u.OBJTYPE_FUNC.envsp,
-                  rc);
-              //!todo collection
-              if (LP_SUCCESS(rc))
-                {
-                  return result;
-                }
-            }
-        }
-    }
-  else
-    {
-      /* is lambda */
-      if (OBJTYPE_PAIR != OBJ_LEAF(leaf)->object.type)
-        {
-          rc = throwError(leaf->line, 0, "expected a function.");
-          return 0;
-        }
-      SynNode *lambda = eval(OBJ_LEAF(leaf), envsp, rc);
-      if (LP_SUCCESS(rc))
-        {
-          if (OBJTYPE_FUNC != lambda->object.type)
-            {
-              rc = throwError(leaf->line, 0, "expected a function.");
-              return 0;
-            }
-          SynNode *args = evalList(lambda->object.u.OBJTYPE_FUNC.params, OBJ_NEXT(leaf), envsp, rc);
-          if (LP_SUCCESS(rc))
-            {
-              /*
-               * Call the procedure.
-               */
-              result = evalProcedure(
-                  lambda->object.u.OBJTYPE_FUNC.body,
-                  lambda->object.u.OBJTYPE_FUNC.params,
-                  args,
-                  lambda->object.u.OBJTYPE_FUNC.envsp,
-                  rc);
-              //!todo colleaction
-              if (LP_SUCCESS(rc))
-                {
-                  return result;
-                }
-            }
-        }
-  }
-  return 0; // failed
-}
-
-
-/**
- * Inner,Working for evalCall(), evaluating the list.
- * @param var Pointer to the source variable.
- * @param vals Pointer to the values of vars.
- * @param envsp Index of local environment stack.
- * @param rc Reference to the status code.
- * @return pointer to the node that stores the result.
- *          (also a list).
- */
-SynNode*
-Lisp::evalList(SynNode *vars, SynNode *vals, EnvSP envsp, __OUT int &rc)
-{
-  SynNode *old_vars = vars;
-  if ((vars == NULL && vals != NULL) ||
-      (vars != NULL && vals == NULL))
-    {
-      rc = throwError(vars->line, 0, "invalid number of actual parameters of target function.");
-      return 0;
-    }
-
-  if (!vars)
-    {
-      //!fixme
-      LP_ASSERT(0);
-      return 0;
-    }
-
-  SynNode *res;
-  SynNode *first;
-  res = eval(OBJ_LEAF(vals), envsp, rc);
-  if (LP_FAILURE(rc))
-    {
-      return 0;
-    }
-  rc = gc().createPair(res, 0, 0, &first);
-  if (LP_FAILURE(rc))
-    {
-      return 0;
-    }
-
-  SynNode *index = first;
-  vars = OBJ_NEXT(vars);
-  vals = OBJ_NEXT(vals);
-  while (vars)
-    {
-      SynNode *each;
-      res = eval(OBJ_LEAF(vals), envsp, rc);
-      if (LP_SUCCESS(rc))
-        {
-          rc = gc().createPair(res, 0, 0, &each);
-          if (LP_SUCCESS(rc))
-            {
-              OBJ_NEXT(index) = each;
-              index = each;
-              vars = OBJ_NEXT(vars);
-              vals = OBJ_NEXT(vals);
-            }
-        }
-      else
-        return 0;
-    }
-  if (vals) {
-    rc = throwError(old_vars->line, 0, "invalid number of actual parameters of target function.");
-    return 0;
-  }
-  return first;
-}
-
-/**
- * Inner, evaluate the procedure.
- * @param bdoy Pointer to the root node of procedure body.
- * @param var Pointer to the source variable.
- * @param vals Pointer to the values of vars.
- * @param envsp Index of local environment stack.
- * @param rc Reference of status code.
- * @return pointer to the node that stores the result.
- */
-SynNode*
-Lisp::evalProcedure(SynNode *body, SynNode *vars, SynNode *vals, EnvSP envsp, __OUT int &rc)
-{
-  /*
-   * create a new local environment for the procedure.
-   */
-  EnvSP newsp;
-  rc = m_envstack.push(vars, vals, envsp, &newsp);
-  if (LP_SUCCESS(rc))
-    {
-      SynNode *res = dispatchEvaling(body, newsp, rc);
-      if (LP_SUCCESS(rc))
-        {
-          //!todo garbage collection.
-          m_envstack.pop();
-          return res;
-        }
-    }
-  return 0;
-}
-
-
-/**
- * Inner, Interpret the leaves in list.
- * @param node Pointer to the target list
- * @param envsp Index of local environment stack.
- * @return status code.
- */
-SynNode *
-Lisp::eval(SynNode *node, EnvSP envsp, __OUT int &rc)
-{
-  if (targetEval(node))
-    {
-      return node;
-    }
-  else if (targetSymbol(node))
-    {
-      return evalVariable(node, envsp, rc);
-    }
-  else if (targetCall(node))
-    {
-      return evalCall(node, envsp, rc);
-    }
-  rc = throwError(node->line, 0, "invalid syntax.");
-  return 0;
-}
-
-/**
- * Inner, dispatch all the operation in the list.
- * @param root Pointer to the root node of SynTree.
- * @param envsp Index of local environment stack.
- * @return Pointer to the node that stores the result.
- */
-SynNode *
-Lisp::dispatchEvaling(SynNode *root, EnvSP envsp, int &rc)
-{
-  SynNode *result = 0;
-  SynNode *node = root;
-  /* execute */
-  while (node)
-    {
-      if (UNLIKELY(node->object.type != OBJTYPE_PAIR))
-        {
-          /* this never happens */
-          LP_ASSERT(0);
-          rc = throwError(node->line, 0, "invalid syntax.");
-          return 0;
-        }
-
-      result = eval(OBJ_LEAF(node), envsp, rc);
-      if (LP_SUCCESS(rc))
-        {
-          node = OBJ_NEXT(node);
-        }
-      else
-        return result; // failed.
-    }
-
-  //todo: gc
-
-  return result;
-}
-
-/**
- * Inner, resolve whether the target is a symbol.
- * @param leaf Pointer to the node.
- * @return true if yes.
- */
-bool
-Lisp::targetSymbol(SynNode *leaf)
-{
-  return (leaf->object.type == OBJTYPE_SYMBOL);
-}
-
-/**
- * Inner, resolve whether the target is a calling.
- * @param leaf Pointer to the node.
- * @return true if yes.
- */
-bool
-Lisp::targetCall(SynNode *leaf)
-{
-  if (OBJTYPE_PAIR == leaf->object.type)
-    {
-      if (OBJTYPE_SYMBOL == OBJ_LEAF(leaf)->object.type)
-        {
-          return true;
-        }
-    }
-  return false;
-}
-
-/**
- * Inner, resolve whether the target is pair.
- * @param leaf Pointer to the node.
- * @return true if yes.
- */
-bool
-Lisp::targetPair(SynNode *leaf)
-{
-  return (leaf->object.type == OBJTYPE_PAIR);
-}
-
-/**
- * Inner, resolve whether the target is a eval expression.
- * @param leaf Pointer to the node.
- * @return true if yes.
- */
-bool
-Lisp::targetEval(SynNode *leaf)
-{
-  switch (leaf->object.type)
-  {
-    case OBJTYPE_BOOLEAN:
-    case OBJTYPE_NUMBER:
-    case OBJTYPE_STRING:
-    case OBJTYPE_CHARACTER:
-      return true;
-    default:
-      return false;
-  }
-}
-
-/**
- * Evaluate the script
- * @param out Optional, Where to store the result.
- * @reutrn status code.
- */
-int
-Lisp::run(__OUT SynNode **out)
-{
-  if (!m_parsed)
-    {
-      return LERR_FAILED;
-    }
-
-  int rc;
-  SynNode *result = 0;
-
-  rc = m_envstack.newenv();
-  if (LP_SUCCESS(rc))
-    {
-      result = dispatchEvaling(m_ast, 0/*envsp*/, rc);
-      if (LP_SUCCESS(rc))
-        {
-          if (out)
-            {
-              *out = result;
-            }
-        }
-    }
-  return rc;
-}
-
-/**
- * Set the callback for atom data output.
- * @param pfn Pointer to the callback function,
- */
-void
-Lisp::setPrintAtomCallback(pfnPrintAtom pfn)
-{
-  m_printAtom = pfn;
-}
-
-} // namespace DSL
+/** @file
+ * LispDSL - main logic
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <stdio.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+#define DEBUG_PARSER (1)
+
+////////////////////////////////////////////////////////////////////////////////
+
+const Token Lisp::tokens[] =
+{
+    {"set!", &Lisp::symbolSet},
+    {"set-car!", &Lisp::symbolSetCar},
+    {"set-cdr!", &Lisp::symbolSetCdr},
+    {"define", &Lisp::symbolDefine},
+    {"lambda", &Lisp::symbolLambda},
+    {"if", &Lisp::symbolIf},
+    {"begin", &Lisp::symbolBegin},
+    {"cond", &Lisp::symbolCond},
+    {"cons", &Lisp::symbolCons},
+    {"car", &Lisp::symbolCar},
+    {"cdr", &Lisp::symbolCdr},
+    {"quote", &Lisp::symbolQuote},
+    {"display", &Lisp::symbolDisplay},
+    {"print", &Lisp::symbolPrint},
+    {"eval", &Lisp::symbolEval},
+    {"append", &Lisp::symbolAppend},
+    {"boolean?", &Lisp::symbolBooleanP},
+    {"number?", &Lisp::symbolNumberP},
+    {"char?", &Lisp::symbolCharP},
+    {"string?", &Lisp::symbolStringP},
+    {"string-append", &Lisp::symbolStringAppend},
+    {"number->string", &Lisp::symbolNumberToString},
+    {"open-output-string", &Lisp::symbolOpenOutputString},
+    {"get-output-string", &Lisp::symbolGetOutputString},
+    {"pmap", &Lisp::symbolPMap},
+    {"pfor-each", &Lisp::symbolPForEach},
+    {"future", &Lisp::symbolFuture},
+    {"touch", &Lisp::symbolTouch},
+    {"channel-send", &Lisp::symbolChannelSend},
+    {"channel-recv", &Lisp::symbolChannelRecv},
+    {"channel-close", &Lisp::symbolChannelClose},
+    {"+", &Lisp::symbolAdd},
+    {"-", &Lisp::symbolSub},
+    {"*", &Lisp::symbolMul},
+    {"/", &Lisp::symbolDiv},
+    {"=", &Lisp::symbolEqual},
+    {">", &Lisp::symbolGreater},
+    {"<", &Lisp::symbolLess},
+    {">=", &Lisp::symbolEGreater},
+    {"<=", &Lisp::symbolELess},
+    {0, 0}
+};
+
+Lisp::Lisp()
+  : m_stream(0),
+    m_parser(&m_gc, &m_srcmap),
+    m_envstack(&m_gc),
+    m_parsed(false),
+    m_ast(0),
+    m_printAtom(0),
+    m_writeOutput(0),
+    m_outputOpaque(0),
+    m_outputThreshold(_DEFAULT_OUTPUT_THRESHOLD),
+    m_diagnostics(DIAG_NONE),
+    m_parent(0),
+    m_pool(0),
+    m_workers(0),
+    m_parallelism(0),
+    m_parallelismSet(false),
+    m_poolErrors(0),
+    m_futures(0),
+    m_futureCount(0),
+    m_futureSize(0),
+    m_futureSerial(0),
+    m_natives(0),
+    m_nativeCount(0),
+    m_nativeSize(0),
+    m_channels(0),
+    m_channelCount(0),
+    m_channelSize(0),
+    m_snapshot(false),
+    m_markParsed(false),
+    m_markAst(0),
+    m_fuel(LISP_FUEL_UNLIMITED),
+    m_deadline(0),
+    m_deadlineAt(0),
+    m_ticks(0),
+    m_refusedReported(0),
+    m_metered(false),
+    m_preemptive(false),
+    m_fiber(0)
+{
+  m_errors.pfn = 0;
+  m_errors.opaque = 0;
+  m_program = 0;
+  m_forgetPositions.slot = m_forgetConsts.slot = 0;
+  m_forgetPositions.size = m_forgetConsts.size = ~static_cast<size_t>(0);
+  m_lexer.setErrorSink(&m_errors);
+  m_parser.setErrorSink(&m_errors);
+  m_gc.setCollectedCallback(forgetCollected, this);
+}
+
+Lisp::~Lisp()
+{
+  dropFiber();
+  stopPool();
+  if (m_futures)
+    delete [] m_futures;
+  flushOutput();
+  for (size_t i = 0; i < m_nativeCount; i++)
+    ImmString::release(m_natives[i].name);
+  if (m_natives)
+    delete [] m_natives;
+  for (size_t i = 0; i < m_channelCount; i++)
+    ImmString::release(m_channels[i].name);
+  if (m_channels)
+    delete [] m_channels;
+}
+
+/**
+ * Inner, report a error with the argument list.
+ * @param sink Where to report, 0 for the log.
+ * @param line The number of source line, 0 if unknown.
+ * @param pos Position of source line, 0 if unknown.
+ * @param msg Format of the message.
+ * @param args Arguments of the format.
+ * @return status code.
+ */
+/* static */
+int
+Lisp::throwErrorV(const ErrorSink *sink, file_off line, file_off pos, const char *msg, va_list args)
+{
+  char buff[_MAX_MSG_BUFFER];
+  vsnprintf(buff, sizeof(buff), msg, args);
+
+  if (sink && sink->pfn)
+    sink->pfn(line, pos, buff, sink->opaque);
+  else
+    LOG(ERROR) << "error: line:" << line << ":" << pos
+        << " " << buff << "\n";
+  return LERR_THROW_ERROR;
+}
+
+/**
+ * Report a error to the log.
+ * @param line The number of source line.
+ * @param pos Position of source line.
+ * @return status code.
+ */
+/* static */
+int
+Lisp::throwError(file_off line, file_off pos, const char *msg, ...)
+{
+  va_list args;
+  va_start (args, msg);
+  int rc = throwErrorV(0, line, pos, msg, args);
+  va_end(args);
+  return rc;
+}
+
+/**
+ * Report a error to the sink.
+ * @param sink Where to report, 0 for the log.
+ * @param line The number of source line.
+ * @param pos Position of source line.
+ * @return status code.
+ */
+/* static */
+int
+Lisp::throwError(const ErrorSink *sink, file_off line, file_off pos, const char *msg, ...)
+{
+  va_list args;
+  va_start (args, msg);
+  int rc = throwErrorV(sink, line, pos, msg, args);
+  va_end(args);
+  return rc;
+}
+
+/**
+ * Set where to report the errors of this instance, including the ones
+ * of lexing and parsing. By default they are written to the log, which
+ * is shared by all the instances.
+ * @param pfn Pointer to the receiver, 0 for the log.
+ * @param opaque The pointer passed to the receiver.
+ */
+void
+Lisp::setErrorSink(pfnReportError pfn, void *opaque)
+{
+  m_errors.pfn = pfn;
+  m_errors.opaque = opaque;
+}
+
+/**
+ * Inner, find the position of a syntax node in source, which may be
+ * parsed by this instance, the program attached or the owner of pool.
+ * @param node Pointer to the node.
+ * @param line Where to store the number of line.
+ * @param column Where to store the column.
+ * @return true if found.
+ */
+bool
+Lisp::locate(SynNode *node, __OUT file_off *line, __OUT file_off *column) const
+{
+  if (m_srcmap.lookup(node, line, column))
+    return true;
+  if (m_program && m_program->srcmap().lookup(node, line, column))
+    return true;
+  return m_parent && m_parent->locate(node, line, column);
+}
+
+/**
+ * Report a error at the position of a syntax node in source.
+ * The position is unknown (0) if the node was created at runtime.
+ * @param node Pointer to the node.
+ * @return status code.
+ */
+int
+Lisp::throwErrorAt(SynNode *node, const char *msg, ...)
+{
+  file_off line = 0, pos = 0;
+  locate(node, &line, &pos);
+
+  flushOutput(); /* keep the order with the output */
+
+  va_list args;
+  va_start (args, msg);
+  int rc = throwErrorV(&m_errors, line, pos, msg, args);
+  va_end(args);
+  return rc;
+}
+
+/**
+ * Parser the lisp code from stream.
+ * @param stream Pointer to the IStream interface.
+ * @return status code.
+ */
+int
+Lisp::parser(IStream *stream)
+{
+  int rc;
+  m_parsed = false;
+
+  /*
+   * attach the lexer, the lexicons are pulled on demand
+   * while generating the AST.
+   */
+  rc = m_lexer.open(stream);
+  if (LP_SUCCESS(rc))
+    {
+      rc = m_parser.parse(&m_lexer);
+      if (LP_SUCCESS(rc))
+        {
+#if DEBUG_PARSER
+          if (m_diagnostics & DIAG_PARSER)
+            m_parser.dumpast();
+#endif
+          m_stream = stream;
+          m_ast = m_parser.getSynRoot();
+          m_parsed = true;
+
+          return rc;
+        }
+    }
+  return rc;
+}
+
+
+/**
+ * Inner, evaluating the variable.
+ * @param leaf Pointer to the source node.
+ * @param envsp Index of local environment stack.
+ * @param rc Reference to the status code.
+ */
+SynNode*
+Lisp::evalVariable(SynNode *leaf, EnvSP envsp, __OUT int &rc)
+{
+  SynNode *var;
+  rc = m_envstack.lookupVariable(envsp, leaf, &var);
+  if (LP_FAILURE(rc))
+    {
+      rc = throwErrorAt(leaf, "variable was not found.");
+      return 0;
+    }
+  return var;
+}
+
+/**
+ * Inner, evaluating the calling.
+ * @param leaf Pointer to the source node.
+ * @param envsp Index of local environment stack.
+ * @param rc Reference to the status code.
+ * @return pointer to the node that stores the result.
+ */
+SynNode*
+Lisp::evalCall(SynNode *leaf, EnvSP envsp, __OUT int &rc)
+{
+  const Token *tk;
+  bool matched = false;
+  SynNode *sym = OBJ_LEAF(leaf);
+
+  /*
+   * Match the symbol name
+   */
+  if (OBJTYPE_SYMBOL == sym->object.type)
+    {
+      int cmp;
+      const ImmString *name = OBJ_VALUE(OBJTYPE_SYMBOL, sym);
+      for (tk = tokens; tk->symbol; tk++)
+        {
+          /* the first character rejects most of them cheaply */
+          if (name->buffer()[0] != tk->symbol[0])
+            continue;
+          cmp = name->compare(tk->symbol);
+          if (cmp == 0)
+            {
+              matched = true;
+              break;
+            }
+        }
+    }
+
+  /*
+   * Call the primitive function if matched.
+   */
+  if (matched)
+    {
+      /* call the internal function here. */
+      SynNode * val = (this->*(tk->eval))(leaf, envsp, rc);
+      if (LP_SUCCESS(rc))
+        {
+          return val;
+        }
+      return 0; // failed
+    }
+
+  SynNode *result;
+
+  /*
+   * the node is not a primary function,
+   * try to evaluate it as a procedure or lambda.
+   */
+  if (OBJTYPE_SYMBOL == OBJ_LEAF(leaf)->object.type)
+    {
+      /* not a lambda */
+      SynNode *value;
+      rc = m_envstack.lookupVariable(envsp, OBJ_LEAF(leaf), &value);
+      if (LP_FAILURE(rc))
+        {
+          /*
+           * Then the functions registered by host, unless shadowed by
+           * a binding of the script.
+           */
+          NativeEntry *native = findNative(sym);
+          if (native)
+            {
+              return evalNative(native, leaf, envsp, rc);
+            }
+          rc = throwErrorAt(OBJ_LEAF(leaf), "target function was not found");
+          return 0;
+        }
+      else
+        {
+          if (!value || OBJTYPE_FUNC != value->object.type)
+            {
+              rc = throwErrorAt(OBJ_LEAF(leaf), "invalid calling, target is not a function.");
+              return 0;
+            }
+
+          SynNode *args = evalList(value->object.u.OBJTYPE_FUNC.params, OBJ_NEXT(leaf), envsp, rc);
+          if (LP_SUCCESS(rc))
+            {
+              /*
+               * Call the procedure.
+               */
+              result = evalProcedure(
+                  value->object.u.OBJTYPE_FUNC.body,
+                  value->object.u.OBJTYPE_FUNC.params,
+                  args,
+                  value->object.u.OBJTYPE_FUNC.envsp,
+                  rc);
+              if (LP_SUCCESS(rc))
+                {
+                  return result;
+                }
+            }
+        }
+    }
+  else
+    {
+      /* is lambda */
+      if (OBJTYPE_PAIR != OBJ_LEAF(leaf)->object.type)
+        {
+          rc = throwErrorAt(OBJ_LEAF(leaf), "expected a function.");
+          return 0;
+        }
+      SynNode *lambda = eval(OBJ_LEAF(leaf), envsp, rc);
+      if (LP_SUCCESS(rc))
+        {
+          if (!lambda || OBJTYPE_FUNC != lambda->object.type)
+            {
+              rc = throwErrorAt(OBJ_LEAF(leaf), "expected a function.");
+              return 0;
+            }
+          SynNode *args = evalList(lambda->object.u.OBJTYPE_FUNC.params, OBJ_NEXT(leaf), envsp, rc);
+          if (LP_SUCCESS(rc))
+            {
+              /*
+               * Call the procedure.
+               */
+              result = evalProcedure(
+                  lambda->object.u.OBJTYPE_FUNC.body,
+                  lambda->object.u.OBJTYPE_FUNC.params,
+                  args,
+                  lambda->object.u.OBJTYPE_FUNC.envsp,
+                  rc);
+              //!todo colleaction
+              if (LP_SUCCESS(rc))
+                {
+                  return result;
+                }
+            }
+        }
+  }
+  return 0; // failed
+}
+
+
+/**
+ * Inner,Working for evalCall(), evaluating the list.
+ * @param var Pointer to the source variable.
+ * @param vals Pointer to the values of vars.
+ * @param envsp Index of local environment stack.
+ * @param rc Reference to the status code.
+ * @return pointer to the node that stores the result.
+ *          (also a list).
+ */
+SynNode*
+Lisp::evalList(SynNode *vars, SynNode *vals, EnvSP envsp, __OUT int &rc)
+{
+  if ((vars == NULL && vals != NULL) ||
+      (vars != NULL && vals == NULL))
+    {
+      rc = throwErrorAt(vals, "invalid number of actual parameters of target function.");
+      return 0;
+    }
+
+  if (!vars)
+    {
+      //!fixme
+      LP_ASSERT(0);
+      return 0;
+    }
+
+  SynNode *res;
+  SynNode *first;
+  res = eval(OBJ_LEAF(vals), envsp, rc);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  rc = gc().createPair(res, 0, &first);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+
+  SynNode *index = first;
+  vars = OBJ_NEXT(vars);
+  vals = OBJ_NEXT(vals);
+  while (vars)
+    {
+      SynNode *each;
+      res = eval(OBJ_LEAF(vals), envsp, rc);
+      if (LP_SUCCESS(rc))
+        {
+          rc = gc().createPair(res, 0, &each);
+          if (LP_SUCCESS(rc))
+            {
+              OBJ_NEXT(index) = each;
+              index = each;
+              vars = OBJ_NEXT(vars);
+              vals = OBJ_NEXT(vals);
+            }
+        }
+      else
+        return 0;
+    }
+  if (vals) {
+    rc = throwErrorAt(vals, "invalid number of actual parameters of target function.");
+    return 0;
+  }
+  return first;
+}
+
+/**
+ * Inner, evaluate the procedure.
+ * @param bdoy Pointer to the root node of procedure body.
+ * @param var Pointer to the source variable.
+ * @param vals Pointer to the values of vars.
+ * @param envsp Index of local environment stack.
+ * @param rc Reference of status code.
+ * @return pointer to the node that stores the result.
+ */
+SynNode*
+Lisp::evalProcedure(SynNode *body, SynNode *vars, SynNode *vals, EnvSP envsp, __OUT int &rc)
+{
+  /*
+   * create a new local environment for the procedure.
+   */
+  EnvSP newsp;
+  rc = m_envstack.push(vars, vals, envsp, &newsp);
+  if (LP_SUCCESS(rc))
+    {
+      SynNode *res = dispatchEvaling(body, newsp, rc);
+      m_envstack.pop();
+      if (LP_SUCCESS(rc))
+        {
+          return res;
+        }
+    }
+  return 0;
+}
+
+
+/**
+ * Inner, Interpret the leaves in list.
+ * @param node Pointer to the target list
+ * @param envsp Index of local environment stack.
+ * @return status code.
+ */
+SynNode *
+Lisp::eval(SynNode *node, EnvSP envsp, __OUT int &rc)
+{
+  if (UNLIKELY(m_metered))
+    {
+      int frc = consumeFuel(node);
+      if (LP_FAILURE(frc))
+        {
+          rc = frc;
+          return 0;
+        }
+    }
+
+  if (targetEval(node))
+    {
+      return node;
+    }
+  else if (targetSymbol(node))
+    {
+      return evalVariable(node, envsp, rc);
+    }
+  else if (targetCall(node))
+    {
+      SynNode *res = evalCall(node, envsp, rc);
+      if (UNLIKELY(LERR_HEAP_LIMIT == rc))
+        reportRefused(node);
+      return res;
+    }
+  rc = throwErrorAt(node, "invalid syntax.");
+  return 0;
+}
+
+/**
+ * Inner, report a allocation refused by the limits of heap at the
+ * innermost call failed by it, once. The status code is kept as
+ * LERR_HEAP_LIMIT.
+ * @param at Pointer to the call.
+ */
+void
+Lisp::reportRefused(SynNode *at)
+{
+  size_t refused = m_gc.stats().refused;
+  if (refused != m_refusedReported)
+    {
+      m_refusedReported = refused;
+      throwErrorAt(at, "heap limit exceeded.");
+    }
+}
+
+/**
+ * Inner, dispatch all the operation in the list.
+ * @param root Pointer to the root node of SynTree.
+ * @param envsp Index of local environment stack.
+ * @return Pointer to the node that stores the result.
+ */
+SynNode *
+Lisp::dispatchEvaling(SynNode *root, EnvSP envsp, int &rc)
+{
+  SynNode *result = 0;
+  SynNode *node = root;
+  /* execute */
+  while (node)
+    {
+      if (UNLIKELY(node->object.type != OBJTYPE_PAIR))
+        {
+          /* this never happens */
+          LP_ASSERT(0);
+          rc = throwErrorAt(node, "invalid syntax.");
+          return 0;
+        }
+
+      result = eval(OBJ_LEAF(node), envsp, rc);
+      if (LP_SUCCESS(rc))
+        {
+          node = OBJ_NEXT(node);
+        }
+      else
+        return result; // failed.
+
+      /* between the top-level expressions nothing else is referenced */
+      if (root == m_ast && !envsp && m_gc.wantsCollect())
+        collectWith(result, m_gc.sliceBudget() != 0);
+    }
+
+  return result;
+}
+
+/**
+ * Inner, resolve whether the target is a symbol.
+ * @param leaf Pointer to the node.
+ * @return true if yes.
+ */
+bool
+Lisp::targetSymbol(SynNode *leaf)
+{
+  return (leaf->object.type == OBJTYPE_SYMBOL);
+}
+
+/**
+ * Inner, resolve whether the target is a calling.
+ * @param leaf Pointer to the node.
+ * @return true if yes.
+ */
+bool
+Lisp::targetCall(SynNode *leaf)
+{
+  if (OBJTYPE_PAIR == leaf->object.type)
+    {
+      if (OBJTYPE_SYMBOL == OBJ_LEAF(leaf)->object.type)
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+/**
+ * Inner, resolve whether the target is pair.
+ * @param leaf Pointer to the node.
+ * @return true if yes.
+ */
+bool
+Lisp::targetPair(SynNode *leaf)
+{
+  return (leaf->object.type == OBJTYPE_PAIR);
+}
+
+/**
+ * Inner, resolve whether the target is a eval expression.
+ * @param leaf Pointer to the node.
+ * @return true if yes.
+ */
+bool
+Lisp::targetEval(SynNode *leaf)
+{
+  switch (leaf->object.type)
+  {
+    case OBJTYPE_BOOLEAN:
+    case OBJTYPE_NUMBER:
+    case OBJTYPE_STRING:
+    case OBJTYPE_CHARACTER:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * Evaluate the script
+ * @param out Optional, Where to store the result.
+ * @reutrn status code. LINF_SUSPENDED if the fuel was used up while
+ *         preemptive, see resume().
+ */
+int
+Lisp::run(__OUT SynNode **out)
+{
+  if (!m_parsed || suspended())
+    {
+      return LERR_FAILED;
+    }
+
+  int rc = LINF_SUCCEEDED;
+
+  /* the global environment is kept between runs, see reset() */
+  if (!m_envstack.ready())
+    {
+      rc = m_envstack.newenv();
+    }
+  if (LP_SUCCESS(rc))
+    {
+      startClock();
+      if (m_preemptive)
+        {
+          return runFiber(out);
+        }
+      SynNode *result = dispatchEvaling(m_ast, 0/*envsp*/, rc);
+      rc = finishRun(result, rc, out);
+    }
+  return rc;
+}
+
+/**
+ * Inner, complete the evaluation of run() or resume().
+ * @param result Pointer to the result of program.
+ * @param rc The status code of evaluation.
+ * @param out Optional, Where to store the result.
+ * @return status code.
+ */
+int
+Lisp::finishRun(SynNode *result, int rc, __OUT SynNode **out)
+{
+  waitFutures();
+  if (LP_SUCCESS(rc))
+    {
+      rc = flushOutput();
+    }
+  if (LP_SUCCESS(rc))
+    {
+      if (out)
+        {
+          *out = result;
+        }
+    }
+  return rc;
+}
+
+/**
+ * Read, parse and evaluate the top-level expressions from stream one
+ * at a time, so that the evaluating overlaps with the reading and
+ * stream of unbounded length (such as a pipe) can be processed.
+ * Unlike parser(), the expressions are not wrapped with an outer list.
+ * @param stream Pointer to the IStream interface.
+ * @param out Optional, Where to store the result of the last expression.
+ * @return status code.
+ */
+int
+Lisp::load(IStream *stream, __OUT SynNode **out)
+{
+  int rc;
+  SynNode *form;
+  SynNode *result = 0;
+
+  if (suspended())
+    {
+      return LERR_FAILED;
+    }
+  startClock();
+
+  rc = m_lexer.open(stream);
+  if (LP_SUCCESS(rc) && !m_envstack.ready())
+    {
+      rc = m_envstack.newenv();
+    }
+  if (LP_FAILURE(rc))
+    {
+      return rc;
+    }
+  m_stream = stream;
+
+  for (;;)
+    {
+      rc = m_parser.parseNext(&m_lexer, &form);
+      if (rc == LINF_END_OF_STREAM)
+        {
+          break;
+        }
+      if (LP_FAILURE(rc))
+        {
+          return rc;
+        }
+      if (!form)
+        {
+          /* nil evaluates to itself */
+          result = 0;
+          continue;
+        }
+
+      result = eval(form, 0/*envsp*/, rc);
+      waitFutures();
+      if (LP_FAILURE(rc))
+        {
+          return rc;
+        }
+
+      /* the output of each expression is visible before reading the next */
+      rc = flushOutput();
+      if (LP_FAILURE(rc))
+        {
+          return rc;
+        }
+
+      if (m_gc.wantsCollect())
+        collectWith(result, m_gc.sliceBudget() != 0);
+    }
+
+  if (out)
+    {
+      *out = result;
+    }
+  return LINF_SUCCEEDED;
+}
+
+/*
+ * Filter of the tables keyed by the nodes, see reset().
+ */
+struct RetainContext
+{
+  GC           *gc;
+  const GCMark *mark;
+};
+
+/**
+ * Inner, keep the keys that survive the release of heap.
+ * @param key Pointer to the node.
+ * @param opaque Pointer to the RetainContext.
+ * @return true if the node was allocated before the mark.
+ */
+static bool
+retainOld(const void *key, void *opaque)
+{
+  RetainContext *ctx = static_cast<RetainContext *>(opaque);
+  return ctx->gc->allocatedBefore(key, *ctx->mark);
+}
+
+/**
+ * Take a snapshot of the current state, which reset() returns to.
+ * Typically the program is parsed (and the prelude defining the global
+ * variables is evaluated) once, followed by a snapshot, after that
+ * each run() is followed by a reset().
+ * Only one snapshot is kept, the later replaces the earlier.
+ * @return status code.
+ */
+int
+Lisp::snapshot()
+{
+  int rc = LINF_SUCCEEDED;
+  if (suspended())
+    {
+      return LERR_FAILED;
+    }
+  if (!m_envstack.ready())
+    {
+      rc = m_envstack.newenv();
+      UPDATE_RC(rc);
+    }
+  m_envstack.unwind();
+
+  m_gc.mark(&m_mark);
+  rc = m_gc.beginUndo(m_mark);
+  UPDATE_RC(rc);
+
+  m_markParsed = m_parsed;
+  m_markAst = m_ast;
+  m_snapshot = true;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Return to the snapshot taken by snapshot(). The changes made to the
+ * objects that existed at that time (such as the global variables
+ * defined or set) are undone, and all the objects created after it are
+ * released at once. The content written to the existing string ports
+ * is not undone. The evaluation suspended, if any, is cancelled.
+ * None of the nodes got after the snapshot (such as the result of run())
+ * may be used afterwards.
+ * @return status code.
+ */
+int
+Lisp::reset()
+{
+  cancel();
+  if (!m_snapshot)
+    {
+      return LERR_FAILED;
+    }
+  waitFutures();
+  int rc = flushOutput();
+
+  m_gc.rollback();
+
+  /* the tables keyed by the nodes must not refer to the released */
+  RetainContext ctx;
+  ctx.gc = &m_gc;
+  ctx.mark = &m_mark;
+  int rc2 = m_srcmap.retain(retainOld, &ctx);
+  if (LP_FAILURE(rc2))
+    rc = rc2;
+  rc2 = m_parser.retainConsts(retainOld, &ctx);
+  if (LP_FAILURE(rc2))
+    rc = rc2;
+
+  m_gc.release(m_mark);
+  m_envstack.unwind();
+  m_parsed = m_markParsed;
+  m_ast = m_markAst;
+  return rc;
+}
+
+/**
+ * Inner, keep the keys that survive the collection.
+ * @param key Pointer to the node.
+ * @param opaque Pointer to the GC.
+ * @return true if the node is alive.
+ */
+static bool
+retainLive(const void *key, void *opaque)
+{
+  return static_cast<GC *>(opaque)->isLive(key);
+}
+
+/**
+ * Inner, the tables keyed by the nodes must not refer to the ones
+ * reclaimed by the collection, see pfnCollected. They are purged in
+ * place a few slots at a time, the positions first.
+ */
+/* static */
+bool
+Lisp::forgetCollected(GC *gc, bool restart, size_t steps, void *opaque)
+{
+  Lisp *lisp = static_cast<Lisp *>(opaque);
+  if (restart)
+    lisp->m_forgetPositions.size = lisp->m_forgetConsts.size = ~static_cast<size_t>(0);
+  if (!lisp->m_srcmap.retainSome(retainLive, gc, &lisp->m_forgetPositions, steps))
+    return false;
+  return lisp->m_parser.retainSomeConsts(retainLive, gc, &lisp->m_forgetConsts, steps);
+}
+
+/**
+ * Inner, reclaim the objects not reachable from the environments and
+ * the program, see collect().
+ * @param extra Pointer to another root, such as the result of the last
+ *              expression, or 0.
+ * @param incremental Whether to mark in slices, see GC::startCollect().
+ * @return status code.
+ */
+int
+Lisp::collectWith(SynNode *extra, bool incremental)
+{
+  /* the objects of the pending futures, the workers and the evaluation
+     suspended are in use */
+  if (m_parent || m_futureCount || m_gc.isPrivate() || suspended())
+    {
+      return LERR_FAILED;
+    }
+
+  int rc = m_envstack.ready() ? LINF_SUCCEEDED : m_envstack.newenv();
+  UPDATE_RC(rc);
+
+  NodeStack roots;
+  SynNode *fixed[4] = {m_ast, m_parser.getSynRoot(), m_snapshot ? m_markAst : 0, extra};
+  for (size_t i = 0; i < 4 && LP_SUCCESS(rc); i++)
+    {
+      if (fixed[i])
+        rc = roots.push(fixed[i]);
+    }
+  if (LP_SUCCESS(rc))
+    rc = m_envstack.roots(roots);
+  UPDATE_RC(rc);
+
+  if (incremental)
+    {
+      return m_gc.startCollect(roots);
+    }
+  TaskPool *pool = LP_SUCCESS(startPool()) ? m_pool : 0;
+  return m_gc.collect(roots, pool);
+}
+
+/**
+ * Reclaim the objects no longer reachable from the global variables and
+ * the program parsed. It is run automatically between the top-level
+ * expressions by run() and load() when the heap has grown to twice the
+ * size that survived the last collection.
+ * With a snapshot, only the objects created after it are reclaimed.
+ * None of the nodes got earlier (such as the result of run()) may be
+ * used afterwards, unless they are reachable from the variables.
+ * @return status code.
+ */
+int
+Lisp::collect()
+{
+  waitFutures();
+  int rc = flushOutput();
+  UPDATE_RC(rc);
+  return collectWith(0, false);
+}
+
+/**
+ * Enable or disable the hash-consing of the immutable constants
+ * (numbers, strings, characters, booleans and quoted data) parsed
+ * afterwards. See Parser::setHashConsing().
+ * @param enable Whether to enable it.
+ */
+void
+Lisp::setHashConsing(bool enable)
+{
+  m_parser.setHashConsing(enable);
+}
+
+/**
+ * Set the callback for atom data output.
+ * @param pfn Pointer to the callback function,
+ */
+void
+Lisp::setPrintAtomCallback(pfnPrintAtom pfn)
+{
+  m_printAtom = pfn;
+}
+
+/**
+ * Select the diagnostic dumps, all are disabled by default.
+ * The dumps are written by LOG(INFO).
+ * @param flags Combination of DiagFlags.
+ */
+void
+Lisp::setDiagnostics(unsigned int flags)
+{
+  m_diagnostics = flags;
+  m_lexer.setDump((flags & DIAG_LEXER) != 0);
+}
+
+/**
+ * Set the writer of output sink, which receives the text of display
+ * and print in large blocks instead of one call for each value.
+ * The print callback, if set, takes precedence over the sink.
+ * @param pfn Pointer to the writer, 0 to discard the output.
+ * @param opaque The pointer passed to the writer.
+ */
+void
+Lisp::setOutputSink(pfnWriteOutput pfn, void *opaque)
+{
+  flushOutput();
+  m_writeOutput = pfn;
+  m_outputOpaque = opaque;
+}
+
+/**
+ * Set the size of output held before it is written.
+ * The output is also written at the flush points: the end of run(),
+ * each top-level expression of load(), the errors and flushOutput().
+ * @param size The size in bytes, 0 to write the output immediately.
+ */
+void
+Lisp::setOutputThreshold(size_t size)
+{
+  m_outputThreshold = size;
+}
+
+/**
+ * Write a value to the output, as the builtin display does.
+ * @param node Pointer to the value.
+ * @param ln Whether print a new line.
+ * @return status code.
+ */
+int
+Lisp::display(SynNode *node, bool ln)
+{
+  int rc;
+  if (m_printAtom)
+    {
+      if (!m_parent)
+        return m_printAtom(node, ln);
+
+      /* a pool worker, the callback is not required to be thread-safe */
+      m_parent->m_pool->lock();
+      rc = m_printAtom(node, ln);
+      m_parent->m_pool->unlock();
+      return rc;
+    }
+  if (!m_writeOutput)
+    {
+      return LINF_SUCCEEDED;
+    }
+
+  rc = formatNode(node, m_output);
+  if (LP_SUCCESS(rc) && ln)
+    {
+      rc = m_output.append("\n", 1);
+    }
+  if (LP_SUCCESS(rc) && m_output.length() >= m_outputThreshold)
+    {
+      rc = flushOutput();
+    }
+  return rc;
+}
+
+/**
+ * Write the output held to the sink.
+ * @return status code.
+ */
+int
+Lisp::flushOutput()
+{
+  int rc = LINF_SUCCEEDED;
+  if (m_writeOutput && m_output.length())
+    {
+      rc = m_writeOutput(m_output.buffer(), m_output.length(), m_outputOpaque);
+    }
+  m_output.copy("", 0); /* the capacity is kept */
+  return rc;
+}
+
+} // namespace DSL
@@ -0,0 +1,245 @@
+/** @file
+ * LispDSL - Functions registered by host.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Inner, find the function registered with the name of symbol.
+ * @param sym Pointer to the symbol node.
+ * @return 0 if not found.
+ * @return pointer to the entry.
+ */
+NativeEntry *
+Lisp::findNative(SynNode *sym)
+{
+  if (OBJTYPE_SYMBOL != sym->object.type)
+    return 0;
+
+  /* only the equality matters, the hash rejects most of them */
+  const ImmString *name = OBJ_VALUE(OBJTYPE_SYMBOL, sym);
+  for (size_t i = 0; i < m_nativeCount; i++)
+    {
+      const ImmString *each = m_natives[i].name;
+      if (each->hash() == name->hash() && each->length() == name->length()
+          && memcmp(each->buffer(), name->buffer(), name->length()) == 0)
+        return &m_natives[i];
+    }
+  /* the pool workers call the ones of their owner */
+  return m_parent ? m_parent->findNative(sym) : 0;
+}
+
+/**
+ * Inner, add a entry or replace the one of the same name.
+ * @param name Name of the function.
+ * @param entry The entry, the name is filled here.
+ * @return status code.
+ */
+int
+Lisp::addNative(const char *name, const NativeEntry &entry)
+{
+  if (!name || !*name)
+    {
+      return LERR_FAILED;
+    }
+  for (const Token *tk = tokens; tk->symbol; tk++)
+    {
+      if (!strcmp(tk->symbol, name))
+        return LERR_NOT_MATCHED; /* the builtins can not be replaced */
+    }
+
+  ImmString *str = ImmString::create(name);
+  if (!str)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  for (size_t i = 0; i < m_nativeCount; i++)
+    {
+      if (m_natives[i].name->compare(*str) == 0)
+        {
+          ImmString::release(m_natives[i].name);
+          m_natives[i] = entry;
+          m_natives[i].name = str;
+          return LINF_SUCCEEDED;
+        }
+    }
+
+  if (m_nativeCount == m_nativeSize)
+    {
+      size_t newsize = m_nativeSize ? m_nativeSize * 2 : 16;
+      NativeEntry *natives = new (std::nothrow) NativeEntry[newsize];
+      if (!natives)
+        {
+          ImmString::release(str);
+          return LERR_ALLOC_MEMORY;
+        }
+      if (m_natives)
+        {
+          memcpy(natives, m_natives, m_nativeCount * sizeof(NativeEntry));
+          delete [] m_natives;
+        }
+      m_natives = natives;
+      m_nativeSize = newsize;
+    }
+  m_natives[m_nativeCount] = entry;
+  m_natives[m_nativeCount].name = str;
+  m_nativeCount++;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Register a host function, which is called as (name arg ...).
+ * The builtins take precedence over it, and so do the variables of the
+ * script (globals, local defines and parameters) of the same name.
+ * @param name Name of the function, a registered one is replaced.
+ * @param pfn Pointer to the function.
+ * @param arity Number of the arguments, or NATIVE_VARIADIC for any number
+ *              up to _MAX_NATIVE_ARGS.
+ * @param opaque The pointer passed to the function.
+ * @return status code.
+ */
+int
+Lisp::registerNative(const char *name, pfnNative pfn, int arity, void *opaque)
+{
+  if (!pfn || arity < NATIVE_VARIADIC || arity > _MAX_NATIVE_ARGS)
+    {
+      return LERR_FAILED;
+    }
+  NativeEntry entry;
+  entry.kind = NATIVE_GENERIC;
+  entry.arity = arity;
+  entry.opaque = opaque;
+  entry.u.generic = pfn;
+  return addNative(name, entry);
+}
+
+/**
+ * Register a numeric host function of one argument, such as sqrt.
+ * The number is passed unboxed and no argument is allocated.
+ * @param name Name of the function, a registered one is replaced.
+ * @param pfn Pointer to the function.
+ * @return status code.
+ */
+int
+Lisp::registerNumber(const char *name, pfnNumber1 pfn)
+{
+  if (!pfn)
+    {
+      return LERR_FAILED;
+    }
+  NativeEntry entry;
+  entry.kind = NATIVE_NUMBER1;
+  entry.arity = 1;
+  entry.opaque = 0;
+  entry.u.number1 = pfn;
+  return addNative(name, entry);
+}
+
+/**
+ * Register a numeric host function of two arguments, such as pow.
+ * The numbers are passed unboxed and no argument is allocated.
+ * @param name Name of the function, a registered one is replaced.
+ * @param pfn Pointer to the function.
+ * @return status code.
+ */
+int
+Lisp::registerNumber(const char *name, pfnNumber2 pfn)
+{
+  if (!pfn)
+    {
+      return LERR_FAILED;
+    }
+  NativeEntry entry;
+  entry.kind = NATIVE_NUMBER2;
+  entry.arity = 2;
+  entry.opaque = 0;
+  entry.u.number2 = pfn;
+  return addNative(name, entry);
+}
+
+/**
+ * Inner, evaluate the arguments and call the host function.
+ * @param native Pointer to the entry.
+ * @param leaf Pointer to the calling node.
+ * @param envsp Index of local environment stack.
+ * @param rc Reference to the status code.
+ * @return pointer to the result.
+ */
+SynNode*
+Lisp::evalNative(NativeEntry *native, SynNode *leaf, EnvSP envsp, __OUT int &rc)
+{
+  SynNode *args[_MAX_NATIVE_ARGS];
+  size_t argc = 0;
+  const char *name = native->name->buffer();
+
+  for (SynNode *n = OBJ_NEXT(leaf); n; n = OBJ_NEXT(n))
+    {
+      if (argc == _MAX_NATIVE_ARGS)
+        {
+          rc = throwErrorAt(OBJ_LEAF(n), "%s - too many arguments.", name);
+          return 0;
+        }
+      args[argc] = eval(OBJ_LEAF(n), envsp, rc);
+      if (LP_FAILURE(rc))
+        {
+          return 0;
+        }
+      if (native->kind != NATIVE_GENERIC
+          && (!args[argc] || OBJTYPE_NUMBER != args[argc]->object.type))
+        {
+          rc = throwErrorAt(OBJ_LEAF(n), "%s - operand(s) type mismatched.", name);
+          return 0;
+        }
+      argc++;
+    }
+  if (native->arity != NATIVE_VARIADIC && static_cast<size_t>(native->arity) != argc)
+    {
+      rc = throwErrorAt(leaf, "'%s' syntax error.", name);
+      return 0;
+    }
+
+  SynNode *res;
+  double v;
+  switch (native->kind)
+  {
+    case NATIVE_NUMBER1:
+      v = native->u.number1(OBJ_VALUE(OBJTYPE_NUMBER, args[0]));
+      break;
+    case NATIVE_NUMBER2:
+      v = native->u.number2(OBJ_VALUE(OBJTYPE_NUMBER, args[0]),
+                            OBJ_VALUE(OBJTYPE_NUMBER, args[1]));
+      break;
+    default:
+      res = native->u.generic(this, args, argc, native->opaque, rc);
+      return LP_SUCCESS(rc) ? res : 0;
+  }
+  createAtom(gc(), OBJTYPE_NUMBER, res, v, rc);
+  return LP_SUCCESS(rc) ? res : 0;
+}
+
+} // namespace DSL
@@ -0,0 +1,889 @@
+/** @file
+ * LispDSL - Parallel map and futures over the work-stealing pool.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <unistd.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Ranges dealt to each worker thread at first, the more the better
+ * balanced when the items take different time.
+ */
+#define PARALLEL_RANGES_PER_WORKER (4)
+
+/*
+ * The work of a parallel map.
+ */
+struct ParallelJob
+{
+  Lisp      *owner;
+  SynNode   *func;
+  SynNode  **items;
+  SynNode  **results;
+  int       *codes;
+};
+
+/**
+ * Set the number of worker threads evaluating pmap, pfor-each and
+ * future, which caps the futures running at once. By default it is the
+ * number of the processors online, the pool is started by the first
+ * parallel map or future.
+ * @param threads Number of the threads, 0 to evaluate the items and
+ *                the futures in the calling thread.
+ * @return status code.
+ */
+int
+Lisp::setParallelism(size_t threads)
+{
+  if (m_parent)
+    {
+      return LERR_FAILED; /* the workers are sequential */
+    }
+  stopPool();
+  m_parallelism = threads;
+  m_parallelismSet = true;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, start the pool and create the worker instances.
+ * Each worker evaluates in its own heap, and refuses to store into the
+ * objects of the others, such as the ones of this instance shared by
+ * all of them.
+ * @return status code.
+ */
+int
+Lisp::startPool()
+{
+  if (m_pool)
+    {
+      return LINF_SUCCEEDED;
+    }
+  if (!m_parallelismSet)
+    {
+      long n = sysconf(_SC_NPROCESSORS_ONLN);
+      m_parallelism = n > 1 ? static_cast<size_t>(n) : 0;
+      m_parallelismSet = true;
+    }
+  if (!m_parallelism)
+    {
+      return LERR_FAILED;
+    }
+
+  m_workers = new (std::nothrow) Lisp *[m_parallelism];
+  if (!m_workers)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  for (size_t i = 0; i < m_parallelism; i++)
+    m_workers[i] = 0;
+
+  for (size_t i = 0; i < m_parallelism; i++)
+    {
+      Lisp *w = new (std::nothrow) Lisp;
+      if (!w)
+        {
+          stopPool();
+          return LERR_ALLOC_MEMORY;
+        }
+      m_workers[i] = w;
+      w->m_parent = this;
+      w->m_parallelismSet = true; /* nested ones are sequential */
+      w->m_gc.setPrivate(true);
+      w->m_gc.setLimits(0, m_gc.hardLimit()); /* each worker on its own */
+      w->setOutputSink(forwardOutput, w);
+      w->setOutputThreshold(0);
+      w->setErrorSink(forwardError, w);
+      w->m_gc.mark(&w->m_mark); /* the heap is released to it after each map */
+    }
+
+  m_pool = new (std::nothrow) TaskPool;
+  if (!m_pool)
+    {
+      stopPool();
+      return LERR_ALLOC_MEMORY;
+    }
+  int rc = m_pool->start(m_parallelism);
+  if (LP_FAILURE(rc))
+    {
+      stopPool();
+    }
+  return rc;
+}
+
+/**
+ * Inner, stop the pool and destroy the worker instances.
+ */
+void
+Lisp::stopPool()
+{
+  waitFutures();
+  if (m_pool)
+    m_pool->stop();
+  if (m_workers)
+    {
+      for (size_t i = 0; i < m_parallelism; i++)
+        delete m_workers[i];
+      delete [] m_workers;
+      m_workers = 0;
+    }
+  delete m_pool;
+  m_pool = 0;
+}
+
+/**
+ * Inner, the output sink of the workers, which appends the text to the
+ * output of the owner.
+ */
+/* static */
+int
+Lisp::forwardOutput(const char *buff, size_t len, void *opaque)
+{
+  Lisp *owner = static_cast<Lisp *>(opaque)->m_parent;
+  owner->m_pool->lock();
+  int rc = owner->m_output.append(buff, len);
+  owner->m_pool->unlock();
+  return rc;
+}
+
+/**
+ * Inner, the error sink of the workers, which reports to the sink of
+ * the owner, after the output held. Only the first error of a map is
+ * reported, the ranges not started are skipped after it.
+ */
+/* static */
+void
+Lisp::forwardError(file_off line, file_off column, const char *msg, void *opaque)
+{
+  Lisp *owner = static_cast<Lisp *>(opaque)->m_parent;
+  owner->m_pool->lock();
+  if (!owner->m_poolErrors++)
+    {
+      owner->flushOutput();
+      throwError(&owner->m_errors, line, column, "%s", msg);
+    }
+  owner->m_pool->unlock();
+}
+
+/**
+ * Inner, apply the procedure of one parameter to the items [begin, end),
+ * it stops at the first failure.
+ * @param func Pointer to the procedure.
+ * @param envsp Index of the environment of procedure.
+ * @param items Pointer to the items.
+ * @param results Where to store the results.
+ * @param codes Where to store the status codes.
+ * @param begin Index of the first item.
+ * @param end Index after the last item.
+ */
+void
+Lisp::evalItems(SynNode *func, EnvSP envsp, SynNode **items, SynNode **results,
+                int *codes, size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; i++)
+    {
+      int rc;
+      SynNode *arg;
+
+      results[i] = 0;
+      rc = gc().createPair(items[i], 0, &arg);
+      if (LP_SUCCESS(rc))
+        {
+          results[i] = evalProcedure(func->object.u.OBJTYPE_FUNC.body,
+                                     func->object.u.OBJTYPE_FUNC.params,
+                                     arg, envsp, rc);
+        }
+      codes[i] = rc;
+      if (LP_FAILURE(rc))
+        break;
+    }
+}
+
+/**
+ * Inner, the task run by the pool, see evalItems().
+ */
+/* static */
+void
+Lisp::parallelTask(size_t worker, size_t begin, size_t end, void *opaque)
+{
+  ParallelJob *job = static_cast<ParallelJob *>(opaque);
+  Lisp *owner = job->owner;
+  Lisp *w = owner->m_workers[worker];
+
+  owner->m_pool->lock();
+  bool failed = owner->m_poolErrors != 0;
+  owner->m_pool->unlock();
+  if (failed)
+    {
+      int code = w->meterUsedUp() ? LERR_OUT_OF_FUEL : LERR_THROW_ERROR;
+      for (size_t i = begin; i < end; i++)
+        job->codes[i] = code; /* reported already */
+      return;
+    }
+
+  w->m_envstack.adopt(owner->m_envstack.node(job->func->object.u.OBJTYPE_FUNC.envsp));
+  w->evalItems(job->func, 0, job->items, job->results, job->codes, begin, end);
+}
+
+/**
+ * Inner, point out whether a node was created by one of the workers.
+ */
+static bool
+fromWorker(Lisp **workers, size_t count, const void *p)
+{
+  for (size_t i = 0; i < count; i++)
+    {
+      if (workers[i]->gc().contains(p))
+        return true;
+    }
+  return false;
+}
+
+/**
+ * Inner, copy a result of the workers into the heap, the nodes of the
+ * other heaps are shared.
+ * @param gc The heap to copy into.
+ * @param workers Pointer to the workers.
+ * @param count Number of the workers.
+ * @param node Pointer to the result.
+ * @param out Where to store the copy.
+ * @return LERR_NOT_MATCHED if a procedure or a port is found.
+ * @return status code.
+ */
+static int
+copyResult(GC &gc, Lisp **workers, size_t count, SynNode *node, __OUT SynNode **out)
+{
+  int rc = LINF_SUCCEEDED;
+  if (!node || !fromWorker(workers, count, node))
+    {
+      *out = node;
+      return rc;
+    }
+
+  switch (node->object.type)
+  {
+    case OBJTYPE_BOOLEAN:
+    case OBJTYPE_NUMBER:
+    case OBJTYPE_CHARACTER:
+      rc = gc._createAtom(out);
+      if (LP_SUCCESS(rc))
+        (*out)->object = node->object;
+      return rc;
+
+    case OBJTYPE_STRING:
+    case OBJTYPE_SYMBOL:
+      {
+        ImmString *src = (OBJTYPE_STRING == node->object.type)
+            ? OBJ_VALUE(OBJTYPE_STRING, node)
+            : OBJ_VALUE(OBJTYPE_SYMBOL, node);
+        ImmString *v;
+        SynNode *atom;
+        rc = gc.createString(src->buffer(), src->length(), &v);
+        UPDATE_RC(rc);
+        if (OBJTYPE_STRING == node->object.type)
+          createAtom(gc, OBJTYPE_STRING, atom, v, rc);
+        else
+          createAtom(gc, OBJTYPE_SYMBOL, atom, v, rc);
+        *out = atom;
+        return rc;
+      }
+
+    case OBJTYPE_PAIR:
+      {
+        /* along the list, only the elements are recursive */
+        SynNode *head = 0, *tail = 0, *rest;
+        while (node && OBJTYPE_PAIR == node->object.type
+               && fromWorker(workers, count, node))
+          {
+            SynNode *leaf, *each;
+            rc = copyResult(gc, workers, count, OBJ_LEAF(node), &leaf);
+            UPDATE_RC(rc);
+            rc = gc.createPair(leaf, 0, &each);
+            UPDATE_RC(rc);
+            if (tail)
+              OBJ_NEXT(tail) = each;
+            else
+              head = each;
+            tail = each;
+            node = OBJ_NEXT(node);
+          }
+        rc = copyResult(gc, workers, count, node, &rest);
+        UPDATE_RC(rc);
+        OBJ_NEXT(tail) = rest;
+        *out = head;
+        return rc;
+      }
+
+    default:
+      /* the procedures refer to the stack of worker */
+      return LERR_NOT_MATCHED;
+  }
+}
+
+/**
+ * Inner, apply a procedure of one parameter to each item of a list with
+ * the pool. The items are evaluated by the workers in their own heaps,
+ * the results are then copied in the order of items. The evaluation is
+ * in the calling thread if the parallelism is 0, or nested in a worker.
+ * (pmap [procedure] [list])
+ * (pfor-each [procedure] [list])
+ * @param args Pointer to the source node.
+ * @param envsp Index of local environment stack.
+ * @param keep Whether to return the list of results.
+ * @param rc Reference to the status code.
+ * @return pointer to the node that stores the result.
+ */
+SynNode*
+Lisp::parallelMap(SynNode *args, EnvSP envsp, bool keep, __OUT int &rc)
+{
+  const char *name = keep ? "pmap" : "pfor-each";
+  rc = validateSyntax(args, 3, name);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  SynNode *func = eval(OBJ_LEAF(OBJ_NEXT(args)), envsp, rc);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  if (!func || OBJTYPE_FUNC != func->object.type || !func->object.u.OBJTYPE_FUNC.params
+      || OBJ_NEXT(func->object.u.OBJTYPE_FUNC.params))
+    {
+      rc = throwErrorAt(OBJ_LEAF(OBJ_NEXT(args)), "%s - expected a procedure of one parameter.", name);
+      return 0;
+    }
+  SynNode *list = eval(OBJ_LEAF(OBJ_NEXT2(args)), envsp, rc);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+
+  size_t count = 0;
+  SynNode *node = list;
+  while (node && OBJTYPE_PAIR == node->object.type)
+    {
+      count++;
+      node = OBJ_NEXT(node);
+    }
+  if (node)
+    {
+      rc = throwErrorAt(OBJ_LEAF(OBJ_NEXT2(args)), "%s - expected a list.", name);
+      return 0;
+    }
+
+  SynNode *res = 0;
+  if (!count)
+    {
+      if (!keep)
+        createAtom(gc(), OBJTYPE_BOOLEAN, res, true, rc);
+      return res; /* the empty list */
+    }
+
+  SynNode **items = new (std::nothrow) SynNode *[count * 2];
+  int *codes = new (std::nothrow) int[count];
+  if (!items || !codes)
+    {
+      delete [] items;
+      delete [] codes;
+      rc = LERR_ALLOC_MEMORY;
+      return 0;
+    }
+  SynNode **results = items + count;
+  node = list;
+  for (size_t i = 0; i < count; i++)
+    {
+      items[i] = OBJ_LEAF(node);
+      codes[i] = LERR_FAILED;
+      node = OBJ_NEXT(node);
+    }
+
+  bool parallel = !m_parent && count > 1 && LP_SUCCESS(startPool());
+  if (parallel)
+    {
+      ParallelJob job;
+      job.owner = this;
+      job.func = func;
+      job.items = items;
+      job.results = results;
+      job.codes = codes;
+      for (size_t i = 0; i < m_parallelism; i++)
+        {
+          m_workers[i]->m_printAtom = m_printAtom;
+          shareMeter(m_workers[i]);
+        }
+
+      m_poolErrors = 0;
+      size_t grain = count / (m_parallelism * PARALLEL_RANGES_PER_WORKER);
+      rc = m_pool->run(count, grain ? grain : 1, parallelTask, &job);
+    }
+  else
+    {
+      evalItems(func, func->object.u.OBJTYPE_FUNC.envsp, items, results, codes, 0, count);
+      rc = LINF_SUCCEEDED;
+    }
+
+  /* the failure of the first item in order */
+  for (size_t i = 0; i < count && LP_SUCCESS(rc); i++)
+    rc = codes[i];
+
+  if (LP_SUCCESS(rc))
+    {
+      if (keep)
+        {
+          SynNode *tail = 0;
+          for (size_t i = 0; i < count && LP_SUCCESS(rc); i++)
+            {
+              SynNode *value, *each;
+              rc = parallel ? copyResult(gc(), m_workers, m_parallelism, results[i], &value)
+                            : (value = results[i], LINF_SUCCEEDED);
+              if (LERR_NOT_MATCHED == rc)
+                rc = throwErrorAt(OBJ_LEAF(OBJ_NEXT(args)), "pmap - the result can not be returned from a worker.");
+              if (LP_SUCCESS(rc))
+                rc = gc().createPair(value, 0, &each);
+              if (LP_SUCCESS(rc))
+                {
+                  if (tail)
+                    OBJ_NEXT(tail) = each;
+                  else
+                    res = each;
+                  tail = each;
+                }
+            }
+        }
+      else
+        {
+          createAtom(gc(), OBJTYPE_BOOLEAN, res, true, rc);
+        }
+    }
+
+  if (parallel)
+    {
+      for (size_t i = 0; i < m_parallelism; i++)
+        m_workers[i]->m_gc.release(m_workers[i]->m_mark);
+      if (m_output.length() >= m_outputThreshold)
+        {
+          int rc2 = flushOutput();
+          if (LP_SUCCESS(rc))
+            rc = rc2;
+        }
+    }
+  delete [] items;
+  delete [] codes;
+  return LP_SUCCESS(rc) ? res : 0;
+}
+
+/**
+ * Parallel map, the results are in the order of list.
+ * (pmap [procedure] [list])
+ */
+SynNode*
+Lisp::symbolPMap(SynNode *args, EnvSP envsp, __OUT int &rc)
+{
+  return parallelMap(args, envsp, true, rc);
+}
+
+/**
+ * Parallel for-each, only for the side effects such as the output.
+ * (pfor-each [procedure] [list])
+ */
+SynNode*
+Lisp::symbolPForEach(SynNode *args, EnvSP envsp, __OUT int &rc)
+{
+  return parallelMap(args, envsp, false, rc);
+}
+
+/**
+ * Inner, the output sink of the futures, which holds the text until
+ * the future is touched.
+ */
+/* static */
+int
+Lisp::holdOutput(const char *buff, size_t len, void *opaque)
+{
+  return static_cast<FutureTask *>(opaque)->output.append(buff, len);
+}
+
+/**
+ * Inner, the error sink of the futures, which holds the first error
+ * until the future is touched.
+ */
+/* static */
+void
+Lisp::holdError(file_off line, file_off column, const char *msg, void *opaque)
+{
+  FutureTask *task = static_cast<FutureTask *>(opaque);
+  if (!task->message[0])
+    {
+      task->line = line;
+      task->column = column;
+      snprintf(task->message, sizeof(task->message), "%s", msg);
+    }
+}
+
+/**
+ * Inner, the job of a future run by the pool.
+ */
+/* static */
+void
+Lisp::futureTask(size_t worker, size_t begin, size_t end, void *opaque)
+{
+  FutureTask *task = static_cast<FutureTask *>(opaque);
+  Lisp *w = task->worker;
+  int rc;
+  UNUSED(worker);
+  UNUSED(begin);
+  UNUSED(end);
+
+  SynNode *res = w->evalProcedure(task->func->object.u.OBJTYPE_FUNC.body, 0, 0, 0, rc);
+  int rc2 = w->flushOutput();
+  if (LP_SUCCESS(rc))
+    rc = rc2;
+
+  task->owner->m_pool->lock();
+  task->result = res;
+  task->rc = rc;
+  task->done = true;
+  task->owner->m_pool->unlock();
+}
+
+/**
+ * Inner, copy the chain of frames of a environment with the cells of
+ * values, the futures read the copy so that the variables defined or
+ * set by the owner afterwards are not shared. The variables and the
+ * values are shared.
+ * @param gc The heap to copy into.
+ * @param env Pointer to the environment.
+ * @param values Where to push the values, which the future may read.
+ * @param out Where to store the copy.
+ * @return status code.
+ */
+static int
+copyFrames(GC &gc, SynNode *env, NodeStack &values, __OUT SynNode **out)
+{
+  int rc = LINF_SUCCEEDED;
+  SynNode *head = 0, *tail = 0;
+  for (; env; env = OBJ_NEXT(env))
+    {
+      SynNode *frame = OBJ_LEAF(env), *cells = 0, *last = 0, *copy, *each;
+      for (SynNode *v = OBJ_NEXT(frame); v; v = OBJ_NEXT(v))
+        {
+          rc = gc.createPair(OBJ_LEAF(v), 0, &each);
+          if (LP_SUCCESS(rc))
+            rc = values.push(OBJ_LEAF(v));
+          UPDATE_RC(rc);
+          if (last)
+            OBJ_NEXT(last) = each;
+          else
+            cells = each;
+          last = each;
+        }
+      rc = gc.createPair(OBJ_LEAF(frame), cells, &copy);
+      UPDATE_RC(rc);
+      rc = gc.createPair(copy, 0, &each);
+      UPDATE_RC(rc);
+      if (tail)
+        OBJ_NEXT(tail) = each;
+      else
+        head = each;
+      tail = each;
+    }
+  *out = head;
+  return rc;
+}
+
+/**
+ * Inner, start a future on the pool. The objects the future may read
+ * (the procedure and the values of its environment) are frozen until
+ * all the futures are resolved, the others are not.
+ * @param func Pointer to the procedure of no parameter.
+ * @param out Where to store the task.
+ * @return status code.
+ */
+int
+Lisp::startFuture(SynNode *func, __OUT FutureTask **out)
+{
+  if (m_futureCount == m_futureSize)
+    {
+      size_t size = m_futureSize ? m_futureSize * 2 : 16;
+      FutureTask **futures = new (std::nothrow) FutureTask *[size];
+      if (!futures)
+        {
+          return LERR_ALLOC_MEMORY;
+        }
+      for (size_t i = 0; i < m_futureCount; i++)
+        futures[i] = m_futures[i];
+      if (m_futures)
+        delete [] m_futures;
+      m_futures = futures;
+      m_futureSize = size;
+    }
+
+  FutureTask *task = new (std::nothrow) FutureTask;
+  Lisp *w = new (std::nothrow) Lisp;
+  if (!task || !w)
+    {
+      delete task;
+      delete w;
+      return LERR_ALLOC_MEMORY;
+    }
+  if (!++m_futureSerial)
+    ++m_futureSerial; /* 0 is for the resolved */
+  task->serial = m_futureSerial;
+  task->owner = this;
+  task->worker = w;
+  task->handle = 0;
+  task->func = func;
+  task->result = 0;
+  task->rc = LINF_SUCCEEDED;
+  task->done = false;
+  task->line = task->column = 0;
+  task->message[0] = '\0';
+
+  w->m_parent = this;
+  w->m_parallelismSet = true; /* nested ones are sequential */
+  w->m_gc.setPrivate(true);
+  w->m_gc.setLimits(0, m_gc.hardLimit());
+  w->setOutputSink(holdOutput, task);
+  w->setErrorSink(holdError, task);
+  shareMeter(w);
+
+  /* the copy is in this heap, so that the future can not store into it */
+  SynNode *env = 0;
+  NodeStack reach;
+  int rc = copyFrames(m_gc, m_envstack.node(func->object.u.OBJTYPE_FUNC.envsp), reach, &env);
+  if (LP_SUCCESS(rc))
+    rc = reach.push(func);
+  if (LP_SUCCESS(rc))
+    rc = m_gc.freeze(reach);
+  if (LP_SUCCESS(rc))
+    {
+      /* counted before it runs, see takeFuel() */
+      w->m_envstack.adopt(env);
+      m_futures[m_futureCount++] = task;
+      rc = m_pool->submit(futureTask, task);
+      if (LP_FAILURE(rc))
+        m_futureCount--;
+    }
+  if (LP_FAILURE(rc))
+    {
+      if (!m_futureCount)
+        m_gc.thaw();
+      delete w;
+      delete task;
+      return rc;
+    }
+  *out = task;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, wait for a future, and resolve its handle with the result
+ * copied. The output held is written, and the error held is reported.
+ * @param index Index of the task.
+ * @param at Pointer to the node where to report the other errors.
+ * @param rc Reference to the status code.
+ * @return pointer to the result.
+ */
+SynNode*
+Lisp::resolveFuture(size_t index, SynNode *at, __OUT int &rc)
+{
+  FutureTask *task = m_futures[index];
+
+  m_pool->lock();
+  while (!task->done)
+    m_pool->waitDone();
+  m_pool->unlock();
+
+  SynNode *value = 0;
+  rc = m_output.append(task->output.buffer(), task->output.length());
+  if (LP_SUCCESS(rc) && m_output.length() >= m_outputThreshold)
+    rc = flushOutput();
+  if (LP_SUCCESS(rc))
+    {
+      rc = task->rc;
+      if (LP_FAILURE(rc))
+        {
+          flushOutput(); /* keep the order with the output */
+          if (task->message[0])
+            throwError(&m_errors, task->line, task->column, "%s", task->message);
+        }
+    }
+  if (LP_SUCCESS(rc))
+    {
+      rc = copyResult(gc(), &task->worker, 1, task->result, &value);
+      if (LERR_NOT_MATCHED == rc)
+        rc = throwErrorAt(at, "touch - the result can not be returned from a future.");
+    }
+
+  /* the other futures running may read the handle */
+  m_pool->lock();
+  task->handle->object.u.OBJTYPE_FUTURE.serial = 0;
+  task->handle->object.u.OBJTYPE_FUTURE.value = LP_SUCCESS(rc) ? value : 0;
+  task->handle->object.u.OBJTYPE_FUTURE.rc = rc;
+  m_pool->unlock();
+
+  /* keep the order of creating, see waitFutures() */
+  m_futureCount--;
+  for (size_t i = index; i < m_futureCount; i++)
+    m_futures[i] = m_futures[i + 1];
+  delete task->worker;
+  delete task;
+  if (!m_futureCount)
+    m_gc.thaw();
+  return LP_SUCCESS(rc) ? value : 0;
+}
+
+/**
+ * Inner, resolve all the futures at the end of a evaluation, so that
+ * none of them refers to the objects released afterwards. The errors
+ * of the ones not touched are reported in the order of creating, but
+ * do not fail the evaluation.
+ */
+void
+Lisp::waitFutures()
+{
+  while (m_futureCount)
+    {
+      int rc;
+      resolveFuture(0, 0, rc);
+    }
+}
+
+/**
+ * Evaluate a procedure of no parameter on the pool, the handle returned
+ * is resolved by touch. The objects it may read are read-only until the
+ * futures are resolved. The evaluation is in the calling thread if the
+ * parallelism is 0, or nested in a worker.
+ * (future [procedure])
+ */
+SynNode*
+Lisp::symbolFuture(SynNode *args, EnvSP envsp, __OUT int &rc)
+{
+  rc = validateSyntax(args, 2, "future");
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  SynNode *func = eval(OBJ_LEAF(OBJ_NEXT(args)), envsp, rc);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  if (!func || OBJTYPE_FUNC != func->object.type || func->object.u.OBJTYPE_FUNC.params)
+    {
+      rc = throwErrorAt(OBJ_LEAF(OBJ_NEXT(args)), "future - expected a procedure of no parameter.");
+      return 0;
+    }
+
+  SynNode *handle;
+  rc = gc()._createAtom(&handle);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  handle->object.type = OBJTYPE_FUTURE;
+  handle->object.u.OBJTYPE_FUTURE.serial = 0;
+  handle->object.u.OBJTYPE_FUTURE.value = 0;
+  handle->object.u.OBJTYPE_FUTURE.rc = LINF_SUCCEEDED;
+
+  if (!m_parent && LP_SUCCESS(startPool()))
+    {
+      FutureTask *task;
+      rc = startFuture(func, &task);
+      if (LP_FAILURE(rc))
+        {
+          return 0;
+        }
+      task->handle = handle;
+      handle->object.u.OBJTYPE_FUTURE.serial = task->serial;
+      return handle;
+    }
+
+  SynNode *value = evalProcedure(func->object.u.OBJTYPE_FUNC.body, 0, 0,
+                                 func->object.u.OBJTYPE_FUNC.envsp, rc);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  handle->object.u.OBJTYPE_FUTURE.value = value;
+  return handle;
+}
+
+/**
+ * Wait for a future and get its result, a future can be touched many
+ * times, but only by the instance creating it.
+ * (touch [future])
+ */
+SynNode*
+Lisp::symbolTouch(SynNode *args, EnvSP envsp, __OUT int &rc)
+{
+  rc = validateSyntax(args, 2, "touch");
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  SynNode *handle = eval(OBJ_LEAF(OBJ_NEXT(args)), envsp, rc);
+  if (LP_FAILURE(rc))
+    {
+      return 0;
+    }
+  if (!handle || OBJTYPE_FUTURE != handle->object.type)
+    {
+      rc = throwErrorAt(OBJ_LEAF(OBJ_NEXT(args)), "touch - expected a future.");
+      return 0;
+    }
+
+  /* the owner may resolve it meanwhile */
+  if (m_parent)
+    m_parent->m_pool->lock();
+  unsigned long serial = handle->object.u.OBJTYPE_FUTURE.serial;
+  SynNode *value = handle->object.u.OBJTYPE_FUTURE.value;
+  int result = handle->object.u.OBJTYPE_FUTURE.rc;
+  if (m_parent)
+    m_parent->m_pool->unlock();
+
+  if (serial)
+    {
+      for (size_t i = 0; i < m_futureCount; i++)
+        {
+          if (m_futures[i]->serial == serial)
+            return resolveFuture(i, OBJ_LEAF(OBJ_NEXT(args)), rc);
+        }
+      rc = throwErrorAt(OBJ_LEAF(OBJ_NEXT(args)), "touch - the future is of another thread.");
+      return 0;
+    }
+  if (LP_FAILURE(result))
+    {
+      rc = throwErrorAt(OBJ_LEAF(OBJ_NEXT(args)), "touch - the future failed.");
+      return 0;
+    }
+  rc = LINF_SUCCEEDED;
+  return value;
+}
+
+} // namespace DSL
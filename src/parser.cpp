@@ -1,419 +1,749 @@
-/** @file
- * LispDSL - Syntax parser & AST management.
- */
-
-/*
- *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
- *  please contact with <diyer175@hotmail.com> if you have any problems.
- *
- *  This project is free software; you can redistribute it and/or
- *  modify it under the terms of the GNU Lesser General Public License(GPL)
- *  as published by the Free Software Foundation; either version 2.1
- *  of the License, or (at your option) any later version.
- *
- *  This project is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
- *  Lesser General Public License for more details.
- */
-
-/*******************************************************************************
-*   Header Files                                                               *
-*******************************************************************************/
-#include "lispdsl.h"
-
-#define LEX_NEXT(n) n->m_next
-#define LEX_PREV(n) n->m_prev
-#define LEX_PREV2(n) LEX_PREV(LEX_PREV(n))
-#define LEX_PREV3(n) LEX_PREV(LEX_PREV2(n))
-
-#define LEX_SET_NEXT(n) n = LEX_NEXT(n)
-#define LEX_SET_PREV(n) n = LEX_PREV(n)
-
-namespace DSL {
-
-////////////////////////////////////////////////////////////////////////////////
-
-Parser::Parser(GC *gc)
-  : m_gc(gc),
-    m_lexlist(0),
-    m_lexlistTail(0),
-    m_ast(0)
-{
-}
-
-/**
- * Inner, process the list.
- * @param lexnode Reference to the pointer to the lexical node.
- * @param rc Where to store the status code.
- * @return 0 if failed.
- * @return pointer to the new syntax node.
- */
-SynNode *
-Parser::generateList(LexNode *& lexnode, __OUT int &rc)
-{
-  if (!(lexnode))
-    {
-      rc = Lisp::throwError(LEX_PREV(m_lexlistTail)->m_line, 0, "Parentheses do not match.");
-      return 0;
-    }
-  if (lexnode->m_type == LEX_CLOSE_PAREN)
-    {
-      /* nil list */
-      rc = LINF_SUCCEEDED;
-      return 0;
-    }
-  else
-    {
-      SynNode *n = 0;
-      SynNode *a = generate(lexnode, rc);
-      if (LP_SUCCESS(rc))
-        {
-          SynNode *b = generateList(lexnode, rc);
-          if (LP_SUCCESS(rc))
-            {
-              rc = gc().createPair(a, b, LEX_PREV(lexnode)->m_line, &n);
-            }
-        }
-      return n;
-    }
-  return 0;
-}
-
-/**
- * Inner, process the number.
- * @param lexnode Reference to the pointer to the lexical node.
- * @param rc Where to store the status code.
- * @return 0 if failed.
- * @return pointer to the new syntax node.
- */
-SynNode *
-Parser::generateNumber(LexNode *& lexnode, __OUT int &rc)
-{
-  SynNode *n;
-  double val;
-  const char *src = lexnode->m_word.buffer();
-
-  rc = parserNumberStr(src, &val);
-  if (LP_SUCCESS(rc))
-    {
-      createAtom(gc(), OBJTYPE_NUMBER, n, val, lexnode->m_line, rc);
-      if (LP_SUCCESS(rc))
-        {
-          return n;
-        }
-    }
-  return 0;
-}
-
-/**
- * Inner, process the string.
- * @param lexnode Reference to the pointer to the lexical node.
- * @param rc Where to store the status code.
- * @return 0 if failed.
- * @return pointer to the new syntax node.
- */
-SynNode *
-Parser::generateString(LexNode *& lexnode, __OUT int &rc)
-{
-  size_t length = lexnode->m_word.length();
-  const char *word = lexnode->m_word.buffer();
-
-  /* check the lexicon */
-  if (word[0] != '"' || word[length-1] != '"')
-    {
-      rc = Lisp::throwError(lexnode->m_line, 0, "String format mismatch.");
-      return 0;
-    }
-
-  SynNode *n;
-  StringPool *pool = new (std::nothrow) StringPool;
-  if (pool)
-    {
-      rc = pool->copy(word + 1, length -2/*remove '\"' char */);
-      if (LP_SUCCESS(rc))
-        {
-          createAtom(gc(), OBJTYPE_STRING, n, pool, lexnode->m_line, rc);
-          if (LP_SUCCESS(rc))
-            {
-              return n;
-            }
-        }
-    }
-  else
-    rc = LERR_ALLOC_MEMORY;
-  return 0;
-}
-
-/**
- * Inner, process the symbol.
- * @param lexnode Reference to the pointer to the lexical node.
- * @param rc Where to store the status code.
- * @return 0 if failed.
- * @return pointer to the new syntax node.
- */
-SynNode *
-Parser::generateSymbol(LexNode *& lexnode, __OUT int &rc)
-{
-  SynNode *n;
-  StringPool *pool = new (std::nothrow) StringPool;
-  if (pool)
-    {
-      rc = pool->copy(lexnode->m_word);
-      if (LP_SUCCESS(rc))
-        {
-          createAtom(gc(), OBJTYPE_SYMBOL, n, pool, lexnode->m_line, rc);
-          if (LP_SUCCESS(rc))
-            {
-              return n;
-            }
-        }
-    }
-  else
-    rc = LERR_ALLOC_MEMORY;
-  return 0;
-}
-
-/**
- * Inner, process the boolean.
- * @param lexnode Reference to the pointer to the lexical node.
- * @param rc Where to store the status code.
- * @return 0 if failed.
- * @return pointer to the new syntax node.
- */
-SynNode *
-Parser::generateBoolean(LexNode *& lexnode, __OUT int &rc)
-{
-  SynNode *n = 0;
-  const char *word = lexnode->m_word.buffer();
-  if (word[0] != '#') {
-    rc = Lisp::throwError(lexnode->m_line, 0, "Not a boolean value.");
-    return 0;
-  }
-  if (word[1] == 't' || word[1] == 'T')
-    {
-      createAtom(gc(), OBJTYPE_BOOLEAN, n, true, lexnode->m_line, rc);
-    }
-  else if (word[1] == 'f' || word[1] == 'F')
-    {
-      createAtom(gc(), OBJTYPE_BOOLEAN, n, false, lexnode->m_line, rc);
-    }
-  else
-    {
-      rc = Lisp::throwError(lexnode->m_line, 0, "Not a boolean value.");
-    }
-  return LP_SUCCESS(rc) ? n : 0;
-}
-
-/**
- * Inner, process the character.
- * @param lexnode Reference to the pointer to the lexical node.
- * @param rc Where to store the status code.
- * @return 0 if failed.
- * @return pointer to the new syntax node.
- */
-SynNode *
-Parser::generateCharacter(LexNode *& lexnode, __OUT int &rc)
-{
-  const char *word = lexnode->m_word.buffer();
-  if (word[0] != '\'' || word[2] != '\'' || lexnode->m_word.length() != 3)
-    {
-      rc = Lisp::throwError(lexnode->m_line, 0, "Invalid syntax of character.");
-      return 0;
-    }
-  SynNode *n;
-  createAtom(gc(), OBJTYPE_CHARACTER, n, word[1], lexnode->m_line, rc);
-  if (LP_SUCCESS(rc))
-    {
-      return n;
-    }
-  return 0;
-}
-
-/**
- * Inner, generate the ast.
- * @param lexnode Pointer to the current lexical node.
- * @param nextnode Where to store the next node.
- * @return status code.
- */
-SynNode *
-Parser::generate(LexNode *& lexnode, __OUT int &rc)
-{
-  SynNode *node = 0;
-  switch (lexnode->m_type)
-  {
-    case LEX_OPEN_PAREN:
-      {
-        LEX_SET_NEXT(lexnode);
-        node = generateList(lexnode, rc);
-        break;
-      }
-    case LEX_STRING:
-      {
-        node = generateString(lexnode, rc);
-        break;
-      }
-    case LEX_MISC:
-      {
-        switch (lexnode->m_word.buffer()[0])
-        {
-          case '#':
-            {
-              node = generateBoolean(lexnode, rc);
-              break;
-            }
-          case '\'':
-            {
-              node = generateCharacter(lexnode, rc);
-              break;
-            }
-          default:
-            {
-              const char *word = lexnode->m_word.buffer();
-
-              if (((word[0] == '.') || word[0] == '+' || word[0] == '-')
-                  && (IsDigit(word[1]) || word[1] == '.') )
-                {
-                  /* signed number */
-                  node = generateNumber(lexnode, rc);
-                  break;
-                }
-              else if (IsDigit(word[0]))
-                {
-                  /* number */
-                  node = generateNumber(lexnode, rc);
-                  break;
-                }
-              else
-                {
-                  /* symbol */
-                  node = generateSymbol(lexnode, rc);
-                  break;
-                }
-            }
-        }
-        break;
-      }
-
-    default:
-      LOG(ERROR) << "invalid lexicon: type = (" << lexnode->m_type << ")\n";
-      rc = LERR_INVALID_LEX;
-      return 0;
-    }
-
-  if (LP_SUCCESS(rc))
-    {
-      LEX_SET_NEXT(lexnode);
-    }
-
-  return node;
-}
-
-
-static void
-dumpNode(SynNode *node, int nest)
-{
-  objData *dat = &node->object;
-
-  /* trunk leading */
-  for (int i = 0; i < nest; i++)
-    LOG(VERBOSE) << " ";
-  LOG(VERBOSE) << "|-";
-
-  LOG(VERBOSE) << "(" << nest << ")NODE: type = " << dat->type << "\n";
-
-  while(node)
-    {
-      /* leaf leading */
-      for (int i = 0; i < nest; i++)
-          LOG(VERBOSE) << " ";
-        LOG(VERBOSE) << "|l";
-
-      dat = &node->object;
-
-      switch(node->object.type)
-        {
-          case OBJTYPE_PAIR:
-            {
-              LOG(VERBOSE) << "\n";
-              if (OBJ_LEAF(node))
-                {
-                  dumpNode(OBJ_LEAF(node), nest + 1);
-                }
-              if (OBJ_NEXT(node))
-                {
-                  node = OBJ_NEXT(node);
-                  continue;
-                }
-            }
-            break;
-
-          case OBJTYPE_NUMBER:
-            {
-              LOG(VERBOSE) << "number = " << dat->u.OBJTYPE_NUMBER.v;
-            }
-            break;
-          case OBJTYPE_STRING:
-            {
-              LOG(VERBOSE) << "string = \"" << dat->u.OBJTYPE_STRING.v->buffer() << "\"";
-            }
-            break;
-          case OBJTYPE_BOOLEAN:
-            {
-              LOG(VERBOSE) << "boolean = " << (dat->u.OBJTYPE_BOOLEAN.v ? "true" : "false");
-            }
-            break;
-          case OBJTYPE_CHARACTER:
-            {
-              LOG(VERBOSE) << "character = " << dat->u.OBJTYPE_CHARACTER.v;
-            }
-            break;
-          case OBJTYPE_SYMBOL:
-            {
-              LOG(VERBOSE) << "symbol = " << dat->u.OBJTYPE_SYMBOL.v->buffer();
-            }
-            break;
-
-          default:
-            LOG(VERBOSE) << "(unknown)";
-        }
-
-      LOG(VERBOSE) << "\n";
-      break;
-    }
-}
-
-/**
- * Dump the AST.
- */
-void
-Parser::dumpast()
-{
-  dumpNode(m_ast, 0);
-}
-
-/**
- * Parser the lexical list and generate the AST.
- * @param root Pointer the root of lexical list.
- * @param tail Pointer to the tail of lexical list.
- * @return status code.
- */
-int
-Parser::parse(LexNode *root, LexNode *tail)
-{
-  int rc;
-  SynNode *node;
-
-  m_lexlist = root;
-  m_lexlistTail = tail;
-  //!todo: delete the original list if needed
-
-  node = generate(root, rc);
-  if (LP_SUCCESS(rc))
-    {
-      m_ast = node;
-    }
-  return rc;
-}
-
-} // namespace DSL
+/** @file
+ * LispDSL - Syntax parser & AST management.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+Parser::Parser(GC *gc, SourceMap *srcmap)
+  : m_gc(gc),
+    m_srcmap(srcmap),
+    m_lexer(0),
+    m_ast(0),
+    m_frames(0),
+    m_depth(0),
+    m_maxdepth(0),
+    m_consing(false),
+    m_errors(0)
+{
+}
+
+Parser::~Parser()
+{
+  if (m_frames)
+    delete [] m_frames;
+}
+
+/**
+ * Inner, record the position of a node generated.
+ * @param node Pointer to the node.
+ * @param line The number of line.
+ * @param column The number of column.
+ * @return status code.
+ */
+int
+Parser::locate(SynNode *node, file_off line, file_off column)
+{
+  if (!m_srcmap || !node)
+    return LINF_SUCCEEDED;
+  return m_srcmap->add(node, line, column);
+}
+
+/**
+ * Inner, open a new list frame on the top of parsing stack.
+ * @param line The number of line where the list begins.
+ * @param column The number of column where the list begins.
+ * @return status code.
+ */
+int
+Parser::pushFrame(file_off line, file_off column)
+{
+  if (m_depth == m_maxdepth)
+    {
+      size_t newsize = m_maxdepth ? m_maxdepth * 2 : 32;
+      ParseFrame *frames = new (std::nothrow) ParseFrame[newsize];
+      if (!frames)
+        {
+          return LERR_ALLOC_MEMORY;
+        }
+      if (m_frames)
+        {
+          memcpy(frames, m_frames, m_depth * sizeof(ParseFrame));
+          delete [] m_frames;
+        }
+      m_frames = frames;
+      m_maxdepth = newsize;
+    }
+
+  bool data = quotedContext();
+
+  ParseFrame *frame = &m_frames[m_depth++];
+  frame->head = 0;
+  frame->tail = 0;
+  frame->line = line;
+  frame->column = column;
+  frame->count = 0;
+  frame->data = data;
+  frame->base = m_elements.count();
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, resolve whether the element being parsed is quoted data,
+ * which is immutable and may be shared if hash-consing is enabled.
+ * @return true if yes.
+ */
+bool
+Parser::quotedContext()
+{
+  if (!m_consing || m_depth == 0)
+    return false;
+
+  ParseFrame *frame = &m_frames[m_depth - 1];
+  if (frame->data)
+    return true;
+
+  /* the operand of (quote [expression]) */
+  if (frame->count == 1)
+    {
+      SynNode *sym = OBJ_LEAF(frame->head);
+      return sym && OBJTYPE_SYMBOL == sym->object.type
+             && OBJ_VALUE(OBJTYPE_SYMBOL, sym)->compare("quote") == 0;
+    }
+  return false;
+}
+
+/**
+ * Inner, lookup a constant parsed before, see ConsTable::lookup().
+ * The constant found is shaded for the incremental marking, as it may
+ * be no longer reachable when the marking started, see GC::shade().
+ * @param type Type of the key.
+ * @param data Pointer to the value of key.
+ * @param len Length of the value.
+ * @param hash Where to store the hash of key.
+ * @return 0 if not found.
+ * @return pointer to the shared node.
+ */
+SynNode *
+Parser::lookupConst(objType type, const void *data, size_t len, __OUT size_t *hash)
+{
+  SynNode *node = m_consts.lookup(type, data, len, hash);
+  gc().shade(node);
+  return node;
+}
+
+/**
+ * Inner, build the list of quoted data from the elements on the stack.
+ * The pairs are consed from the tail, so that each of them is shared with
+ * the equal one parsed before, if any.
+ * @param frame Pointer to the completed frame.
+ * @param rc Where to store the status code.
+ * @return pointer to the list, 0 if nil.
+ */
+SynNode *
+Parser::generateData(ParseFrame *frame, __OUT int &rc)
+{
+  SynNode *list = 0;
+
+  rc = LINF_SUCCEEDED;
+  for (size_t i = m_elements.count(); i > frame->base; i--)
+    {
+      SynNode *pair[2];
+      size_t hash;
+
+      pair[0] = m_elements[i - 1];
+      pair[1] = list;
+
+      SynNode *n = lookupConst(OBJTYPE_PAIR, pair, sizeof(pair), &hash);
+      if (!n)
+        {
+          rc = gc().createPair(pair[0], pair[1], &n);
+          if (LP_SUCCESS(rc))
+            rc = m_consts.insert(n, hash);
+          if (LP_SUCCESS(rc))
+            rc = locate(n, frame->line, frame->column);
+          if (LP_FAILURE(rc))
+            break;
+        }
+      list = n;
+    }
+  m_elements.truncate(frame->base);
+  return list;
+}
+
+/**
+ * Inner, process the number.
+ * @param lexnode Reference to the pointer to the lexical node.
+ * @param rc Where to store the status code.
+ * @return 0 if failed.
+ * @return pointer to the new syntax node.
+ */
+SynNode *
+Parser::generateNumber(LexNode *lexnode, __OUT int &rc)
+{
+  SynNode *n;
+  double val;
+  const char *src = lexnode->m_word.buffer();
+
+  rc = parserNumberStr(src, &val);
+  if (LP_SUCCESS(rc))
+    {
+      size_t hash;
+      if (m_consing && (n = lookupConst(OBJTYPE_NUMBER, &val, sizeof(val), &hash)))
+        {
+          return n;
+        }
+      createAtom(gc(), OBJTYPE_NUMBER, n, val, rc);
+      if (LP_SUCCESS(rc) && m_consing)
+        {
+          rc = m_consts.insert(n, hash);
+        }
+      if (LP_SUCCESS(rc))
+        {
+          return n;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Inner, process the string.
+ * @param lexnode Reference to the pointer to the lexical node.
+ * @param rc Where to store the status code.
+ * @return 0 if failed.
+ * @return pointer to the new syntax node.
+ */
+SynNode *
+Parser::generateString(LexNode *lexnode, __OUT int &rc)
+{
+  size_t length = lexnode->m_word.length();
+  const char *word = lexnode->m_word.buffer();
+
+  /* check the lexicon */
+  if (word[0] != '"' || word[length-1] != '"')
+    {
+      rc = Lisp::throwError(m_errors, lexnode->m_line, lexnode->m_column, "String format mismatch.");
+      return 0;
+    }
+
+  SynNode *n;
+  size_t hash;
+  if (m_consing && (n = lookupConst(OBJTYPE_STRING, word + 1, length - 2, &hash)))
+    {
+      rc = LINF_SUCCEEDED;
+      return n;
+    }
+
+  ImmString *str;
+  rc = gc().createString(word + 1, length -2/*remove '\"' char */, &str);
+  if (LP_SUCCESS(rc))
+    {
+      createAtom(gc(), OBJTYPE_STRING, n, str, rc);
+      if (LP_FAILURE(rc))
+        {
+          return 0;
+        }
+      if (m_consing)
+        {
+          rc = m_consts.insert(n, hash);
+        }
+      if (LP_SUCCESS(rc))
+        {
+          return n;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Inner, process the symbol.
+ * @param lexnode Reference to the pointer to the lexical node.
+ * @param rc Where to store the status code.
+ * @return 0 if failed.
+ * @return pointer to the new syntax node.
+ */
+SynNode *
+Parser::generateSymbol(LexNode *lexnode, __OUT int &rc)
+{
+  SynNode *n;
+  size_t hash;
+
+  /*
+   * Only the symbols in quoted data are shared, the ones in code
+   * keep their own node for locating the errors.
+   */
+  bool shared = quotedContext();
+  if (shared && (n = lookupConst(OBJTYPE_SYMBOL, lexnode->m_word.buffer(),
+                                     lexnode->m_word.length(), &hash)))
+    {
+      rc = LINF_SUCCEEDED;
+      return n;
+    }
+
+  ImmString *str;
+  rc = gc().createString(lexnode->m_word.buffer(), lexnode->m_word.length(), &str);
+  if (LP_SUCCESS(rc))
+    {
+      createAtom(gc(), OBJTYPE_SYMBOL, n, str, rc);
+      if (LP_FAILURE(rc))
+        {
+          return 0;
+        }
+      if (shared)
+        {
+          rc = m_consts.insert(n, hash);
+        }
+      if (LP_SUCCESS(rc))
+        {
+          return n;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Inner, process the boolean.
+ * @param lexnode Reference to the pointer to the lexical node.
+ * @param rc Where to store the status code.
+ * @return 0 if failed.
+ * @return pointer to the new syntax node.
+ */
+SynNode *
+Parser::generateBoolean(LexNode *lexnode, __OUT int &rc)
+{
+  SynNode *n = 0;
+  bool val;
+  size_t hash;
+  const char *word = lexnode->m_word.buffer();
+  if (word[0] != '#') {
+    rc = Lisp::throwError(m_errors, lexnode->m_line, lexnode->m_column, "Not a boolean value.");
+    return 0;
+  }
+  if (word[1] == 't' || word[1] == 'T')
+    {
+      val = true;
+    }
+  else if (word[1] == 'f' || word[1] == 'F')
+    {
+      val = false;
+    }
+  else
+    {
+      rc = Lisp::throwError(m_errors, lexnode->m_line, lexnode->m_column, "Not a boolean value.");
+      return 0;
+    }
+  if (m_consing && (n = lookupConst(OBJTYPE_BOOLEAN, &val, sizeof(val), &hash)))
+    {
+      rc = LINF_SUCCEEDED;
+      return n;
+    }
+  createAtom(gc(), OBJTYPE_BOOLEAN, n, val, rc);
+  if (LP_SUCCESS(rc) && m_consing)
+    {
+      rc = m_consts.insert(n, hash);
+    }
+  return LP_SUCCESS(rc) ? n : 0;
+}
+
+/**
+ * Inner, process the character.
+ * @param lexnode Reference to the pointer to the lexical node.
+ * @param rc Where to store the status code.
+ * @return 0 if failed.
+ * @return pointer to the new syntax node.
+ */
+SynNode *
+Parser::generateCharacter(LexNode *lexnode, __OUT int &rc)
+{
+  const char *word = lexnode->m_word.buffer();
+  if (word[0] != '\'' || word[2] != '\'' || lexnode->m_word.length() != 3)
+    {
+      rc = Lisp::throwError(m_errors, lexnode->m_line, lexnode->m_column, "Invalid syntax of character.");
+      return 0;
+    }
+  SynNode *n;
+  size_t hash;
+  if (m_consing && (n = lookupConst(OBJTYPE_CHARACTER, &word[1], 1, &hash)))
+    {
+      rc = LINF_SUCCEEDED;
+      return n;
+    }
+  createAtom(gc(), OBJTYPE_CHARACTER, n, word[1], rc);
+  if (LP_SUCCESS(rc) && m_consing)
+    {
+      rc = m_consts.insert(n, hash);
+    }
+  if (LP_SUCCESS(rc))
+    {
+      return n;
+    }
+  return 0;
+}
+
+/**
+ * Inner, process the atom.
+ * @param lexnode Pointer to the current lexical node.
+ * @param rc Where to store the status code.
+ * @return 0 if failed.
+ * @return pointer to the new syntax node.
+ */
+SynNode *
+Parser::generateAtom(LexNode *lexnode, __OUT int &rc)
+{
+  SynNode *node = 0;
+  switch (lexnode->m_type)
+  {
+    case LEX_STRING:
+      {
+        node = generateString(lexnode, rc);
+        break;
+      }
+    case LEX_MISC:
+      {
+        switch (lexnode->m_word.buffer()[0])
+        {
+          case '#':
+            {
+              node = generateBoolean(lexnode, rc);
+              break;
+            }
+          case '\'':
+            {
+              node = generateCharacter(lexnode, rc);
+              break;
+            }
+          default:
+            {
+              const char *word = lexnode->m_word.buffer();
+
+              if (((word[0] == '.') || word[0] == '+' || word[0] == '-')
+                  && (IsDigit(word[1]) || word[1] == '.') )
+                {
+                  /* signed number */
+                  node = generateNumber(lexnode, rc);
+                  break;
+                }
+              else if (IsDigit(word[0]))
+                {
+                  /* number */
+                  node = generateNumber(lexnode, rc);
+                  break;
+                }
+              else
+                {
+                  /* symbol */
+                  node = generateSymbol(lexnode, rc);
+                  break;
+                }
+            }
+        }
+        break;
+      }
+
+    default:
+      LOG(ERROR) << "invalid lexicon: type = (" << lexnode->m_type << ")\n";
+      rc = LERR_INVALID_LEX;
+      return 0;
+    }
+
+  return node;
+}
+
+/**
+ * Inner, generate the ast.
+ * The lists are built on an explicit stack of frames, by appending the
+ * elements at the tail, so the depth of parsing is bounded by the nesting
+ * of lists rather than the number of elements.
+ * @param lexnode Pointer to the current lexical node.
+ * @param rc Where to store the status code.
+ * @return pointer to the new syntax node.
+ */
+SynNode *
+Parser::generate(LexNode *lexnode, __OUT int &rc)
+{
+  SynNode *node;
+  SynNode *pair;
+  file_off line, column;
+
+  m_depth = 0;
+
+  for (;;)
+    {
+      if (!lexnode)
+        {
+          rc = Lisp::throwError(m_errors, m_lexer->line(), 0, "Parentheses do not match.");
+          break;
+        }
+
+      line = lexnode->m_line;
+      column = lexnode->m_column;
+
+      if (lexnode->m_type == LEX_OPEN_PAREN)
+        {
+          rc = pushFrame(line, column);
+          if (LP_FAILURE(rc))
+            break;
+        }
+      else
+        {
+          if (lexnode->m_type == LEX_CLOSE_PAREN)
+            {
+              if (m_depth == 0)
+                {
+                  rc = Lisp::throwError(m_errors, line, column, "Parentheses do not match.");
+                  break;
+                }
+              /* the list is completed, nil if empty */
+              ParseFrame *frame = &m_frames[--m_depth];
+              line = frame->line;
+              column = frame->column;
+              rc = LINF_SUCCEEDED;
+              if (frame->data)
+                {
+                  node = generateData(frame, rc);
+                  if (LP_FAILURE(rc))
+                    break;
+                }
+              else
+                node = frame->head;
+            }
+          else
+            {
+              node = generateAtom(lexnode, rc);
+              if (LP_SUCCESS(rc))
+                rc = locate(node, line, column);
+              if (LP_FAILURE(rc))
+                break;
+            }
+
+          if (m_depth == 0)
+            {
+              return node; /* top level */
+            }
+
+          /*
+           * append to the list under construction
+           */
+          ParseFrame *frame = &m_frames[m_depth - 1];
+          if (frame->data)
+            {
+              rc = m_elements.push(node);
+              if (LP_FAILURE(rc))
+                break;
+            }
+          else
+            {
+              /* the head of list is located at its open parenthesis */
+              rc = gc().createPair(node, 0, &pair);
+              if (LP_SUCCESS(rc))
+                rc = frame->tail ? locate(pair, line, column)
+                                 : locate(pair, frame->line, frame->column);
+              if (LP_FAILURE(rc))
+                break;
+              if (frame->tail)
+                OBJ_NEXT(frame->tail) = pair;
+              else
+                frame->head = pair;
+              frame->tail = pair;
+            }
+          frame->count++;
+        }
+
+      rc = m_lexer->next(&lexnode);
+      if (LP_FAILURE(rc))
+        break;
+    }
+
+  m_depth = 0;
+  m_elements.clear();
+  return 0;
+}
+
+
+static void
+dumpNode(SynNode *node, int nest)
+{
+  objData *dat = &node->object;
+
+  /* trunk leading */
+  for (int i = 0; i < nest; i++)
+    LOG(INFO) << " ";
+  LOG(INFO) << "|-";
+
+  LOG(INFO) << "(" << nest << ")NODE: type = " << dat->type << "\n";
+
+  while(node)
+    {
+      /* leaf leading */
+      for (int i = 0; i < nest; i++)
+          LOG(INFO) << " ";
+        LOG(INFO) << "|l";
+
+      dat = &node->object;
+
+      switch(node->object.type)
+        {
+          case OBJTYPE_PAIR:
+            {
+              LOG(INFO) << "\n";
+              if (OBJ_LEAF(node))
+                {
+                  dumpNode(OBJ_LEAF(node), nest + 1);
+                }
+              if (OBJ_NEXT(node))
+                {
+                  node = OBJ_NEXT(node);
+                  continue;
+                }
+            }
+            break;
+
+          case OBJTYPE_NUMBER:
+            {
+              LOG(INFO) << "number = " << dat->u.OBJTYPE_NUMBER.v;
+            }
+            break;
+          case OBJTYPE_STRING:
+            {
+              LOG(INFO) << "string = \"" << dat->u.OBJTYPE_STRING.v->buffer() << "\"";
+            }
+            break;
+          case OBJTYPE_BOOLEAN:
+            {
+              LOG(INFO) << "boolean = " << (dat->u.OBJTYPE_BOOLEAN.v ? "true" : "false");
+            }
+            break;
+          case OBJTYPE_CHARACTER:
+            {
+              LOG(INFO) << "character = " << dat->u.OBJTYPE_CHARACTER.v;
+            }
+            break;
+          case OBJTYPE_SYMBOL:
+            {
+              LOG(INFO) << "symbol = " << dat->u.OBJTYPE_SYMBOL.v->buffer();
+            }
+            break;
+
+          default:
+            LOG(INFO) << "(unknown)";
+        }
+
+      LOG(INFO) << "\n";
+      break;
+    }
+}
+
+/**
+ * Dump the AST.
+ */
+void
+Parser::dumpast()
+{
+  dumpNode(m_ast, 0);
+}
+
+/**
+ * Enable or disable the hash-consing of immutable constants.
+ * When enabled, equal numbers, strings, characters, booleans and quoted
+ * data share one node, along with the position of their first appearance.
+ * Note that a mutation of a quoted constant (such as set-car!) becomes
+ * visible at all the places it appears.
+ * @param enable Whether to enable it.
+ */
+void
+Parser::setHashConsing(bool enable)
+{
+  m_consing = enable;
+}
+
+/**
+ * Forget the shared constants rejected by the filter, for example the
+ * ones whose memory is to be released. See ConsTable::retain().
+ * @param pfn Pointer to the filter, called with the node.
+ * @param opaque The pointer passed to the filter.
+ * @return status code.
+ */
+int
+Parser::retainConsts(pfnRetainKey pfn, void *opaque)
+{
+  return m_consts.retain(pfn, opaque);
+}
+
+/**
+ * Forget the constants rejected by the filter in steps, see
+ * ConsTable::retainSome().
+ */
+bool
+Parser::retainSomeConsts(pfnRetainKey pfn, void *opaque, RetainCursor *at, size_t steps)
+{
+  return m_consts.retainSome(pfn, opaque, at, steps);
+}
+
+/**
+ * Pull the lexicons of the next top-level expression and generate its AST.
+ * No lexicon beyond the end of the expression is read, so that the caller
+ * can evaluate it before the remainder of stream becomes available.
+ * @param lexer Pointer to the lexer attached to the source.
+ * @param out Where to store the root node of expression.
+ * @return LINF_END_OF_STREAM if there is no more expression.
+ * @return status code.
+ */
+int
+Parser::parseNext(Lexer *lexer, __OUT SynNode **out)
+{
+  int rc;
+  LexNode *lexnode;
+
+  m_lexer = lexer;
+  *out = 0;
+
+  rc = m_lexer->next(&lexnode);
+  if (LP_FAILURE(rc))
+    {
+      return rc;
+    }
+  if (!lexnode)
+    {
+      return LINF_END_OF_STREAM;
+    }
+  *out = generate(lexnode, rc);
+  return rc;
+}
+
+/**
+ * Pull the lexicons from the lexer and generate the AST.
+ * @param lexer Pointer to the lexer attached to the source.
+ * @return status code.
+ */
+int
+Parser::parse(Lexer *lexer)
+{
+  int rc;
+  SynNode *node;
+
+  rc = parseNext(lexer, &node);
+  if (rc == LINF_END_OF_STREAM)
+    {
+      rc = LINF_SUCCEEDED; /* empty source */
+    }
+  if (LP_SUCCESS(rc))
+    {
+      m_ast = node;
+    }
+  return rc;
+}
+
+} // namespace DSL
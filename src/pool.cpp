@@ -0,0 +1,338 @@
+/** @file
+ * LispDSL - Work-stealing thread pool.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+TaskPool::TaskPool()
+  : m_workers(0),
+    m_count(0),
+    m_task(0),
+    m_opaque(0),
+    m_pending(0),
+    m_generation(0),
+    m_stopping(false),
+    m_jobs(0),
+    m_jobHead(0),
+    m_jobCount(0),
+    m_jobSize(0)
+{
+  pthread_mutex_init(&m_lock, 0);
+  pthread_cond_init(&m_wake, 0);
+  pthread_cond_init(&m_done, 0);
+}
+
+TaskPool::~TaskPool()
+{
+  stop();
+  pthread_cond_destroy(&m_done);
+  pthread_cond_destroy(&m_wake);
+  pthread_mutex_destroy(&m_lock);
+}
+
+/**
+ * Start the worker threads.
+ * @param threads Number of the threads.
+ * @return status code.
+ */
+int
+TaskPool::start(size_t threads)
+{
+  if (m_workers || !threads)
+    {
+      return LERR_FAILED;
+    }
+  m_workers = new (std::nothrow) TaskWorker[threads];
+  if (!m_workers)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+
+  /* the threads look into all the queues, prepare them first */
+  for (size_t i = 0; i < threads; i++)
+    {
+      TaskWorker *w = &m_workers[i];
+      w->pool = this;
+      w->index = i;
+      w->queue = 0;
+      w->head = w->tail = 0;
+      pthread_mutex_init(&w->lock, 0);
+    }
+  m_count = threads;
+  m_stopping = false;
+
+  for (size_t i = 0; i < threads; i++)
+    {
+      if (pthread_create(&m_workers[i].thread, 0, threadMain, &m_workers[i]))
+        {
+          /* the ones created are waiting for the first run */
+          for (size_t j = i; j < threads; j++)
+            pthread_mutex_destroy(&m_workers[j].lock);
+          m_count = i;
+          stop();
+          return LERR_FAILED;
+        }
+    }
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Stop and join the worker threads.
+ */
+void
+TaskPool::stop()
+{
+  if (!m_workers)
+    return;
+
+  pthread_mutex_lock(&m_lock);
+  m_stopping = true;
+  pthread_cond_broadcast(&m_wake);
+  pthread_mutex_unlock(&m_lock);
+
+  /* the others may still look into the queue of a joined one */
+  for (size_t i = 0; i < m_count; i++)
+    pthread_join(m_workers[i].thread, 0);
+  for (size_t i = 0; i < m_count; i++)
+    pthread_mutex_destroy(&m_workers[i].lock);
+  delete [] m_workers;
+  m_workers = 0;
+  m_count = 0;
+
+  /* the jobs not started are dropped */
+  delete [] m_jobs;
+  m_jobs = 0;
+  m_jobHead = m_jobCount = m_jobSize = 0;
+}
+
+/**
+ * Inner, take a range from the own queue, or steal one from the others.
+ * @param worker Pointer to the worker.
+ * @param out Where to store the range.
+ * @return false if all the queues are empty.
+ */
+bool
+TaskPool::take(TaskWorker *worker, __OUT TaskRange *out)
+{
+  for (size_t i = 0; i < m_count; i++)
+    {
+      TaskWorker *victim = &m_workers[(worker->index + i) % m_count];
+      bool found = false;
+
+      pthread_mutex_lock(&victim->lock);
+      if (victim->head < victim->tail)
+        {
+          /* the latest of its own, which is likely in cache */
+          if (victim == worker)
+            *out = victim->queue[--victim->tail];
+          else
+            *out = victim->queue[victim->head++];
+          found = true;
+        }
+      pthread_mutex_unlock(&victim->lock);
+      if (found)
+        return true;
+    }
+  return false;
+}
+
+/**
+ * Inner, the loop of the worker threads.
+ * @param arg Pointer to the TaskWorker.
+ */
+/* static */
+void *
+TaskPool::threadMain(void *arg)
+{
+  TaskWorker *worker = static_cast<TaskWorker *>(arg);
+  TaskPool *pool = worker->pool;
+  unsigned long seen = 0;
+
+  for (;;)
+    {
+      pthread_mutex_lock(&pool->m_lock);
+      while (!pool->m_stopping && pool->m_generation == seen && !pool->m_jobCount)
+        pthread_cond_wait(&pool->m_wake, &pool->m_lock);
+      if (pool->m_stopping)
+        {
+          pthread_mutex_unlock(&pool->m_lock);
+          break;
+        }
+      if (pool->m_jobCount)
+        {
+          TaskJob job = pool->m_jobs[pool->m_jobHead];
+          pool->m_jobHead = (pool->m_jobHead + 1) % pool->m_jobSize;
+          pool->m_jobCount--;
+          pthread_mutex_unlock(&pool->m_lock);
+
+          job.pfn(worker->index, 0, 0, job.opaque);
+
+          pthread_mutex_lock(&pool->m_lock);
+          pthread_cond_broadcast(&pool->m_done);
+          pthread_mutex_unlock(&pool->m_lock);
+          continue;
+        }
+      seen = pool->m_generation;
+      pthread_mutex_unlock(&pool->m_lock);
+
+      /* all the ranges were queued before waking, none is missed */
+      TaskRange range;
+      while (pool->take(worker, &range))
+        {
+          /*
+           * The task is read after taking, as a late worker may take the
+           * ranges of the next run, which can not finish without them.
+           */
+          pthread_mutex_lock(&pool->m_lock);
+          pfnTask task = pool->m_task;
+          void *opaque = pool->m_opaque;
+          pthread_mutex_unlock(&pool->m_lock);
+
+          task(worker->index, range.begin, range.end, opaque);
+
+          pthread_mutex_lock(&pool->m_lock);
+          if (--pool->m_pending == 0)
+            pthread_cond_broadcast(&pool->m_done);
+          pthread_mutex_unlock(&pool->m_lock);
+        }
+    }
+  return 0;
+}
+
+/**
+ * Run a task on the indexes [0, count) with the worker threads, and
+ * wait for all of them. The indexes are divided into ranges of grain,
+ * which are dealt to the workers in turn at first.
+ * @param count Number of the indexes.
+ * @param grain Number of the indexes in each range.
+ * @param pfn Pointer to the task.
+ * @param opaque The pointer passed to the task.
+ * @return status code.
+ */
+int
+TaskPool::run(size_t count, size_t grain, pfnTask pfn, void *opaque)
+{
+  if (!m_workers)
+    {
+      return LERR_FAILED;
+    }
+  if (!count)
+    {
+      return LINF_SUCCEEDED;
+    }
+  if (!grain)
+    grain = 1;
+
+  size_t ranges = (count + grain - 1) / grain;
+  size_t each = (ranges + m_count - 1) / m_count;
+  TaskRange *queues = new (std::nothrow) TaskRange[each * m_count];
+  if (!queues)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+
+  /* a worker may still be looking for the ranges of the last run */
+  for (size_t i = 0; i < m_count; i++)
+    {
+      TaskWorker *w = &m_workers[i];
+      pthread_mutex_lock(&w->lock);
+      w->queue = queues + i * each;
+      w->head = w->tail = 0;
+      for (size_t r = i; r < ranges; r += m_count)
+        {
+          TaskRange *range = &w->queue[w->tail++];
+          range->begin = r * grain;
+          range->end = range->begin + grain < count ? range->begin + grain : count;
+        }
+      pthread_mutex_unlock(&w->lock);
+    }
+
+  pthread_mutex_lock(&m_lock);
+  m_task = pfn;
+  m_opaque = opaque;
+  m_pending = ranges;
+  m_generation++;
+  pthread_cond_broadcast(&m_wake);
+  while (m_pending)
+    pthread_cond_wait(&m_done, &m_lock);
+  pthread_mutex_unlock(&m_lock);
+
+  for (size_t i = 0; i < m_count; i++)
+    {
+      pthread_mutex_lock(&m_workers[i].lock);
+      m_workers[i].queue = 0;
+      m_workers[i].head = m_workers[i].tail = 0;
+      pthread_mutex_unlock(&m_workers[i].lock);
+    }
+  delete [] queues;
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Submit a job to run alone on a worker thread, without waiting for it.
+ * The job is called with the range [0, 0), it reports its completion
+ * by itself, such as by a flag written with the lock held, which the
+ * waiter checks after each waitDone().
+ * @param pfn Pointer to the job.
+ * @param opaque The pointer passed to the job.
+ * @return status code.
+ */
+int
+TaskPool::submit(pfnTask pfn, void *opaque)
+{
+  if (!m_workers)
+    {
+      return LERR_FAILED;
+    }
+
+  pthread_mutex_lock(&m_lock);
+  if (m_jobCount == m_jobSize)
+    {
+      size_t size = m_jobSize ? m_jobSize * 2 : 16;
+      TaskJob *jobs = new (std::nothrow) TaskJob[size];
+      if (!jobs)
+        {
+          pthread_mutex_unlock(&m_lock);
+          return LERR_ALLOC_MEMORY;
+        }
+      for (size_t i = 0; i < m_jobCount; i++)
+        jobs[i] = m_jobs[(m_jobHead + i) % m_jobSize];
+      delete [] m_jobs;
+      m_jobs = jobs;
+      m_jobHead = 0;
+      m_jobSize = size;
+    }
+  TaskJob *job = &m_jobs[(m_jobHead + m_jobCount) % m_jobSize];
+  job->pfn = pfn;
+  job->opaque = opaque;
+  m_jobCount++;
+  pthread_cond_signal(&m_wake);
+  pthread_mutex_unlock(&m_lock);
+  return LINF_SUCCEEDED;
+}
+
+} // namespace DSL
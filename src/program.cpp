@@ -0,0 +1,127 @@
+/** @file
+ * LispDSL - Program image shared by the interpreters.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+Program::Program()
+  : m_parser(&m_gc, &m_srcmap),
+    m_ast(0)
+{
+  m_errors.pfn = 0;
+  m_errors.opaque = 0;
+  m_lexer.setErrorSink(&m_errors);
+  m_parser.setErrorSink(&m_errors);
+
+  /* the constants are shared, they can not be mutated anyway */
+  m_parser.setHashConsing(true);
+}
+
+/**
+ * Parser the lisp code from stream, the program is frozen afterwards.
+ * @param stream Pointer to the IStream interface.
+ * @return status code.
+ */
+int
+Program::parse(IStream *stream)
+{
+  int rc;
+  if (m_ast)
+    {
+      return LERR_FAILED; /* frozen */
+    }
+
+  rc = m_lexer.open(stream);
+  if (LP_SUCCESS(rc))
+    {
+      rc = m_parser.parse(&m_lexer);
+      if (LP_SUCCESS(rc))
+        {
+          m_ast = m_parser.getSynRoot();
+        }
+    }
+  return rc;
+}
+
+/**
+ * Parser the lisp code from file, see parse().
+ * @param filename Path name of the source file.
+ * @return status code.
+ */
+int
+Program::parseFile(const char *filename)
+{
+  IStream *stream = Stream::CreateStream();
+  if (!stream)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  int rc = stream->Open(filename, "r");
+  if (LP_SUCCESS(rc))
+    {
+      rc = parse(stream);
+      stream->Close();
+    }
+  delete stream;
+  return rc;
+}
+
+/**
+ * Set where to report the errors of parsing, see Lisp::setErrorSink().
+ * @param pfn Pointer to the receiver, 0 for the log.
+ * @param opaque The pointer passed to the receiver.
+ */
+void
+Program::setErrorSink(pfnReportError pfn, void *opaque)
+{
+  m_errors.pfn = pfn;
+  m_errors.opaque = opaque;
+}
+
+/**
+ * Execute a shared program instead of parsing one, run() evaluates it.
+ * The program is only read, the instances attached to the same program
+ * can run on different threads at the same time. Mutating its objects
+ * (such as set-car! of a quoted list) fails with LERR_READ_ONLY.
+ * @param program Pointer to the program parsed, which must outlive
+ *                this instance.
+ * @return status code.
+ */
+int
+Lisp::attach(const Program *program)
+{
+  if (!program || !program->root())
+    {
+      return LERR_FAILED;
+    }
+  m_program = program;
+  m_gc.setReadOnly(&program->gc());
+  m_ast = program->root();
+  m_parsed = true;
+  return LINF_SUCCEEDED;
+}
+
+} // namespace DSL
@@ -0,0 +1,426 @@
+/** @file
+ * LispDSL - Binary serialization of syntax nodes.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <string.h>
+#include "lispdsl.h"
+
+/*
+ * Layout:
+ *   varint  count of nodes
+ *   varint  reference to the root
+ *   record  * count
+ *
+ * Record:
+ *   byte    objType
+ *   varint  line, 0 if unknown
+ *   varint  column, 0 if unknown
+ *   ...     payload by the type:
+ *     OBJTYPE_BOOLEAN    byte
+ *     OBJTYPE_NUMBER     8 bytes, double in host order
+ *     OBJTYPE_CHARACTER  byte
+ *     OBJTYPE_STRING     varint length, bytes
+ *     OBJTYPE_SYMBOL     varint length, bytes
+ *     OBJTYPE_PAIR       varint reference to leaf, varint reference to next
+ *     OBJTYPE_FUNC       varint reference to params, varint reference to body,
+ *                        varint envsp
+ *
+ * A reference is 0 for nil, or the index of record plus 1.
+ */
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Inner, write a variable-length integer.
+ * @param out Target buffer.
+ * @param v The value.
+ * @return status code.
+ */
+static int
+putVarint(StringPool &out, unsigned long long v)
+{
+  char buff[10];
+  size_t len = 0;
+  while (v >= 0x80)
+    {
+      buff[len++] = static_cast<char>((v & 0x7f) | 0x80);
+      v >>= 7;
+    }
+  buff[len++] = static_cast<char>(v);
+  return out.append(buff, len);
+}
+
+/**
+ * Inner, read a variable-length integer.
+ * @param p Reference to the current position, will be moved forward.
+ * @param end The end of buffer.
+ * @param v Where to store the value.
+ * @return false if the buffer is truncated.
+ */
+static bool
+getVarint(const unsigned char *&p, const unsigned char *end, __OUT unsigned long long *v)
+{
+  unsigned long long r = 0;
+  int shift = 0;
+  while (p < end && shift < 64)
+    {
+      unsigned char c = *p++;
+      r |= static_cast<unsigned long long>(c & 0x7f) << shift;
+      if (!(c & 0x80))
+        {
+          *v = r;
+          return true;
+        }
+      shift += 7;
+    }
+  return false;
+}
+
+/**
+ * Inner, get the reference to a node.
+ */
+static inline unsigned long long
+refNode(const PtrMap &index, SynNode *node)
+{
+  unsigned long long i = 0;
+  if (!node)
+    return 0;
+  index.lookup(node, &i);
+  return i + 1;
+}
+
+/**
+ * Serialize the graph of nodes reachable from the root.
+ * Shared (and circular) structures are written once.
+ * @param root Pointer to the root node, may be 0.
+ * @param srcmap Pointer to the positions of nodes in source, may be 0.
+ * @param out Where to append the result.
+ * @return status code.
+ */
+/* static */
+int
+Serializer::encode(SynNode *root, const SourceMap *srcmap, __OUT StringPool &out)
+{
+  int rc;
+  PtrMap index;
+  NodeStack order;
+  NodeStack stack;
+
+  /*
+   * number the nodes in depth-first order
+   */
+  rc = stack.push(root);
+  while (LP_SUCCESS(rc) && stack.count())
+    {
+      unsigned long long i;
+      SynNode *node = stack.pop();
+      if (!node || index.lookup(node, &i))
+        continue;
+
+      rc = index.insert(node, order.count());
+      if (LP_SUCCESS(rc))
+        rc = order.push(node);
+      if (LP_FAILURE(rc))
+        break;
+
+      if (OBJTYPE_PAIR == node->object.type)
+        {
+          rc = stack.push(OBJ_NEXT(node));
+          if (LP_SUCCESS(rc))
+            rc = stack.push(OBJ_LEAF(node));
+        }
+      else if (OBJTYPE_FUNC == node->object.type)
+        {
+          rc = stack.push(node->object.u.OBJTYPE_FUNC.body);
+          if (LP_SUCCESS(rc))
+            rc = stack.push(node->object.u.OBJTYPE_FUNC.params);
+        }
+    }
+  UPDATE_RC(rc);
+
+  rc = putVarint(out, order.count());
+  if (LP_SUCCESS(rc))
+    rc = putVarint(out, refNode(index, root));
+
+  /*
+   * write the records
+   */
+  for (size_t n = 0; LP_SUCCESS(rc) && n < order.count(); n++)
+    {
+      SynNode *node = order[n];
+      char tag = static_cast<char>(node->object.type);
+      file_off line = 0, column = 0;
+
+      if (srcmap)
+        srcmap->lookup(node, &line, &column);
+
+      rc = out.append(&tag, 1);
+      if (LP_SUCCESS(rc))
+        rc = putVarint(out, line);
+      if (LP_SUCCESS(rc))
+        rc = putVarint(out, column);
+      if (LP_FAILURE(rc))
+        break;
+
+      switch (node->object.type)
+      {
+        case OBJTYPE_BOOLEAN:
+          {
+            char v = OBJ_VALUE(OBJTYPE_BOOLEAN, node) ? 1 : 0;
+            rc = out.append(&v, 1);
+          }
+          break;
+        case OBJTYPE_NUMBER:
+          {
+            double v = OBJ_VALUE(OBJTYPE_NUMBER, node);
+            rc = out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+          }
+          break;
+        case OBJTYPE_CHARACTER:
+          {
+            char v = OBJ_VALUE(OBJTYPE_CHARACTER, node);
+            rc = out.append(&v, 1);
+          }
+          break;
+        case OBJTYPE_STRING:
+        case OBJTYPE_SYMBOL:
+          {
+            ImmString *v = node->object.type == OBJTYPE_STRING
+                ? OBJ_VALUE(OBJTYPE_STRING, node)
+                : OBJ_VALUE(OBJTYPE_SYMBOL, node);
+            rc = putVarint(out, v->length());
+            if (LP_SUCCESS(rc))
+              rc = out.append(v->buffer(), v->length());
+          }
+          break;
+        case OBJTYPE_PAIR:
+          {
+            rc = putVarint(out, refNode(index, OBJ_LEAF(node)));
+            if (LP_SUCCESS(rc))
+              rc = putVarint(out, refNode(index, OBJ_NEXT(node)));
+          }
+          break;
+        case OBJTYPE_FUNC:
+          {
+            rc = putVarint(out, refNode(index, node->object.u.OBJTYPE_FUNC.params));
+            if (LP_SUCCESS(rc))
+              rc = putVarint(out, refNode(index, node->object.u.OBJTYPE_FUNC.body));
+            if (LP_SUCCESS(rc))
+              rc = putVarint(out, node->object.u.OBJTYPE_FUNC.envsp);
+          }
+          break;
+        case OBJTYPE_PORT: /* runtime only */
+        case OBJTYPE_FUTURE:
+          rc = LERR_FAILED;
+          break;
+
+        default:
+          LP_ASSERT(0);
+          rc = LERR_FAILED;
+      }
+    }
+  return rc;
+}
+
+/**
+ * Inner, resolve a reference read from the records.
+ */
+static inline SynNode *
+resolveRef(SynNode **nodes, SynNode *ref)
+{
+  size_t i = reinterpret_cast<size_t>(ref);
+  return i ? nodes[i - 1] : 0;
+}
+
+/**
+ * Rebuild the graph of nodes from the serialized data.
+ * The records are decoded in one pass, then the references are
+ * resolved in a second pass over the nodes created.
+ * @param gc GC object reference.
+ * @param src Pointer to the source buffer.
+ * @param len Length of source buffer.
+ * @param srcmap Where to record the positions of nodes in source, may be 0.
+ * @param out Where to store the root node.
+ * @return LERR_FAILED if the data is invalid.
+ * @return status code.
+ */
+/* static */
+int
+Serializer::decode(GC &gc, const char *src, size_t len, SourceMap *srcmap, __OUT SynNode **out)
+{
+  int rc = LINF_SUCCEEDED;
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(src);
+  const unsigned char *end = p + len;
+  unsigned long long count, root, line, column, a, b, c;
+
+  if (!getVarint(p, end, &count) || !getVarint(p, end, &root)
+      || count > len /* at least one byte for each record */
+      || root > count)
+    {
+      return LERR_FAILED;
+    }
+
+  SynNode **nodes = new (std::nothrow) SynNode*[count ? count : 1];
+  if (!nodes)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  if (srcmap)
+    {
+      /* most of the nodes have a position, avoid the rehashing */
+      rc = srcmap->reserve(static_cast<size_t>(count));
+      if (LP_FAILURE(rc))
+        {
+          delete [] nodes;
+          return rc;
+        }
+    }
+
+  for (size_t n = 0; n < count; n++)
+    {
+      SynNode *node = 0;
+      if (p >= end)
+        {
+          rc = LERR_FAILED;
+          break;
+        }
+      objType type = static_cast<objType>(*p++);
+      if (!getVarint(p, end, &line) || !getVarint(p, end, &column))
+        {
+          rc = LERR_FAILED;
+          break;
+        }
+
+      switch (type)
+      {
+        case OBJTYPE_BOOLEAN:
+          {
+            if (p + 1 > end) { rc = LERR_FAILED; break; }
+            createAtom(gc, OBJTYPE_BOOLEAN, node, *p != 0, rc);
+            p++;
+          }
+          break;
+        case OBJTYPE_NUMBER:
+          {
+            double v;
+            if (p + sizeof(v) > end) { rc = LERR_FAILED; break; }
+            memcpy(&v, p, sizeof(v));
+            p += sizeof(v);
+            createAtom(gc, OBJTYPE_NUMBER, node, v, rc);
+          }
+          break;
+        case OBJTYPE_CHARACTER:
+          {
+            if (p + 1 > end) { rc = LERR_FAILED; break; }
+            createAtom(gc, OBJTYPE_CHARACTER, node, static_cast<char>(*p), rc);
+            p++;
+          }
+          break;
+        case OBJTYPE_STRING:
+        case OBJTYPE_SYMBOL:
+          {
+            if (!getVarint(p, end, &a) || a > static_cast<size_t>(end - p))
+              {
+                rc = LERR_FAILED;
+                break;
+              }
+            ImmString *str;
+            rc = gc.createString(reinterpret_cast<const char *>(p), static_cast<size_t>(a), &str);
+            if (LP_FAILURE(rc))
+              {
+                break;
+              }
+            p += a;
+            if (type == OBJTYPE_STRING)
+              createAtom(gc, OBJTYPE_STRING, node, str, rc);
+            else
+              createAtom(gc, OBJTYPE_SYMBOL, node, str, rc);
+          }
+          break;
+        case OBJTYPE_PAIR:
+          {
+            if (!getVarint(p, end, &a) || !getVarint(p, end, &b)
+                || a > count || b > count)
+              {
+                rc = LERR_FAILED;
+                break;
+              }
+            /* store the references until all the nodes exist */
+            rc = gc.createPair(reinterpret_cast<SynNode *>(static_cast<size_t>(a)),
+                               reinterpret_cast<SynNode *>(static_cast<size_t>(b)),
+                               &node);
+          }
+          break;
+        case OBJTYPE_FUNC:
+          {
+            if (!getVarint(p, end, &a) || !getVarint(p, end, &b) || !getVarint(p, end, &c)
+                || a > count || b > count)
+              {
+                rc = LERR_FAILED;
+                break;
+              }
+            rc = gc.createFunc(reinterpret_cast<SynNode *>(static_cast<size_t>(a)),
+                               reinterpret_cast<SynNode *>(static_cast<size_t>(b)),
+                               static_cast<EnvSP>(c), &node);
+          }
+          break;
+
+        default:
+          rc = LERR_FAILED;
+      }
+
+      if (LP_SUCCESS(rc) && srcmap && line)
+        rc = srcmap->add(node, static_cast<file_off>(line), static_cast<file_off>(column));
+      if (LP_FAILURE(rc))
+        break;
+      nodes[n] = node;
+    }
+
+  if (LP_SUCCESS(rc))
+    {
+      /*
+       * relocate the references
+       */
+      for (size_t n = 0; n < count; n++)
+        {
+          SynNode *node = nodes[n];
+          if (OBJTYPE_PAIR == node->object.type)
+            {
+              OBJ_LEAF(node) = resolveRef(nodes, OBJ_LEAF(node));
+              OBJ_NEXT(node) = resolveRef(nodes, OBJ_NEXT(node));
+            }
+          else if (OBJTYPE_FUNC == node->object.type)
+            {
+              node->object.u.OBJTYPE_FUNC.params = resolveRef(nodes, node->object.u.OBJTYPE_FUNC.params);
+              node->object.u.OBJTYPE_FUNC.body = resolveRef(nodes, node->object.u.OBJTYPE_FUNC.body);
+            }
+        }
+      *out = root ? nodes[root - 1] : 0;
+    }
+
+  delete [] nodes;
+  return rc;
+}
+
+} // namespace DSL
@@ -1,295 +1,527 @@
-/** @file
- * LispDSL - String pool management.
- */
-
-/*
- *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
- *  please contact with <diyer175@hotmail.com> if you have any problems.
- *
- *  This project is free software; you can redistribute it and/or
- *  modify it under the terms of the GNU Lesser General Public License(GPL)
- *  as published by the Free Software Foundation; either version 2.1
- *  of the License, or (at your option) any later version.
- *
- *  This project is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
- *  Lesser General Public License for more details.
- */
-
-/*******************************************************************************
-*   Header Files                                                               *
-*******************************************************************************/
-#include <new>
-#include <string.h>
-#include "lispdsl.h"
-
-namespace DSL {
-
-////////////////////////////////////////////////////////////////////////////////
-
-StringPool::StringPool()
-  : heap_buff (0),
-    len (0),
-    buffsize (0),
-    inheap (false),
-    curpos (0)
-{
-  memset(buff, 0, sizeof(buff));
-}
-
-StringPool::~StringPool() {
-  if (heap_buff)
-    delete [] heap_buff;
-}
-
-/**
- * Join a string to the buffer, this will append a '\0'
- * termination at the end of string as well.
- * @param src Pointer to the source string.
- * @param len Length of source string.
- * @return status code.
- */
-int
-StringPool::append(const char *src, size_t lensrc) {
-  int rc;
-  size_t pos = len;
-  size_t lenwr = lensrc + 1; // padding '\0'
-  size_t lenwrSum = len + lenwr;
-
-  if (lenwrSum <= _MAX_BUFF_SIZE)
-    {
-      memcpy(&buff[pos], src, lensrc);
-      buff[pos + lensrc] = 0;
-      len += lensrc;
-      rc = LINF_SUCCEEDED;
-    }
-  else
-    { /* using the heap buffer */
-      if (lenwrSum > buffsize)
-        {
-          if (buffsize == 0) buffsize = len;
-          rc = resizeBuffer(buffsize + lenwr);
-          if (LP_SUCCESS(rc))
-            {
-              /* move the buff data into heap */
-              if (!inheap)
-                {
-                  strcpy(heap_buff, buff);
-                  inheap = true;
-                }
-            }
-          else
-            return rc;
-        }
-
-      /* append the source */
-      memcpy(&heap_buff[pos], src, lensrc);
-      heap_buff[pos + lensrc] = 0;
-      len += lensrc;
-      rc = LINF_SUCCEEDED;
-    }
-  return rc;
-}
-
-int
-StringPool::append(const char *src)
-{
-  return append(src, strlen(src));
-}
-
-/**
- * Copy the string to the buffer (replace the original).
- * this will append a '\0' termination at the end of string as well.
- * @param src Pointer to the source string.
- * @param len Length of source string.
- * @return status code.
- */
-int
-StringPool::copy(const char *src, size_t lensrc)
-{
-  int rc;
-  size_t lenwr = lensrc + 1; // padding '\0'
-
-  if (lenwr <= _MAX_BUFF_SIZE)
-    {
-      memcpy(buff, src, lensrc);
-      buff[lensrc] = 0;
-      len = lensrc;
-      rc = LINF_SUCCEEDED;
-    }
-  else
-    { /* using the heap buffer */
-      rc = reallocBuffer(lenwr);
-      if (LP_SUCCESS(rc))
-        {
-          memcpy(heap_buff, src, lensrc);
-          heap_buff[lensrc] = 0;
-          len = lensrc;
-        }
-    }
-  return rc;
-}
-
-int
-StringPool::copy(const char *src)
-{
-  return copy(src, strlen(src));
-}
-
-int
-StringPool::copy(const StringPool &src)
-{
-  return copy(src.buffer()); //!fixme
-}
-
-/**
- * Compare the string in buffer with the source specified.
- * @param src Pointer to the source string.
- * @return 0 if the two are exactly the same.
- */
-int
-StringPool::compare(const char *src)
-{
-  return strcmp(buffer(), src);
-}
-
-int
-StringPool::compare(const StringPool &src)
-{
-  return strcmp(buffer(), src.buffer());
-}
-
-/**
- * Inner, Resize the heap buffer.
- * @param newsize The new size, NOT increment.
- * @return status code.
- */
-int
-StringPool::resizeBuffer(size_t newsize)
-{
-  char *oldbuff = heap_buff;
-
-  /*
-   * Calculate the new size of buffer.
-   * The function image of the result may be near a
-   * para-curve, when the newsize is a constant.
-   */
-  newsize |= _MAX_BUFF_SIZE - 1;
-  if (newsize / 3 < buffsize / 2)
-    newsize = buffsize + buffsize / 2; // = 3/2 * buffsize;
-
-  heap_buff = new (std::nothrow) char[newsize];
-  if (!heap_buff)
-    {
-      if (oldbuff)
-        delete [] oldbuff;
-      return LERR_ALLOC_MEMORY;
-    }
-
-  /* copy the original data */
-  if (oldbuff)
-    {
-      strcpy(heap_buff, oldbuff);
-      delete [] oldbuff;
-    }
-  buffsize = newsize;
-
-  return LINF_SUCCEEDED;
-}
-
-/**
- * Re allocate the buffer.
- * @param size The size want of new buffer.
- * @return status code.
- */
-int
-StringPool::reallocBuffer(size_t size)
-{
-  if (heap_buff)
-    delete [] heap_buff;
-  heap_buff = new (std::nothrow) char [size];
-  if (heap_buff)
-    {
-      buffsize = size;
-      return LINF_SUCCEEDED;
-    }
-  return LERR_ALLOC_MEMORY;
-}
-
-/**
- * Get the current length of string, barring '\0' termination.
- * @retur the value in bytes.
- */
-size_t
-StringPool::length() {
-  return len;
-}
-
-/**
- * Get the pointer of buffer.
- * Be careful that the pointer exposed will become
- * @return pointer to the buffer.
- */
-char *
-StringPool::buffer() const {
-  return (len + 1 <= _MAX_BUFF_SIZE ? /*fixme???*/const_cast<char*>(buff) : heap_buff);
-}
-
-
-////////////////////////////////////////////////////////////////////////////////
-
-
-/*
- * Convert a number-formated string to double.
- * @param src Pointer to the source buffer.
- * @param out Where to store the result.
- * @return status code.
- */
-int
-parserNumberStr(const char *src, __OUT double *out)
-{
-  double d = 0.0, power = 1.0;
-
-  /* parse the sign */
-  int sign = 1;
-  for (; *src; src++)
-    {
-      if (*src == ' ') continue;
-      if (*src == '-') { sign = -1; continue; }
-      if (*src == '+') { sign = 1; continue; }
-      break;
-    }
-
-  for (; *src; src++)
-    {
-      /* parse the integer part */
-      if (IsDigit(*src))
-        {
-          d = d* 10.0 + (*src - '0');
-        }
-      /* parse the float part */
-      else if (*src == '.')
-        {
-          for (src++; *src && IsDigit(*src); src++)
-            {
-              d = d* 10.0 + (*src - '0');
-              power *= 10;
-            }
-          break;
-        }
-      else
-        break;
-    }
-
-  if (*src != '\0')
-    {
-      return LERR_FAILED;
-    }
-
-  *out = sign * d/power;
-  return LINF_SUCCEEDED;
-}
-
-
-} // namespace DSL
+/** @file
+ * LispDSL - String pool management.
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include "lispdsl.h"
+
+namespace DSL {
+
+////////////////////////////////////////////////////////////////////////////////
+
+StringPool::StringPool()
+  : heap_buff (0),
+    len (0),
+    buffsize (0),
+    inheap (false),
+    curpos (0)
+{
+  memset(buff, 0, sizeof(buff));
+}
+
+StringPool::~StringPool() {
+  if (heap_buff)
+    delete [] heap_buff;
+}
+
+/**
+ * Inner, make sure the buffer holds at least the size specified,
+ * the content is kept. The heap buffer grows geometrically, so that
+ * appending n bytes in pieces costs O(n) in total.
+ * @param size The size wanted, including the '\0' termination.
+ * @return status code.
+ */
+int
+StringPool::resizeBuffer(size_t size)
+{
+  size_t capacity = inheap ? buffsize : _MAX_BUFF_SIZE;
+  if (size <= capacity)
+    return LINF_SUCCEEDED;
+
+  size_t newsize = capacity * 2;
+  if (newsize < size)
+    newsize = size;
+
+  char *newbuff = new (std::nothrow) char[newsize];
+  if (!newbuff)
+    {
+      return LERR_ALLOC_MEMORY;
+    }
+  /* copy the original data */
+  memcpy(newbuff, buffer(), len + 1);
+
+  if (heap_buff)
+    delete [] heap_buff;
+  heap_buff = newbuff;
+  buffsize = newsize;
+  inheap = true;
+
+  return LINF_SUCCEEDED;
+}
+
+/**
+ * Inner, make sure the buffer holds at least the size specified,
+ * the content is discarded.
+ * @param size The size wanted, including the '\0' termination.
+ * @return status code.
+ */
+int
+StringPool::reallocBuffer(size_t size)
+{
+  len = 0;
+  buff[0] = 0;
+  if (inheap)
+    heap_buff[0] = 0;
+  return resizeBuffer(size);
+}
+
+/**
+ * Join a string to the buffer, this will append a '\0'
+ * termination at the end of string as well.
+ * @param src Pointer to the source string.
+ * @param len Length of source string.
+ * @return status code.
+ */
+int
+StringPool::append(const char *src, size_t lensrc) {
+  int rc = resizeBuffer(len + lensrc + 1); // padding '\0'
+  UPDATE_RC(rc);
+
+  char *p = buffer();
+  memcpy(&p[len], src, lensrc);
+  len += lensrc;
+  p[len] = 0;
+  return LINF_SUCCEEDED;
+}
+
+int
+StringPool::append(const char *src)
+{
+  return append(src, strlen(src));
+}
+
+/**
+ * Copy the string to the buffer (replace the original).
+ * this will append a '\0' termination at the end of string as well.
+ * @param src Pointer to the source string.
+ * @param len Length of source string.
+ * @return status code.
+ */
+int
+StringPool::copy(const char *src, size_t lensrc)
+{
+  int rc = reallocBuffer(lensrc + 1); // padding '\0'
+  UPDATE_RC(rc);
+
+  char *p = buffer();
+  memcpy(p, src, lensrc);
+  len = lensrc;
+  p[len] = 0;
+  return LINF_SUCCEEDED;
+}
+
+int
+StringPool::copy(const char *src)
+{
+  return copy(src, strlen(src));
+}
+
+int
+StringPool::copy(const StringPool &src)
+{
+  return copy(src.buffer(), src.len);
+}
+
+/**
+ * Reserve the capacity up-front, when the final length is known,
+ * so that the appending after it will not reallocate the buffer.
+ * @param size The length of string wanted, barring '\0' termination.
+ * @return status code.
+ */
+int
+StringPool::reserve(size_t size)
+{
+  return resizeBuffer(size + 1);
+}
+
+/**
+ * Take over the content of another pool without copying the heap buffer.
+ * The source is left empty.
+ * @param src Reference to the source.
+ */
+void
+StringPool::move(StringPool &src)
+{
+  if (this == &src)
+    return;
+  if (heap_buff)
+    delete [] heap_buff;
+
+  memcpy(buff, src.buff, sizeof(buff));
+  heap_buff = src.heap_buff;
+  len = src.len;
+  buffsize = src.buffsize;
+  inheap = src.inheap;
+  curpos = 0;
+
+  src.heap_buff = 0;
+  src.len = 0;
+  src.buffsize = 0;
+  src.inheap = false;
+  src.curpos = 0;
+  src.buff[0] = 0;
+}
+
+/**
+ * Compare the string in buffer with the source specified.
+ * @param src Pointer to the source string.
+ * @return 0 if the two are exactly the same.
+ */
+int
+StringPool::compare(const char *src)
+{
+  return strcmp(buffer(), src);
+}
+
+int
+StringPool::compare(const StringPool &src)
+{
+  return strcmp(buffer(), src.buffer());
+}
+
+/**
+ * Get the current length of string, barring '\0' termination.
+ * @retur the value in bytes.
+ */
+size_t
+StringPool::length() {
+  return len;
+}
+
+/**
+ * Get the pointer of buffer.
+ * Be careful that the pointer exposed will become
+ * @return pointer to the buffer.
+ */
+char *
+StringPool::buffer() const {
+  return inheap ? heap_buff : const_cast<char*>(buff);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Get the size of block taken by a string.
+ * @param len Length of the string.
+ * @return the value in bytes.
+ */
+/* static */
+size_t
+ImmString::sizeOf(size_t len)
+{
+  return offsetof(ImmString, m_data) + len + 1;
+}
+
+/**
+ * Construct a immutable string in the block given.
+ * @param block Pointer to the memory, at least sizeOf(len) bytes.
+ * @param src Pointer to the source bytes, may contain '\0'.
+ * @param len Length of source.
+ * @return pointer to the string.
+ */
+/* static */
+ImmString *
+ImmString::construct(void *block, const char *src, size_t len)
+{
+  ImmString *str = new (block) ImmString;
+  str->m_len = len;
+  str->m_hash = hashBuffer(src, len);
+  memcpy(str->m_data, src, len);
+  str->m_data[len] = '\0';
+  return str;
+}
+
+/**
+ * Create a immutable string.
+ * @param src Pointer to the source bytes, may contain '\0'.
+ * @param len Length of source.
+ * @return 0 if failed to allocate the memory.
+ * @return pointer to the new string, should be released by release().
+ */
+/* static */
+ImmString *
+ImmString::create(const char *src, size_t len)
+{
+  void *block = ::operator new(sizeOf(len), std::nothrow);
+  if (!block)
+    return 0;
+  return construct(block, src, len);
+}
+
+/**
+ * Create a immutable string from a '\0' terminated one.
+ * @param src Pointer to the source string.
+ * @return 0 if failed to allocate the memory.
+ * @return pointer to the new string, should be released by release().
+ */
+/* static */
+ImmString *
+ImmString::create(const char *src)
+{
+  return create(src, strlen(src));
+}
+
+/**
+ * Release a string created by create().
+ * @param str Pointer to the string, may be 0.
+ */
+/* static */
+void
+ImmString::release(ImmString *str)
+{
+  ::operator delete(str);
+}
+
+/**
+ * Compare the string with the bytes specified.
+ * @param src Pointer to the source bytes.
+ * @param len Length of source.
+ * @return 0 if the two are exactly the same.
+ * @return <0 or >0 by the order of bytes, the shorter first if one is a prefix.
+ */
+int
+ImmString::compare(const char *src, size_t len) const
+{
+  int cmp = memcmp(m_data, src, m_len < len ? m_len : len);
+  if (cmp)
+    return cmp;
+  return m_len < len ? -1 : (m_len > len ? 1 : 0);
+}
+
+/**
+ * Compare the string with a '\0' terminated one.
+ * @param src Pointer to the source string.
+ * @return 0 if the two are exactly the same.
+ */
+int
+ImmString::compare(const char *src) const
+{
+  return compare(src, strlen(src));
+}
+
+/**
+ * Compare with another string. The ones with different length or hash
+ * are known to be unequal without scanning the bytes, so the order is
+ * by the length, then the hash, then the bytes, not the order of text.
+ * @param src Reference to the source.
+ * @return 0 if the two are exactly the same.
+ * @return <0 or >0 otherwise, consistently.
+ */
+int
+ImmString::compare(const ImmString &src) const
+{
+  if (this == &src)
+    return 0;
+  if (m_len != src.m_len)
+    return m_len < src.m_len ? -1 : 1;
+  if (m_hash != src.m_hash)
+    return m_hash < src.m_hash ? -1 : 1;
+  return memcmp(m_data, src.m_data, m_len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ * Hash a block of memory (64-bit FNV-1a).
+ * @param src Pointer to the source buffer.
+ * @param len The length in bytes.
+ * @return the hash value.
+ */
+unsigned long long
+hashBuffer(const void *src, size_t len)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(src);
+  unsigned long long h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++)
+    {
+      h ^= p[i];
+      h *= 0x100000001b3ULL;
+    }
+  return h;
+}
+
+/*
+ * Powers of ten that are exactly representable by double.
+ */
+static const double powersOfTen[] =
+{
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAX_EXACT_POW10 (22)
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+#define MAX_MANTISSA_DIGITS (19)
+#define MAX_EXPONENT (100000)
+
+/*
+ * Convert a number-formated string to double.
+ * Syntax: [+|-]digits[.digits][(e|E)[+|-]digits], either part of digits
+ * may be omitted around the point but not both.
+ *
+ * The digits are gathered into a 64-bit integer mantissa in a single pass.
+ * When the mantissa and the power of ten are both exactly representable,
+ * the result is a single correctly rounded multiplication or division
+ * (Clinger's fast path). The rare remainder (more than 19 significant
+ * digits, or an exponent out of the exact range) is handed to strtod(),
+ * so the result is always the nearest double.
+ * @param src Pointer to the source buffer.
+ * @param out Where to store the result.
+ * @return status code.
+ */
+int
+parserNumberStr(const char *src, __OUT double *out)
+{
+  unsigned long long mantissa = 0;
+  int digits = 0;
+  int exp10 = 0;
+  bool truncated = false;
+  bool any = false;
+  bool negative = false;
+
+  while (*src == ' ')
+    src++;
+
+  const char *start = src;
+
+  /* parse the sign */
+  if (*src == '-' || *src == '+')
+    {
+      negative = (*src == '-');
+      src++;
+    }
+
+  /* parse the integer part */
+  for (; IsDigit(*src); src++)
+    {
+      any = true;
+      if (digits < MAX_MANTISSA_DIGITS)
+        {
+          mantissa = mantissa * 10 + (*src - '0');
+          if (mantissa)
+            digits++;
+        }
+      else
+        {
+          truncated = true;
+          exp10++;
+        }
+    }
+
+  /* parse the float part */
+  if (*src == '.')
+    {
+      for (src++; IsDigit(*src); src++)
+        {
+          any = true;
+          if (digits < MAX_MANTISSA_DIGITS)
+            {
+              mantissa = mantissa * 10 + (*src - '0');
+              if (mantissa)
+                digits++;
+              exp10--;
+            }
+          else
+            truncated = true;
+        }
+    }
+
+  if (!any)
+    {
+      return LERR_FAILED;
+    }
+
+  /* parse the exponent part */
+  if (*src == 'e' || *src == 'E')
+    {
+      int expsign = 1;
+      int e = 0;
+
+      src++;
+      if (*src == '-' || *src == '+')
+        {
+          expsign = (*src == '-') ? -1 : 1;
+          src++;
+        }
+      if (!IsDigit(*src))
+        {
+          return LERR_FAILED;
+        }
+      for (; IsDigit(*src); src++)
+        {
+          if (e < MAX_EXPONENT)
+            e = e * 10 + (*src - '0');
+        }
+      exp10 += expsign * e;
+    }
+
+  if (*src != '\0')
+    {
+      return LERR_FAILED;
+    }
+
+  double d;
+
+  if (mantissa == 0)
+    {
+      d = 0.0;
+    }
+  else if (!truncated && exp10 == 0)
+    {
+      /* integer, the conversion itself is correctly rounded */
+      d = static_cast<double>(mantissa);
+    }
+  else if (!truncated && mantissa <= MAX_EXACT_MANTISSA
+           && exp10 >= -MAX_EXACT_POW10 && exp10 <= MAX_EXACT_POW10)
+    {
+      d = static_cast<double>(mantissa);
+      if (exp10 < 0)
+        d /= powersOfTen[-exp10];
+      else
+        d *= powersOfTen[exp10];
+    }
+  else
+    {
+      /* slow path, the parsing is done again by libc */
+      *out = strtod(start, 0);
+      return LINF_SUCCEEDED;
+    }
+
+  *out = negative ? -d : d;
+  return LINF_SUCCEEDED;
+}
+
+
+} // namespace DSL
@@ -0,0 +1,711 @@
+/** @file
+ * LispDSL - Micro benchmarks.
+ *
+ * Build:
+ *  g++ -O2 -pthread -Iinclude tests/bench.cpp $(find src -name '*.cpp' ! -name main.cpp) -o bench
+ * Usage:
+ *  bench [number|string|apply|native|pmap|gc|image]
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "lispdsl.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+using namespace DSL;
+
+#define BENCH_NUMBERS (1000000)
+#define BENCH_NUMBER_LEN (32)
+
+/**
+ * Inner, get the processor time in seconds.
+ */
+static double
+seconds()
+{
+  return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+}
+
+/**
+ * Inner, generate the numeric literals as they appear in data files.
+ * @param buff Where to store the literals, BENCH_NUMBER_LEN bytes for each.
+ * @param count The number of literals.
+ */
+static void
+generateNumbers(char *buff, int count)
+{
+  srand(2016);
+  for (int i = 0; i < count; i++)
+    {
+      char *p = buff + i * BENCH_NUMBER_LEN;
+      int r = rand();
+      switch (i % 5)
+      {
+        case 0: /* integer */
+          snprintf(p, BENCH_NUMBER_LEN, "%d", r % 100000);
+          break;
+        case 1: /* short decimal */
+          snprintf(p, BENCH_NUMBER_LEN, "%d.%02d", r % 1000, r % 100);
+          break;
+        case 2: /* long mantissa */
+          snprintf(p, BENCH_NUMBER_LEN, "%.17g", static_cast<double>(r) / RAND_MAX);
+          break;
+        case 3: /* exponent */
+          snprintf(p, BENCH_NUMBER_LEN, "%d.%de%d", r % 10, r % 1000, r % 40 - 20);
+          break;
+        default: /* signed */
+          snprintf(p, BENCH_NUMBER_LEN, "-%d.%d", r % 100, r % 10000);
+      }
+    }
+}
+
+/**
+ * Compare parserNumberStr() with strtod(), both for the speed and
+ * for the exactness of results.
+ * @return 0 if all the results are identical.
+ */
+static int
+benchNumber()
+{
+  char *buff = new char[BENCH_NUMBERS * BENCH_NUMBER_LEN];
+  double *results = new double[BENCH_NUMBERS];
+  generateNumbers(buff, BENCH_NUMBERS);
+
+  double t0 = seconds();
+  for (int i = 0; i < BENCH_NUMBERS; i++)
+    {
+      parserNumberStr(buff + i * BENCH_NUMBER_LEN, &results[i]);
+    }
+  double t1 = seconds();
+  double sum = 0.0;
+  for (int i = 0; i < BENCH_NUMBERS; i++)
+    {
+      sum += strtod(buff + i * BENCH_NUMBER_LEN, 0);
+    }
+  double t2 = seconds();
+
+  int mismatched = 0;
+  for (int i = 0; i < BENCH_NUMBERS; i++)
+    {
+      const char *src = buff + i * BENCH_NUMBER_LEN;
+      double expected = strtod(src, 0);
+      if (memcmp(&expected, &results[i], sizeof(double)) != 0)
+        {
+          if (mismatched++ < 10)
+            printf("mismatched: '%s' %.17g != %.17g\n", src, results[i], expected);
+        }
+    }
+
+  printf("number: %d literals, parserNumberStr %.3fs, strtod %.3fs (%g), %d mismatched\n",
+         BENCH_NUMBERS, t1 - t0, t2 - t1, sum, mismatched);
+
+  delete [] results;
+  delete [] buff;
+  return mismatched ? 1 : 0;
+}
+
+#define BENCH_STRING_SIZE (10 * 1024 * 1024)
+
+/**
+ * Inner, append the bytes to a pool in pieces.
+ * @param size The total length.
+ * @param piece The length of each piece.
+ * @param reserve Whether to reserve the capacity up-front.
+ * @return the time in seconds, negative if failed.
+ */
+static double
+appendPieces(size_t size, size_t piece, bool reserve)
+{
+  static const char src[] = "0123456789abcdefghijklmnopqrstuvwxyz"
+                            "0123456789abcdefghijklmnopqrstuvwxyz";
+  StringPool pool, target;
+
+  double t0 = seconds();
+  if (reserve && LP_FAILURE(pool.reserve(size)))
+    return -1.0;
+  for (size_t n = 0; n < size; n += piece)
+    {
+      if (LP_FAILURE(pool.append(src, piece)))
+        return -1.0;
+    }
+  target.move(pool);
+  double t1 = seconds();
+
+  if (target.length() != (size + piece - 1) / piece * piece || pool.length() != 0)
+    return -1.0;
+  return t1 - t0;
+}
+
+/**
+ * Build long strings in small pieces, as the lexer does for long
+ * literals. The time of 10 MB should be about 10 times of 1 MB.
+ * @return 0 if succeeded.
+ */
+static int
+benchString()
+{
+  static const size_t pieces[] = { 1, 2, 16, 64 };
+  int rc = 0;
+
+  for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+    {
+      double small = appendPieces(BENCH_STRING_SIZE / 10, pieces[i], false);
+      double large = appendPieces(BENCH_STRING_SIZE, pieces[i], false);
+      double reserved = appendPieces(BENCH_STRING_SIZE, pieces[i], true);
+      if (small < 0 || large < 0 || reserved < 0)
+        {
+          printf("string: append failed\n");
+          rc = 1;
+          continue;
+        }
+      printf("string: %d-byte pieces, 1 MB %.3fs, 10 MB %.3fs, 10 MB reserved %.3fs\n",
+             static_cast<int>(pieces[i]), small, large, reserved);
+    }
+  return rc;
+}
+
+#define BENCH_RECORDS (1000000)
+#define BENCH_SCRIPTS (10000)
+#define BENCH_RULE_FILE "bench_rule.scm"
+
+/*
+ * The rule evaluated for each record, followed by a call of it so that
+ * it can also be run as a whole script.
+ */
+static const char benchRule[] =
+    "(\n"
+    "(define rule\n"
+    "  (lambda (amount limit)\n"
+    "    (cond ((> amount limit) \"reject\")\n"
+    "          ((> (* amount 2) limit) \"review\")\n"
+    "          (else \"accept\"))))\n"
+    "(rule 30 100)\n"
+    ")\n";
+
+/**
+ * Inner, parse and run the script with a new instance, the way of
+ * calling the interpreter once per record without the batch API.
+ * @return status code.
+ */
+static int
+runScript()
+{
+  IStream *stream = Stream::CreateStream();
+  if (!stream)
+    return LERR_ALLOC_MEMORY;
+  int rc = stream->Open(BENCH_RULE_FILE, "r");
+  if (LP_SUCCESS(rc))
+    {
+      Lisp *lisp = new Lisp();
+      SynNode *res;
+      rc = lisp->parser(stream);
+      if (LP_SUCCESS(rc))
+        rc = lisp->run(&res);
+      delete lisp;
+      stream->Close();
+    }
+  delete stream;
+  return rc;
+}
+
+/**
+ * Compare calling a rule through applyBatch() with parsing and running
+ * the script for each record. The heap should not grow with the batch.
+ * @return 0 if succeeded.
+ */
+static int
+benchApply()
+{
+  FILE *fp = fopen(BENCH_RULE_FILE, "w");
+  if (!fp)
+    return 1;
+  fputs(benchRule, fp);
+  fclose(fp);
+
+  int rc = 0;
+  double t0 = seconds();
+  for (int i = 0; i < BENCH_SCRIPTS && !rc; i++)
+    {
+      if (LP_FAILURE(runScript()))
+        rc = 1;
+    }
+  double t1 = seconds();
+
+  IStream *stream = Stream::CreateStream();
+  Lisp *lisp = new Lisp();
+  SynNode *rule = 0;
+  HostValue *args = new HostValue[BENCH_RECORDS * 2];
+  HostValue *results = new HostValue[BENCH_RECORDS];
+  StringPool text;
+  size_t before = 0, after = 0;
+
+  srand(2016);
+  for (int i = 0; i < BENCH_RECORDS * 2; i++)
+    {
+      args[i].type = OBJTYPE_NUMBER;
+      args[i].u.number = rand() % 200;
+    }
+
+  if (!rc && stream && LP_SUCCESS(stream->Open(BENCH_RULE_FILE, "r"))
+      && LP_SUCCESS(lisp->parser(stream)) && LP_SUCCESS(lisp->run(0))
+      && LP_SUCCESS(lisp->lookupProcedure("rule", &rule)))
+    {
+      before = lisp->gc().allocated();
+      t1 = seconds();
+      if (LP_FAILURE(lisp->applyBatch(rule, args, 2, BENCH_RECORDS, results, &text)))
+        rc = 1;
+      after = lisp->gc().allocated();
+    }
+  else
+    rc = 1;
+  double t2 = seconds();
+
+  int rejected = 0;
+  for (int i = 0; i < BENCH_RECORDS && !rc; i++)
+    {
+      if (results[i].type != OBJTYPE_STRING)
+        rc = 1;
+      else if (!strcmp(results[i].u.string.buffer, "reject"))
+        rejected++;
+    }
+
+  if (rc)
+    printf("apply: failed\n");
+  else
+    printf("apply: parse+run %.0f records/s, applyBatch %.0f records/s (%d rejected), heap %lu -> %lu bytes\n",
+           BENCH_SCRIPTS / (t1 - t0), BENCH_RECORDS / (t2 - t1), rejected,
+           static_cast<unsigned long>(before), static_cast<unsigned long>(after));
+
+  delete [] results;
+  delete [] args;
+  delete lisp;
+  if (stream)
+    {
+      stream->Close();
+      delete stream;
+    }
+  remove(BENCH_RULE_FILE);
+  return rc;
+}
+
+#define BENCH_CALLS (1000000)
+
+/*
+ * The same arithmetic through the builtins and through the host functions.
+ */
+static const char benchNativeScript[] =
+    "(define by-builtin (lambda (x y) (+ (* x x) (* y y))))\n"
+    "(define by-native (lambda (x y) (hadd (hmul x x) (hmul y y))))\n";
+
+static double hostAdd(double x, double y) { return x + y; }
+static double hostMul(double x, double y) { return x * y; }
+
+/**
+ * Inner, time the calls of a procedure through applyBatch().
+ * @param lisp Pointer to the interpreter.
+ * @param name Name of the procedure.
+ * @param args Pointer to the arguments, two for each call.
+ * @param results Where to store the results.
+ * @return the time in seconds, negative if failed.
+ */
+static double
+timeCalls(Lisp *lisp, const char *name, const HostValue *args, HostValue *results)
+{
+  SynNode *proc;
+  if (LP_FAILURE(lisp->lookupProcedure(name, &proc)))
+    return -1.0;
+  double t0 = seconds();
+  if (LP_FAILURE(lisp->applyBatch(proc, args, 2, BENCH_CALLS, results, 0)))
+    return -1.0;
+  return seconds() - t0;
+}
+
+/**
+ * Compare the numeric host functions registered by registerNumber()
+ * with the builtin arithmetic, the costs should be close.
+ * @return 0 if the results are identical.
+ */
+static int
+benchNative()
+{
+  FILE *fp = fopen(BENCH_RULE_FILE, "w");
+  if (!fp)
+    return 1;
+  fputs(benchNativeScript, fp);
+  fclose(fp);
+
+  int rc = 1;
+  IStream *stream = Stream::CreateStream();
+  Lisp *lisp = new Lisp();
+  HostValue *args = new HostValue[BENCH_CALLS * 2];
+  HostValue *builtin = new HostValue[BENCH_CALLS];
+  HostValue *native = new HostValue[BENCH_CALLS];
+
+  srand(2016);
+  for (int i = 0; i < BENCH_CALLS * 2; i++)
+    {
+      args[i].type = OBJTYPE_NUMBER;
+      args[i].u.number = rand() % 1000 / 10.0;
+    }
+
+  SynNode *res;
+  if (stream && LP_SUCCESS(stream->Open(BENCH_RULE_FILE, "r"))
+      && LP_SUCCESS(lisp->registerNumber("hadd", hostAdd))
+      && LP_SUCCESS(lisp->registerNumber("hmul", hostMul))
+      && LP_SUCCESS(lisp->load(stream, &res)))
+    {
+      double t0 = timeCalls(lisp, "by-builtin", args, builtin);
+      double t1 = timeCalls(lisp, "by-native", args, native);
+      if (t0 >= 0 && t1 >= 0)
+        {
+          int mismatched = 0;
+          for (int i = 0; i < BENCH_CALLS; i++)
+            {
+              if (builtin[i].type != OBJTYPE_NUMBER || native[i].type != OBJTYPE_NUMBER
+                  || builtin[i].u.number != native[i].u.number)
+                mismatched++;
+            }
+          printf("native: %d calls, builtins %.3fs, registerNumber %.3fs, %d mismatched\n",
+                 BENCH_CALLS, t0, t1, mismatched);
+          rc = mismatched ? 1 : 0;
+        }
+    }
+  if (rc)
+    printf("native: failed\n");
+
+  delete [] native;
+  delete [] builtin;
+  delete [] args;
+  delete lisp;
+  if (stream)
+    {
+      stream->Close();
+      delete stream;
+    }
+  remove(BENCH_RULE_FILE);
+  return rc;
+}
+
+#define BENCH_PMAP_ITEMS (64)
+#define BENCH_PMAP_FIB (20)
+
+/**
+ * Inner, get the elapsed time in seconds, as the processor time counts
+ * all the threads.
+ */
+static double
+wallSeconds()
+{
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * Inner, time a map of fib over the items with the parallelism.
+ * @param script The script defining fib and the items.
+ * @param threads Number of the threads, 0 for the calling thread.
+ * @param out Where to store the output.
+ * @return the time in seconds, negative if failed.
+ */
+static double
+timeMap(const char *script, size_t threads, StringPool &out)
+{
+  double t = -1.0;
+  IStream *stream = Stream::CreateStream();
+  Lisp *lisp = new Lisp();
+  SynNode *res;
+
+  lisp->setParallelism(threads);
+  if (stream && LP_SUCCESS(stream->Open(script, "r")))
+    {
+      double t0 = wallSeconds();
+      if (LP_SUCCESS(lisp->load(stream, &res)) && LP_SUCCESS(Lisp::formatNode(res, out)))
+        t = wallSeconds() - t0;
+      stream->Close();
+    }
+  delete lisp;
+  delete stream;
+  return t;
+}
+
+/**
+ * Compare pmap on the pool with the map in the calling thread, the
+ * results must be identical and in the same order.
+ * @return 0 if succeeded.
+ */
+static int
+benchPMap()
+{
+  FILE *fp = fopen(BENCH_RULE_FILE, "w");
+  if (!fp)
+    return 1;
+  fputs("(define fib (lambda (n) (cond ((< n 2) n) (else (+ (fib (- n 1)) (fib (- n 2)))))))\n", fp);
+  fputs("(pmap fib (quote (", fp);
+  for (int i = 0; i < BENCH_PMAP_ITEMS; i++)
+    fprintf(fp, " %d", BENCH_PMAP_FIB - i % 4);
+  fputs(")))\n", fp);
+  fclose(fp);
+
+  StringPool seq, par;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  double t0 = timeMap(BENCH_RULE_FILE, 0, seq);
+  double t1 = timeMap(BENCH_RULE_FILE, threads > 1 ? threads : 2, par);
+  remove(BENCH_RULE_FILE);
+
+  if (t0 < 0 || t1 < 0 || seq.length() != par.length()
+      || memcmp(seq.buffer(), par.buffer(), seq.length()))
+    {
+      printf("pmap: failed\n");
+      return 1;
+    }
+  printf("pmap: %d items, calling thread %.3fs, %ld threads %.3fs\n",
+         BENCH_PMAP_ITEMS, t0, threads > 1 ? threads : 2, t1);
+  return 0;
+}
+
+#define BENCH_GC_TABLES (8)
+#define BENCH_GC_ROWS (1000)
+#define BENCH_GC_FORMS (400)
+#define BENCH_GC_TRIGGER (1024 * 1024)
+#define BENCH_GC_SLICE (100) /* microseconds */
+
+/**
+ * Inner, load the script with the collections and print the pauses.
+ * @param script The script.
+ * @param threads Number of the threads marking, 0 for the calling thread.
+ * @param budget Microseconds of each slice of the incremental marking,
+ *               0 to mark at once.
+ * @param out Where to store the output.
+ * @return status code.
+ */
+static int
+timeCollect(const char *script, size_t threads, unsigned long budget, StringPool &out)
+{
+  int rc = LERR_ALLOC_MEMORY;
+  IStream *stream = Stream::CreateStream();
+  Lisp *lisp = new Lisp();
+  SynNode *res;
+
+  lisp->setParallelism(threads);
+  lisp->gc().setTrigger(BENCH_GC_TRIGGER);
+  lisp->gc().setSliceBudget(budget);
+  if (stream && LP_SUCCESS(rc = stream->Open(script, "r")))
+    {
+      double t0 = wallSeconds();
+      rc = lisp->load(stream, &res);
+      if (LP_SUCCESS(rc))
+        rc = Lisp::formatNode(res, out);
+      double t = wallSeconds() - t0;
+      stream->Close();
+
+      const GCStats &stats = lisp->gc().stats();
+      unsigned long long pauses = 0;
+      for (size_t i = 0; i < GC_PAUSE_BUCKETS; i++)
+        pauses += stats.pauses[i];
+      printf("gc: %lu threads, %luus slices, %.3fs, %lu collections, %lu slices, "
+             "%.1fMB freed, %.1fMB alive, pause mean %lluus max %lluus\n",
+             static_cast<unsigned long>(threads), budget, t,
+             static_cast<unsigned long>(stats.collections),
+             static_cast<unsigned long>(stats.slices),
+             stats.bytesFreed / 1048576.0, lisp->gc().allocated() / 1048576.0,
+             pauses ? stats.pauseTotal / pauses : 0ULL, stats.pauseMax);
+      for (size_t i = 0; i < GC_PAUSE_BUCKETS; i++)
+        {
+          if (stats.pauses[i])
+            printf("gc:   < %8luus %lu\n", 2UL << i, static_cast<unsigned long>(stats.pauses[i]));
+        }
+    }
+  delete lisp;
+  delete stream;
+  return rc;
+}
+
+/**
+ * Build the garbage around the tables alive, with the marking in the
+ * calling thread, on the pool and in slices, the results must be
+ * identical.
+ * @return 0 if succeeded.
+ */
+static int
+benchCollect()
+{
+  FILE *fp = fopen(BENCH_RULE_FILE, "w");
+  if (!fp)
+    return 1;
+  fputs("(define build (lambda (n acc) (cond ((= n 0) acc)"
+        " (else (build (- n 1) (cons (cons n (number->string n)) acc))))))\n", fp);
+  fputs("(define sum (lambda (l n acc) (cond ((= n 0) acc)"
+        " (else (sum (cdr l) (- n 1) (+ acc (car (car l))))))))\n", fp);
+  for (int i = 0; i < BENCH_GC_TABLES; i++)
+    fprintf(fp, "(define table%d (build %d (quote ())))\n", i, BENCH_GC_ROWS);
+  for (int i = 0; i < BENCH_GC_FORMS; i++)
+    fprintf(fp, "(sum (build %d (quote ())) %d 0)\n", BENCH_GC_ROWS, BENCH_GC_ROWS);
+  for (int i = 0; i < BENCH_GC_TABLES; i++)
+    fprintf(fp, "(sum table%d %d 0)\n", i, BENCH_GC_ROWS);
+  fclose(fp);
+
+  StringPool seq, par, inc;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int rc0 = timeCollect(BENCH_RULE_FILE, 0, 0, seq);
+  int rc1 = timeCollect(BENCH_RULE_FILE, threads > 1 ? threads : 2, 0, par);
+  int rc2 = timeCollect(BENCH_RULE_FILE, 0, BENCH_GC_SLICE, inc);
+  remove(BENCH_RULE_FILE);
+
+  if (LP_FAILURE(rc0) || LP_FAILURE(rc1) || LP_FAILURE(rc2)
+      || seq.length() != par.length() || memcmp(seq.buffer(), par.buffer(), seq.length())
+      || seq.length() != inc.length() || memcmp(seq.buffer(), inc.buffer(), seq.length()))
+    {
+      printf("gc: failed\n");
+      return 1;
+    }
+  return 0;
+}
+
+#define BENCH_IMAGE_FUNCS (2000)
+#define BENCH_IMAGE_TABLES (8)
+#define BENCH_IMAGE_STARTS (20)
+#define BENCH_IMAGE_FILE "bench_image.lspi"
+
+/**
+ * Inner, start a instance by evaluating the prelude or loading the image,
+ * then call the last function defined.
+ * @param image Whether to load the image.
+ * @param result Where to store the result of the call.
+ * @return status code.
+ */
+static int
+startInstance(bool image, __OUT double *result)
+{
+  int rc = LINF_SUCCEEDED;
+  Lisp *lisp = new Lisp();
+  if (image)
+    rc = lisp->loadImage(BENCH_IMAGE_FILE);
+  else
+    {
+      IStream *stream = Stream::CreateStream();
+      if (!stream)
+        rc = LERR_ALLOC_MEMORY;
+      else if (LP_SUCCESS(rc = stream->Open(BENCH_RULE_FILE, "r")))
+        {
+          rc = lisp->load(stream, 0);
+          stream->Close();
+        }
+      delete stream;
+    }
+
+  char name[32];
+  SynNode *proc;
+  HostValue arg, res;
+  snprintf(name, sizeof(name), "f%d", BENCH_IMAGE_FUNCS - 1);
+  arg.type = OBJTYPE_NUMBER;
+  arg.u.number = 1;
+  if (LP_SUCCESS(rc))
+    rc = lisp->lookupProcedure(name, &proc);
+  if (LP_SUCCESS(rc))
+    rc = lisp->applyBatch(proc, &arg, 1, 1, &res, 0);
+  if (LP_SUCCESS(rc))
+    *result = res.type == OBJTYPE_NUMBER ? res.u.number : 0;
+  delete lisp;
+  return rc;
+}
+
+/**
+ * Compare the startup by evaluating a prelude of many functions with
+ * loading the image saved after it, the calls must give the same result.
+ * @return 0 if succeeded.
+ */
+static int
+benchImage()
+{
+  FILE *fp = fopen(BENCH_RULE_FILE, "w");
+  if (!fp)
+    return 1;
+  fputs("(define f0 (lambda (x) x))\n", fp);
+  for (int i = 1; i < BENCH_IMAGE_FUNCS; i++)
+    fprintf(fp, "(define f%d (lambda (x) (cond ((> x %d) (f%d (- x 1))) (else (+ x %d)))))\n",
+            i, i % 10, i - 1, i % 7);
+  /* the values computed by the prelude are loaded rather than computed */
+  fputs("(define fib (lambda (n) (cond ((< n 2) n) (else (+ (fib (- n 1)) (fib (- n 2)))))))\n", fp);
+  for (int i = 0; i < BENCH_IMAGE_TABLES; i++)
+    fprintf(fp, "(define table%d (fib %d))\n", i, BENCH_PMAP_FIB - i % 4);
+  fclose(fp);
+
+  int rc = 0;
+  Lisp *lisp = new Lisp();
+  IStream *stream = Stream::CreateStream();
+  if (!stream || LP_FAILURE(stream->Open(BENCH_RULE_FILE, "r"))
+      || LP_FAILURE(lisp->load(stream, 0)) || LP_FAILURE(lisp->saveImage(BENCH_IMAGE_FILE)))
+    rc = 1;
+  if (stream)
+    {
+      stream->Close();
+      delete stream;
+    }
+  delete lisp;
+
+  double evaluated = 0, loaded = 0;
+  double t0 = wallSeconds();
+  for (int i = 0; i < BENCH_IMAGE_STARTS && !rc; i++)
+    rc = LP_FAILURE(startInstance(false, &evaluated));
+  double t1 = wallSeconds();
+  for (int i = 0; i < BENCH_IMAGE_STARTS && !rc; i++)
+    rc = LP_FAILURE(startInstance(true, &loaded));
+  double t2 = wallSeconds();
+  remove(BENCH_RULE_FILE);
+  remove(BENCH_IMAGE_FILE);
+
+  if (rc || evaluated != loaded)
+    {
+      printf("image: failed\n");
+      return 1;
+    }
+  printf("image: %d functions, prelude %.2fms, image %.2fms per start\n",
+         BENCH_IMAGE_FUNCS, (t1 - t0) * 1e3 / BENCH_IMAGE_STARTS, (t2 - t1) * 1e3 / BENCH_IMAGE_STARTS);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char *which = argc > 1 ? argv[1] : "all";
+  int rc = 0;
+
+  if (!strcmp(which, "all") || !strcmp(which, "number"))
+    rc |= benchNumber();
+  if (!strcmp(which, "all") || !strcmp(which, "string"))
+    rc |= benchString();
+  if (!strcmp(which, "all") || !strcmp(which, "apply"))
+    rc |= benchApply();
+  if (!strcmp(which, "all") || !strcmp(which, "native"))
+    rc |= benchNative();
+  if (!strcmp(which, "all") || !strcmp(which, "pmap"))
+    rc |= benchPMap();
+  if (!strcmp(which, "all") || !strcmp(which, "gc"))
+    rc |= benchCollect();
+  if (!strcmp(which, "all") || !strcmp(which, "image"))
+    rc |= benchImage();
+
+  return rc;
+}
@@ -0,0 +1,711 @@
+/** @file
+ * LispDSL - Stress test of one interpreter per thread.
+ *
+ * Build:
+ *  g++ -O2 -pthread -Iinclude tests/stress.cpp $(find src -name '*.cpp' ! -name main.cpp) -o stress
+ * Usage:
+ *  stress [threads]
+ */
+
+/*
+ *  LispDSL is Copyleft (C) 2016, The 1st Middle School in Yongsheng Lijiang China
+ *  please contact with <diyer175@hotmail.com> if you have any problems.
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "lispdsl.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+using namespace DSL;
+
+#define STRESS_RUNS (2000)
+#define STRESS_RECORDS (20000)
+#define STRESS_MAX_THREADS (256)
+#define STRESS_SCRIPT "stress.scm"
+#define STRESS_ERROR_SCRIPT "stress_err.scm"
+#define STRESS_PRODUCER_SCRIPT "stress_src.scm"
+#define STRESS_STAGE_SCRIPT "stress_stage.scm"
+#define STRESS_RUNAWAY_SCRIPT "stress_runaway.scm"
+#define STRESS_HEAP_LIMIT (1024 * 1024)
+#define STRESS_GROW_SCRIPT "stress_grow.scm"
+#define STRESS_GROW_LIMIT_MIN (100001)
+#define STRESS_GROW_LIMIT_MAX (400000)
+#define STRESS_GROW_LIMIT_STEP (8000)
+#define STRESS_SLICED_SCRIPT "stress_sliced.scm"
+#define STRESS_SLICED_INSTANCES (16)
+#define STRESS_SLICED_THREADS (2)
+#define STRESS_SLICE_FUEL (500)
+#define STRESS_METERED_MAP_SCRIPT "stress_meter_map.scm"
+#define STRESS_METERED_FUTURE_SCRIPT "stress_meter_future.scm"
+#define STRESS_METERED_FUEL (10000)
+#define STRESS_METERED_DEADLINE (20) /* ms */
+#define STRESS_FUEL_SWEEP (200)
+#define STRESS_PIPELINE_ITEMS (100) /* as in the producer script */
+#define STRESS_PIPELINE_CAPACITY (8)
+
+static const char stressScript[] =
+    "(\n"
+    "(define total 0)\n"
+    "(define fact (lambda (n) (cond ((= n 0) 1) (else (* n (fact (- n 1)))))))\n"
+    "(define scaled (lambda (n) (scale (fact n) 2)))\n"
+    /* the bindings named as the host function shadow it */
+    "(define neg (lambda (x) (- 0 x)))\n"
+    "(define shadow-param (lambda (scale n) (scale n)))\n"
+    "(define shadow-local (lambda (n) (define scale (lambda (x y) (- x y))) (scale n 1)))\n"
+    "(define shadowed (lambda (n) (+ (shadow-param neg n) (* 10 (shadow-local n)))))\n"
+    "(define port (open-output-string))\n"
+    "(display (fact 10) port)\n"
+    "(set! total (+ total (fact 5)))\n"
+    "(display (string-append \"total \" (number->string total) \" \" (get-output-string port)))\n"
+    "(display (cdr (quote (1 .2 .3 1.4 2.5 6 7))))\n"
+    "(display (pmap fact (quote (1 2 3 4 5 6 7 8 9 10))))\n"
+    "(define later (future (lambda () (fact 12))))\n"
+    "(set! total (+ total 1))\n" /* not read by the future pending */
+    "(display total)\n"
+    "(display (touch later))\n"
+    ")\n";
+
+static const char stressErrorScript[] =
+    "(\n"
+    "(display (+ 1 \"a\"))\n"
+    ")\n";
+
+static const char runawayScript[] =
+    "(\n"
+    "(define grow (lambda (s) (grow (string-append s s))))\n"
+    "(grow \"runaway\")\n"
+    ")\n";
+
+/*
+ * The list keeps growing in the tests of cond, until the hard limit.
+ */
+static const char growScript[] =
+    "(\n"
+    "(define kept 0)\n"
+    "(define grow (lambda (n) (cond ((< n 1) kept)\n"
+    "                               (else (begin (set! kept (cons n kept)) (grow (- n 1)) (grow (- n 1)))))))\n"
+    "(grow 30)\n"
+    ")\n";
+
+static const char slicedScript[] =
+    "(\n"
+    "(define fib (lambda (n) (cond ((< n 2) n) (else (+ (fib (- n 1)) (fib (- n 2)))))))\n"
+    "(define count (lambda (n) (cond ((> n 10) n) (else (begin (display (fib n)) (count (+ n 1)))))))\n"
+    "(count 1)\n"
+    ")\n";
+
+/*
+ * The workers evaluate far more than the fuel and the time allowed,
+ * which are shared with them.
+ */
+static const char meteredMapScript[] =
+    "(\n"
+    "(define fib (lambda (n) (cond ((< n 2) n) (else (+ (fib (- n 1)) (fib (- n 2)))))))\n"
+    "(display (pmap fib (quote (24 24 24 24))))\n"
+    ")\n";
+
+static const char meteredFutureScript[] =
+    "(\n"
+    "(define fib (lambda (n) (cond ((< n 2) n) (else (+ (fib (- n 1)) (fib (- n 2)))))))\n"
+    "(define later (future (lambda () (fib 24))))\n"
+    "(display (touch later))\n"
+    ")\n";
+
+/*
+ * The pipeline of two instances on threads of their own, the host
+ * receives the squares from the stage.
+ */
+static const char producerScript[] =
+    "(\n"
+    "(define produce (lambda (n) (cond ((> n 100) (channel-close \"numbers\"))\n"
+    "                                  (else (begin (channel-send \"numbers\" n) (produce (+ n 1)))))))\n"
+    "(produce 1)\n"
+    ")\n";
+
+static const char stageScript[] =
+    "(\n"
+    "(define stage (lambda (v) (cond ((< v 0) (channel-close \"squares\"))\n"
+    "                                (else (begin (channel-send \"squares\" (cons v (* v v)))\n"
+    "                                             (stage (channel-recv \"numbers\" -1)))))))\n"
+    "(stage (channel-recv \"numbers\" -1))\n"
+    ")\n";
+
+/*
+ * State of each thread, nothing is shared between them.
+ */
+struct Worker
+{
+  pthread_t  thread;
+  const Program *program;
+  int        id;
+  int        failed;
+  int        errors;
+  StringPool output;
+  char       message[_MAX_MSG_BUFFER];
+};
+
+/**
+ * Inner, the output sink of each instance.
+ */
+static int
+writeOutput(const char *buff, size_t len, void *opaque)
+{
+  return static_cast<Worker *>(opaque)->output.append(buff, len);
+}
+
+/**
+ * Inner, the error sink of each instance.
+ */
+static void
+reportError(file_off line, file_off column, const char *msg, void *opaque)
+{
+  Worker *w = static_cast<Worker *>(opaque);
+  w->errors++;
+  snprintf(w->message, sizeof(w->message), "%d:%d %s",
+           static_cast<int>(line), static_cast<int>(column), msg);
+}
+
+static double hostScale(double x, double y) { return x * y + 1; }
+
+/**
+ * Inner, parse a script with a new stream.
+ * @return status code.
+ */
+static int
+parseScript(Lisp *lisp, const char *filename)
+{
+  IStream *stream = Stream::CreateStream();
+  if (!stream)
+    return LERR_ALLOC_MEMORY;
+  int rc = stream->Open(filename, "r");
+  if (LP_SUCCESS(rc))
+    {
+      rc = lisp->parser(stream);
+      stream->Close();
+    }
+  delete stream;
+  return rc;
+}
+
+/**
+ * Inner, run the shared program many times in a instance of its own,
+ * the output of each run must be identical with the first one.
+ */
+static void *
+work(void *arg)
+{
+  Worker *w = static_cast<Worker *>(arg);
+  Lisp *lisp = new Lisp();
+  lisp->setOutputSink(writeOutput, w);
+  lisp->setErrorSink(reportError, w);
+
+  /* the errors are reported to this instance only */
+  if (LP_SUCCESS(parseScript(lisp, STRESS_ERROR_SCRIPT)) && LP_SUCCESS(lisp->run(0)))
+    w->failed++;
+  if (w->errors != 1 || !strstr(w->message, "2:15 add"))
+    w->failed++;
+  delete lisp;
+
+  /* the runaway script is stopped by the limit of its instance */
+  lisp = new Lisp();
+  lisp->setOutputSink(writeOutput, w);
+  lisp->setErrorSink(reportError, w);
+  lisp->gc().setLimits(0, STRESS_HEAP_LIMIT);
+  if (LP_FAILURE(parseScript(lisp, STRESS_RUNAWAY_SCRIPT)) || LERR_HEAP_LIMIT != lisp->run(0)
+      || lisp->gc().allocated() > STRESS_HEAP_LIMIT)
+    w->failed++;
+  delete lisp;
+
+  lisp = new Lisp();
+  lisp->setOutputSink(writeOutput, w);
+  lisp->setErrorSink(reportError, w);
+  lisp->setParallelism(2); /* the pmap and future of each run are on a pool of its own */
+
+  /* the program is parsed once and shared by all the threads */
+  if (LP_FAILURE(lisp->attach(w->program)) || LP_FAILURE(lisp->snapshot()))
+    {
+      w->failed++;
+      delete lisp;
+      return 0;
+    }
+
+  StringPool first;
+  for (int i = 0; i < STRESS_RUNS && !w->failed; i++)
+    {
+      w->output.copy("", 0);
+      if (LP_FAILURE(lisp->run(0)) || LP_FAILURE(lisp->reset()))
+        w->failed++;
+      else if (i == 0)
+        first.copy(w->output);
+      else if (w->output.length() != first.length()
+               || memcmp(w->output.buffer(), first.buffer(), first.length()))
+        w->failed++;
+    }
+
+  /* a host function on a batch of records, with the definitions kept */
+  SynNode *scaled, *shadowed;
+  HostValue shadowArg, shadowResult;
+  shadowArg.type = OBJTYPE_NUMBER;
+  shadowArg.u.number = 5;
+  HostValue *args = new HostValue[STRESS_RECORDS];
+  HostValue *results = new HostValue[STRESS_RECORDS];
+  for (int i = 0; i < STRESS_RECORDS; i++)
+    {
+      args[i].type = OBJTYPE_NUMBER;
+      args[i].u.number = (i + w->id) % 10;
+    }
+  if (w->failed
+      || LP_FAILURE(lisp->registerNumber("scale", hostScale))
+      || LP_FAILURE(lisp->run(0))
+      || LP_FAILURE(lisp->lookupProcedure("scaled", &scaled))
+      || LP_FAILURE(lisp->applyBatch(scaled, args, 1, STRESS_RECORDS, results, 0))
+      || LP_FAILURE(lisp->lookupProcedure("shadowed", &shadowed))
+      || LP_FAILURE(lisp->apply(shadowed, &shadowArg, 1, &shadowResult, 0))
+      || shadowResult.type != OBJTYPE_NUMBER || shadowResult.u.number != 35)
+    w->failed++;
+  else
+    {
+      for (int i = 0; i < STRESS_RECORDS; i++)
+        {
+          double f = 1;
+          for (int n = static_cast<int>(args[i].u.number); n > 0; n--)
+            f *= n;
+          if (results[i].type != OBJTYPE_NUMBER || results[i].u.number != f * 2 + 1)
+            w->failed++;
+        }
+    }
+
+  w->output.move(first);
+  delete [] results;
+  delete [] args;
+  delete lisp;
+  return 0;
+}
+
+/*
+ * Stage of the pipeline, sharing only the channels.
+ */
+struct Stage
+{
+  pthread_t   thread;
+  const char *script;
+  Channel    *numbers;
+  Channel    *squares;
+  int         failed;
+};
+
+/**
+ * Inner, run a stage of the pipeline in a instance of its own.
+ */
+static void *
+runStage(void *arg)
+{
+  Stage *stage = static_cast<Stage *>(arg);
+  Lisp *lisp = new Lisp();
+  if (LP_FAILURE(lisp->registerChannel("numbers", stage->numbers))
+      || LP_FAILURE(lisp->registerChannel("squares", stage->squares))
+      || LP_FAILURE(parseScript(lisp, stage->script))
+      || LP_FAILURE(lisp->run(0)))
+    {
+      stage->failed++;
+      /* let the others finish */
+      stage->numbers->close();
+      stage->squares->close();
+    }
+  delete lisp;
+  return 0;
+}
+
+/**
+ * Inner, run the pipeline and check the values received in order.
+ * @return number of the failures.
+ */
+static int
+runPipeline()
+{
+  Channel numbers, squares;
+  if (LP_FAILURE(numbers.open(STRESS_PIPELINE_CAPACITY))
+      || LP_FAILURE(squares.open(STRESS_PIPELINE_CAPACITY)))
+    return 1;
+
+  Stage stages[2];
+  const char *scripts[2] = {STRESS_PRODUCER_SCRIPT, STRESS_STAGE_SCRIPT};
+  for (int i = 0; i < 2; i++)
+    {
+      stages[i].script = scripts[i];
+      stages[i].numbers = &numbers;
+      stages[i].squares = &squares;
+      stages[i].failed = 0;
+      if (pthread_create(&stages[i].thread, 0, runStage, &stages[i]))
+        return 1;
+    }
+
+  /* the host receives into a heap of its own */
+  GC gc;
+  SynNode *value;
+  int failed = 0, received = 0, rc;
+  while (LINF_END_OF_STREAM != (rc = squares.recv(gc, &value)))
+    {
+      received++;
+      if (LP_FAILURE(rc) || !value || OBJTYPE_PAIR != value->object.type
+          || OBJ_VALUE(OBJTYPE_NUMBER, OBJ_LEAF(value)) != received
+          || OBJ_VALUE(OBJTYPE_NUMBER, OBJ_NEXT(value)) != received * received)
+        failed++;
+    }
+  for (int i = 0; i < 2; i++)
+    {
+      pthread_join(stages[i].thread, 0);
+      failed += stages[i].failed;
+    }
+  return failed + (received != STRESS_PIPELINE_ITEMS);
+}
+
+/*
+ * Instances time-sliced on a few threads, see Lisp::setPreemptive().
+ */
+struct Slicer
+{
+  pthread_mutex_t lock;
+  Lisp      *lisps[STRESS_SLICED_INSTANCES];
+  StringPool outputs[STRESS_SLICED_INSTANCES];
+  bool       started[STRESS_SLICED_INSTANCES];
+  int        queue[STRESS_SLICED_INSTANCES]; /* ring of the runnable */
+  int        head;
+  int        count;
+  int        remaining;
+  int        slices;
+  int        failed;
+};
+
+/**
+ * Inner, the output sink of each time-sliced instance.
+ */
+static int
+writeSliced(const char *buff, size_t len, void *opaque)
+{
+  return static_cast<StringPool *>(opaque)->append(buff, len);
+}
+
+/**
+ * Inner, run a slice of the instances in turn until all are finished.
+ */
+static void *
+runSlices(void *arg)
+{
+  Slicer *s = static_cast<Slicer *>(arg);
+  for (;;)
+    {
+      pthread_mutex_lock(&s->lock);
+      if (!s->remaining)
+        {
+          pthread_mutex_unlock(&s->lock);
+          return 0;
+        }
+      if (!s->count)
+        {
+          /* all are running on the other threads */
+          pthread_mutex_unlock(&s->lock);
+          sched_yield();
+          continue;
+        }
+      int i = s->queue[s->head];
+      s->head = (s->head + 1) % STRESS_SLICED_INSTANCES;
+      s->count--;
+      bool started = s->started[i];
+      s->started[i] = true;
+      pthread_mutex_unlock(&s->lock);
+
+      /* it may be resumed on another thread than last time */
+      s->lisps[i]->setFuel(STRESS_SLICE_FUEL);
+      int rc = started ? s->lisps[i]->resume(0) : s->lisps[i]->run(0);
+
+      pthread_mutex_lock(&s->lock);
+      s->slices++;
+      if (LINF_SUSPENDED == rc)
+        {
+          s->queue[(s->head + s->count) % STRESS_SLICED_INSTANCES] = i;
+          s->count++;
+        }
+      else
+        {
+          if (LP_FAILURE(rc))
+            s->failed++;
+          s->remaining--;
+        }
+      pthread_mutex_unlock(&s->lock);
+    }
+}
+
+/**
+ * Inner, run the instances time-sliced, the output of each must be
+ * identical with the one run at once.
+ * @param slices Where to store the number of slices run.
+ * @return number of the failures.
+ */
+static int
+runSliced(int *slices)
+{
+  int failed = 0;
+  StringPool expected;
+  Lisp *lisp = new Lisp();
+  lisp->setOutputSink(writeSliced, &expected);
+  if (LP_FAILURE(parseScript(lisp, STRESS_SLICED_SCRIPT)) || LP_FAILURE(lisp->run(0)))
+    failed++;
+  delete lisp;
+
+  Slicer s;
+  pthread_mutex_init(&s.lock, 0);
+  s.head = 0;
+  s.count = s.remaining = STRESS_SLICED_INSTANCES;
+  s.slices = 0;
+  s.failed = 0;
+  for (int i = 0; i < STRESS_SLICED_INSTANCES; i++)
+    {
+      s.lisps[i] = new Lisp();
+      s.lisps[i]->setOutputSink(writeSliced, &s.outputs[i]);
+      s.lisps[i]->setPreemptive(true);
+      s.started[i] = false;
+      s.queue[i] = i;
+      if (LP_FAILURE(parseScript(s.lisps[i], STRESS_SLICED_SCRIPT)))
+        failed++;
+    }
+
+  pthread_t threads[STRESS_SLICED_THREADS];
+  int created = 0;
+  for (; !failed && created < STRESS_SLICED_THREADS; created++)
+    {
+      if (pthread_create(&threads[created], 0, runSlices, &s))
+        {
+          failed++;
+          break;
+        }
+    }
+  for (int i = 0; i < created; i++)
+    pthread_join(threads[i], 0);
+
+  failed += s.failed;
+  for (int i = 0; i < STRESS_SLICED_INSTANCES; i++)
+    {
+      if (!created || s.outputs[i].length() != expected.length()
+          || memcmp(s.outputs[i].buffer(), expected.buffer(), expected.length()))
+        failed++;
+      delete s.lisps[i];
+    }
+  pthread_mutex_destroy(&s.lock);
+  *slices = s.slices;
+  return failed;
+}
+
+/**
+ * Inner, the error sink of the metered instances.
+ */
+static void
+countError(file_off line, file_off column, const char *msg, void *opaque)
+{
+  UNUSED(line);
+  UNUSED(column);
+  UNUSED(msg);
+  (*static_cast<int *>(opaque))++;
+}
+
+/**
+ * Inner, run a script with the fuel or the deadline, it must fail with
+ * LERR_OUT_OF_FUEL and report the error.
+ * @return 1 if not.
+ */
+static int
+runOutOfFuel(const char *script, size_t parallelism, unsigned long long fuel,
+             unsigned long deadline)
+{
+  StringPool output;
+  int errors = 0, failed = 0;
+  Lisp *lisp = new Lisp();
+  lisp->setOutputSink(writeSliced, &output);
+  lisp->setErrorSink(countError, &errors);
+  lisp->setParallelism(parallelism);
+  lisp->setFuel(fuel);
+  lisp->setDeadline(deadline);
+  if (LP_FAILURE(parseScript(lisp, script)) || LERR_OUT_OF_FUEL != lisp->run(0) || !errors)
+    failed = 1;
+  delete lisp;
+  return failed;
+}
+
+/**
+ * Inner, run the maps and the futures on a pool with the fuel or the
+ * deadline, each must fail with LERR_OUT_OF_FUEL. The fuel is swept
+ * over the scripts of cond, so that it runs out in every place.
+ * @return number of the failures.
+ */
+static int
+runMetered()
+{
+  int failed = 0;
+  const char *scripts[2] = {STRESS_METERED_MAP_SCRIPT, STRESS_METERED_FUTURE_SCRIPT};
+  for (int i = 0; i < 2; i++)
+    {
+      failed += runOutOfFuel(scripts[i], 2, STRESS_METERED_FUEL, 0);
+      failed += runOutOfFuel(scripts[i], 2, LISP_FUEL_UNLIMITED, STRESS_METERED_DEADLINE);
+    }
+  for (unsigned long long fuel = 0; fuel < STRESS_FUEL_SWEEP; fuel++)
+    {
+      failed += runOutOfFuel(STRESS_SLICED_SCRIPT, 0, fuel, 0);
+      failed += runOutOfFuel(scripts[fuel % 2], 2, fuel, 0);
+    }
+  return failed;
+}
+
+/**
+ * Inner, run the growing script with the hard limits swept, each run
+ * must fail with LERR_HEAP_LIMIT and report the error.
+ * @return number of the failures.
+ */
+static int
+runHeapLimits()
+{
+  int failed = 0;
+  for (size_t limit = STRESS_GROW_LIMIT_MIN; limit <= STRESS_GROW_LIMIT_MAX;
+       limit += STRESS_GROW_LIMIT_STEP)
+    {
+      StringPool output;
+      int errors = 0;
+      Lisp *lisp = new Lisp();
+      lisp->setOutputSink(writeSliced, &output);
+      lisp->setErrorSink(countError, &errors);
+      lisp->gc().setLimits(0, limit);
+      if (LP_FAILURE(parseScript(lisp, STRESS_GROW_SCRIPT)) || LERR_HEAP_LIMIT != lisp->run(0)
+          || errors != 1)
+        failed++;
+      delete lisp;
+    }
+  return failed;
+}
+
+/**
+ * Write the text to a file.
+ * @return 0 if succeeded.
+ */
+static int
+writeFile(const char *filename, const char *text)
+{
+  FILE *fp = fopen(filename, "w");
+  if (!fp)
+    return 1;
+  fputs(text, fp);
+  fclose(fp);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  long threads = argc > 1 ? atol(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1)
+    threads = 1;
+  if (threads > STRESS_MAX_THREADS)
+    threads = STRESS_MAX_THREADS;
+
+  if (writeFile(STRESS_SCRIPT, stressScript) || writeFile(STRESS_ERROR_SCRIPT, stressErrorScript)
+      || writeFile(STRESS_PRODUCER_SCRIPT, producerScript) || writeFile(STRESS_STAGE_SCRIPT, stageScript)
+      || writeFile(STRESS_RUNAWAY_SCRIPT, runawayScript) || writeFile(STRESS_SLICED_SCRIPT, slicedScript)
+      || writeFile(STRESS_METERED_MAP_SCRIPT, meteredMapScript)
+      || writeFile(STRESS_METERED_FUTURE_SCRIPT, meteredFutureScript)
+      || writeFile(STRESS_GROW_SCRIPT, growScript))
+    {
+      printf("stress: can not write the scripts\n");
+      return 1;
+    }
+
+  Program program;
+  if (LP_FAILURE(program.parseFile(STRESS_SCRIPT)))
+    {
+      printf("stress: can not parse the script\n");
+      return 1;
+    }
+
+  Worker *workers = new Worker[threads];
+  for (long i = 0; i < threads; i++)
+    {
+      workers[i].program = &program;
+      workers[i].id = static_cast<int>(i);
+      workers[i].failed = 0;
+      workers[i].errors = 0;
+      workers[i].message[0] = '\0';
+      if (pthread_create(&workers[i].thread, 0, work, &workers[i]))
+        {
+          printf("stress: can not create thread %ld\n", i);
+          return 1;
+        }
+    }
+
+  int failed = 0;
+  for (long i = 0; i < threads; i++)
+    {
+      pthread_join(workers[i].thread, 0);
+      if (workers[i].failed)
+        {
+          printf("stress: thread %ld failed, error '%s'\n", i, workers[i].message);
+          failed++;
+        }
+      /* all the threads must produce the same output */
+      else if (workers[i].output.length() != workers[0].output.length()
+               || memcmp(workers[i].output.buffer(), workers[0].output.buffer(),
+                         workers[0].output.length()))
+        {
+          printf("stress: thread %ld produced different output\n", i);
+          failed++;
+        }
+    }
+
+  printf("stress: %ld threads, %d runs and %d records each, %d failed\n",
+         threads, STRESS_RUNS, STRESS_RECORDS, failed);
+
+  int pipeline = runPipeline();
+  printf("stress: pipeline of %d values, %d failed\n", STRESS_PIPELINE_ITEMS, pipeline);
+  failed += pipeline;
+
+  int slices;
+  int sliced = runSliced(&slices);
+  printf("stress: %d instances in %d slices on %d threads, %d failed\n",
+         STRESS_SLICED_INSTANCES, slices, STRESS_SLICED_THREADS, sliced);
+  failed += sliced;
+
+  int metered = runMetered();
+  printf("stress: maps and futures on 2 threads metered, %d failed\n", metered);
+  failed += metered;
+
+  int limited = runHeapLimits();
+  printf("stress: hard limits of heap swept, %d failed\n", limited);
+  failed += limited;
+  if (threads)
+    printf("%.*s", static_cast<int>(workers[0].output.length()), workers[0].output.buffer());
+
+  delete [] workers;
+  remove(STRESS_SCRIPT);
+  remove(STRESS_ERROR_SCRIPT);
+  remove(STRESS_PRODUCER_SCRIPT);
+  remove(STRESS_STAGE_SCRIPT);
+  remove(STRESS_RUNAWAY_SCRIPT);
+  remove(STRESS_SLICED_SCRIPT);
+  remove(STRESS_METERED_MAP_SCRIPT);
+  remove(STRESS_METERED_FUTURE_SCRIPT);
+  remove(STRESS_GROW_SCRIPT);
+  return failed ? 1 : 0;
+}
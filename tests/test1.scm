@@ -0,0 +1,20 @@
+;
+; streaming mode: lisp -s tests/test1.scm
+; each top-level expression is evaluated as soon as it is read,
+; so there is no outer list wrapping the program.
+;
+
+(define square
+    (lambda (n)
+        (* n n)))
+
+(display "Hello world!")
+
+(display (square 12))
+
+(define table
+    (quote (1 2 3 4 5 6 7 8)))
+
+(display (cdr table))
+
+(square 3)